@@ -0,0 +1,1181 @@
+#include "descriptions.h"
+#include "json.h"
+#include "json_view.h"
+#include "json_writer.h"
+#include "metrics.h"
+#include "name_table.h"
+#include "priority_queues.h"
+#include "requests.h"
+#include "road_network.h"
+#include "router.h"
+#include "server.h"
+#include "spatial_index.h"
+#include "sphere.h"
+#include "timetable_router.h"
+#include "transport_catalog.h"
+#include "transport_router.h"
+
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <limits>
+#include <numeric>
+#include <optional>
+#include <random>
+#include <string>
+#include <system_error>
+#include <thread>
+#include <vector>
+
+using namespace std;
+
+namespace {
+
+  struct NetworkParams {
+    size_t stop_count = 1000;
+    size_t bus_count = 200;
+    size_t stops_per_bus = 50;
+    size_t query_count = 1000;
+    // A bus goes on to the closest of this many random stops; 1 makes buses jump all over the city
+    size_t next_stop_candidates = 20;
+    // Buses with bus_idx % 100 below this go round, the others go there and back
+    size_t roundtrip_percent = 100;
+    // Road distances from every stop to nearby stops no bus goes between, making the input denser
+    size_t extra_distances_per_stop = 0;
+  };
+
+  struct Network {
+    vector<Descriptions::Stop> stops;
+    vector<Descriptions::Bus> buses;  // with stops of both ways for buses that are not roundtrip
+    vector<bool> roundtrip_buses;  // by index in buses
+    Descriptions::StopsDict stops_dict;
+    Descriptions::BusesDict buses_dict;
+    NameTable stop_names;
+    NameTable bus_names;
+    vector<BusRoute> bus_routes;
+    vector<Sphere::Point> stop_positions;  // by stop id
+  };
+
+  size_t ChooseNextStop(const vector<Descriptions::Stop>& stops, size_t prev_stop_idx, size_t candidate_count,
+                        mt19937& generator) {
+    uniform_int_distribution<size_t> stop_idx_distribution(0, stops.size() - 1);
+    size_t next_stop_idx = stop_idx_distribution(generator);
+    double next_stop_distance = Sphere::Distance(stops[prev_stop_idx].position, stops[next_stop_idx].position);
+    for (size_t i = 1; i < candidate_count; ++i) {
+      const size_t stop_idx = stop_idx_distribution(generator);
+      const double distance = Sphere::Distance(stops[prev_stop_idx].position, stops[stop_idx].position);
+      if (stop_idx != prev_stop_idx && (next_stop_idx == prev_stop_idx || distance < next_stop_distance)) {
+        next_stop_idx = stop_idx;
+        next_stop_distance = distance;
+      }
+    }
+    return next_stop_idx;
+  }
+
+  Network GenerateNetwork(const NetworkParams& params, mt19937& generator) {
+    Network network;
+    uniform_real_distribution<double> latitude(55.5, 55.9);
+    uniform_real_distribution<double> longitude(37.3, 37.9);
+    uniform_int_distribution<int> distance(300, 3000);
+
+    network.stops.reserve(params.stop_count);
+    for (size_t stop_idx = 0; stop_idx < params.stop_count; ++stop_idx) {
+      network.stops.push_back({"Stop " + to_string(stop_idx), {latitude(generator), longitude(generator)}, {}});
+    }
+
+    uniform_int_distribution<size_t> stop_idx_distribution(0, params.stop_count - 1);
+    network.buses.reserve(params.bus_count);
+    for (size_t bus_idx = 0; bus_idx < params.bus_count; ++bus_idx) {
+      Descriptions::Bus bus{"Bus " + to_string(bus_idx), {}};
+      const bool is_roundtrip = bus_idx % 100 < params.roundtrip_percent;
+      // A roundtrip bus comes back to its first stop, so it has one more stop to choose
+      const size_t last_i = is_roundtrip ? params.stops_per_bus : params.stops_per_bus - 1;
+      size_t first_stop_idx = stop_idx_distribution(generator);
+      size_t prev_stop_idx = first_stop_idx;
+      bus.stops.push_back(network.stops[first_stop_idx].name);
+      for (size_t i = 1; i <= last_i; ++i) {
+        const size_t stop_idx = is_roundtrip && i == last_i
+            ? first_stop_idx
+            : ChooseNextStop(network.stops, prev_stop_idx, params.next_stop_candidates, generator);
+        network.stops[prev_stop_idx].distances[network.stops[stop_idx].name] = distance(generator);
+        bus.stops.push_back(network.stops[stop_idx].name);
+        prev_stop_idx = stop_idx;
+      }
+      if (!is_roundtrip) {
+        for (size_t stop_idx = bus.stops.size() - 1; stop_idx > 0; --stop_idx) {
+          bus.stops.push_back(bus.stops[stop_idx - 1]);
+        }
+      }
+      network.buses.push_back(move(bus));
+      network.roundtrip_buses.push_back(is_roundtrip);
+    }
+
+    for (size_t stop_idx = 0; stop_idx < params.stop_count; ++stop_idx) {
+      for (size_t i = 0; i < params.extra_distances_per_stop; ++i) {
+        const size_t neighbour_idx = ChooseNextStop(network.stops, stop_idx, params.next_stop_candidates, generator);
+        if (neighbour_idx != stop_idx) {
+          network.stops[stop_idx].distances.emplace(network.stops[neighbour_idx].name, distance(generator));
+        }
+      }
+    }
+
+    vector<string> stop_names;
+    for (const auto& stop : network.stops) {
+      network.stops_dict[stop.name] = &stop;
+      stop_names.push_back(stop.name);
+    }
+    vector<string> bus_names;
+    for (const auto& bus : network.buses) {
+      network.buses_dict[bus.name] = &bus;
+      bus_names.push_back(bus.name);
+    }
+    network.stop_names = NameTable(move(stop_names));
+    network.bus_names = NameTable(move(bus_names));
+    network.bus_routes = MakeBusRoutes(network.buses_dict, network.stop_names, network.bus_names,
+                                       RoadDistances(network.stops_dict, network.stop_names));
+    for (const string& stop_name : network.stop_names.GetNames()) {
+      network.stop_positions.push_back(network.stops_dict.at(stop_name)->position);
+    }
+    return network;
+  }
+
+  double ComputeMilliseconds(chrono::steady_clock::duration duration) {
+    return chrono::duration<double, milli>(duration).count();
+  }
+
+  struct GraphModelStats {
+    double build_ms;
+    size_t vertex_count;
+    size_t edge_count;
+    double query_us;
+    double settled_vertex_count;  // per query
+    vector<double> total_times;
+  };
+
+  double GetPeakRssMegabytes() {
+    rusage usage{};
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_maxrss / 1024.0;  // kilobytes on Linux
+  }
+
+  // The network as main reads it, with requests of every type. Buses depart every 10 minutes all day long.
+  string MakeInputDocument(const Network& network, const NetworkParams& params, mt19937& generator) {
+    string document;
+    Json::Writer writer(document);
+    writer.BeginObject().Key("base_requests").BeginArray();
+    for (const auto& stop : network.stops) {
+      writer.BeginObject()
+          .Key("type").String("Stop")
+          .Key("name").String(stop.name)
+          .Key("latitude").Double(stop.position.latitude)
+          .Key("longitude").Double(stop.position.longitude)
+          .Key("road_distances").BeginObject();
+      for (const auto& [neighbour_name, distance] : stop.distances) {
+        writer.Key(neighbour_name).Int(distance);
+      }
+      writer.EndObject().EndObject();
+    }
+    for (size_t bus_idx = 0; bus_idx < network.buses.size(); ++bus_idx) {
+      const auto& bus = network.buses[bus_idx];
+      const bool is_roundtrip = network.roundtrip_buses[bus_idx];
+      writer.BeginObject()
+          .Key("type").String("Bus")
+          .Key("name").String(bus.name)
+          .Key("stops").BeginArray();
+      const size_t stop_count = is_roundtrip ? bus.stops.size() : bus.stops.size() / 2 + 1;
+      for (size_t stop_idx = 0; stop_idx < stop_count; ++stop_idx) {
+        writer.String(bus.stops[stop_idx]);
+      }
+      writer.EndArray()
+          .Key("is_roundtrip").Bool(is_roundtrip)
+          .Key("departures").BeginArray();
+      for (int departure = 5 * 60 + static_cast<int>(bus_idx % 10); departure <= 23 * 60; departure += 10) {
+        writer.Int(departure);
+      }
+      writer.EndArray().EndObject();
+    }
+    writer.EndArray();
+
+    writer.Key("routing_settings").BeginObject()
+        .Key("bus_wait_time").Int(6)
+        .Key("bus_velocity").Double(40)
+        .EndObject();
+
+    uniform_int_distribution<size_t> stop_idx_distribution(0, network.stops.size() - 1);
+    uniform_int_distribution<size_t> bus_idx_distribution(0, network.buses.size() - 1);
+    uniform_real_distribution<double> latitude(55.5, 55.9);
+    uniform_real_distribution<double> longitude(37.3, 37.9);
+    uniform_int_distribution<int> departure_time(5 * 60, 22 * 60);
+    auto random_stop = [&]() -> const string& { return network.stops[stop_idx_distribution(generator)].name; };
+    auto write_point = [&] {
+      writer.BeginObject()
+          .Key("latitude").Double(latitude(generator))
+          .Key("longitude").Double(longitude(generator))
+          .EndObject();
+    };
+    int request_id = 0;
+    writer.Key("stat_requests").BeginArray();
+    for (size_t i = 0; i < params.query_count; ++i) {
+      writer.BeginObject().Key("type").String("Stop").Key("id").Int(++request_id)
+          .Key("name").String(random_stop()).EndObject();
+      writer.BeginObject().Key("type").String("Bus").Key("id").Int(++request_id)
+          .Key("name").String(network.buses[bus_idx_distribution(generator)].name).EndObject();
+      writer.BeginObject().Key("type").String("Route").Key("id").Int(++request_id)
+          .Key("from").String(random_stop()).Key("to").String(random_stop()).EndObject();
+      writer.BeginObject().Key("type").String("NearestStops").Key("id").Int(++request_id)
+          .Key("latitude").Double(latitude(generator)).Key("longitude").Double(longitude(generator))
+          .Key("count").Int(5).EndObject();
+      writer.BeginObject().Key("type").String("PointRoute").Key("id").Int(++request_id).Key("from");
+      write_point();
+      writer.Key("to");
+      write_point();
+      writer.EndObject();
+      writer.BeginObject().Key("type").String("TimetableRoute").Key("id").Int(++request_id)
+          .Key("from").String(random_stop()).Key("to").String(random_stop())
+          .Key("departure_time").Int(departure_time(generator)).EndObject();
+    }
+    // A matrix costs as much as a search per source, so there are fewer of them
+    for (size_t i = 0; i < max<size_t>(1, params.query_count / 50); ++i) {
+      writer.BeginObject().Key("type").String("RouteMatrix").Key("id").Int(++request_id).Key("from").BeginArray();
+      for (size_t j = 0; j < 5; ++j) {
+        writer.String(random_stop());
+      }
+      writer.EndArray().Key("to").BeginArray();
+      for (size_t j = 0; j < 20; ++j) {
+        writer.String(random_stop());
+      }
+      writer.EndArray().EndObject();
+    }
+    writer.EndArray().EndObject();
+    return document;
+  }
+
+  // The whole way of an input document through main: parsing, building the catalog and answering requests,
+  // with latency percentiles by request type
+  void BenchmarkPipeline(const Network& network, const NetworkParams& params, mt19937& generator) {
+    const string document = MakeInputDocument(network, params, generator);
+    cout << "pipeline  document_mb=" << document.size() / (1024.0 * 1024.0) << endl;
+
+    auto start = chrono::steady_clock::now();
+    const Json::ViewNode view = Json::LoadView(document);
+    const auto view_descriptions = Descriptions::ReadDescriptions(view.AsMap().at("base_requests").AsArray());
+    cout << "load_view_ms=" << ComputeMilliseconds(chrono::steady_clock::now() - start) << endl;
+
+    start = chrono::steady_clock::now();
+    auto input_document = Descriptions::ReadInputDocument(document);
+    cout << "read_input_document_ms=" << ComputeMilliseconds(chrono::steady_clock::now() - start) << endl;
+
+    start = chrono::steady_clock::now();
+    const TransportCatalog catalog(move(input_document.descriptions),
+                                   input_document.sections.at("routing_settings").AsMap());
+    cout << "catalog_build_ms=" << ComputeMilliseconds(chrono::steady_clock::now() - start) << endl;
+    cout << "peak_rss_mb=" << GetPeakRssMegabytes() << endl;
+
+    map<string, vector<double>> latencies_us;  // by request type
+    string response;
+    for (const auto& request : input_document.sections.at("stat_requests").AsArray()) {
+      response.clear();
+      Json::Writer writer(response);
+      start = chrono::steady_clock::now();
+      Requests::Process(catalog, request, writer);
+      const double latency_us = ComputeMilliseconds(chrono::steady_clock::now() - start) * 1000;
+      latencies_us[request.AsMap().at("type").AsString()].push_back(latency_us);
+    }
+
+    cout << "request_type  count  p50_us  p90_us  p99_us  max_us" << endl;
+    for (auto& [type, latencies] : latencies_us) {
+      sort(begin(latencies), end(latencies));
+      auto percentile = [&latencies](double share) {
+        return latencies[min(latencies.size() - 1, static_cast<size_t>(share * latencies.size()))];
+      };
+      cout << type << "  " << latencies.size() << "  " << percentile(0.5) << "  " << percentile(0.9) << "  "
+           << percentile(0.99) << "  " << latencies.back() << endl;
+    }
+  }
+
+  Json::Dict MakeRoutingSettings(const string& graph_model, const string& route_search) {
+    return {
+        {"bus_wait_time", Json::Node(6)},
+        {"bus_velocity", Json::Node(40.0)},
+        {"graph_model", Json::Node(graph_model)},
+        {"route_search", Json::Node(route_search)},
+    };
+  }
+
+  GraphModelStats BenchmarkGraphModel(const Network& network,
+                                      const string& graph_model,
+                                      const string& route_search,
+                                      const vector<pair<NameId, NameId>>& queries) {
+    const Json::Dict routing_settings = MakeRoutingSettings(graph_model, route_search);
+
+    GraphModelStats stats;
+    auto start = chrono::steady_clock::now();
+    const TransportRouter router(network.stop_positions, network.bus_routes, routing_settings);
+    stats.build_ms = ComputeMilliseconds(chrono::steady_clock::now() - start);
+    stats.vertex_count = router.GetVertexCount();
+    stats.edge_count = router.GetEdgeCount();
+
+    stats.total_times.reserve(queries.size());
+    size_t settled_vertex_count = 0;
+    start = chrono::steady_clock::now();
+    for (const auto& [stop_from, stop_to] : queries) {
+      const auto route = router.FindRoute(stop_from, stop_to);
+      stats.total_times.push_back(route ? route->total_time : -1);
+      settled_vertex_count += route ? route->settled_vertex_count : 0;
+    }
+    stats.query_us = ComputeMilliseconds(chrono::steady_clock::now() - start) * 1000 / queries.size();
+    stats.settled_vertex_count = static_cast<double>(settled_vertex_count) / queries.size();
+    return stats;
+  }
+
+  void BenchmarkGraphModels(const Network& network, const NetworkParams& params, mt19937& generator) {
+    uniform_int_distribution<size_t> stop_idx_distribution(0, params.stop_count - 1);
+    vector<pair<NameId, NameId>> queries;
+    queries.reserve(params.query_count);
+    for (size_t i = 0; i < params.query_count; ++i) {
+      const auto& stop_from = network.stops[stop_idx_distribution(generator)];
+      const auto& stop_to = network.stops[stop_idx_distribution(generator)];
+      queries.emplace_back(network.stop_names.GetId(stop_from.name), network.stop_names.GetId(stop_to.name));
+    }
+
+    // Settled vertices are counted for found routes only
+    cout << "graph_model  route_search  build_ms  vertices  edges  query_us  settled  time_mismatches" << endl;
+    vector<GraphModelStats> all_stats;
+    for (const string graph_model : {"stop_pairs", "rides"}) {
+      for (const string route_search : {"dijkstra", "bidirectional_a_star", "contraction_hierarchies"}) {
+        const auto& stats = all_stats.emplace_back(BenchmarkGraphModel(network, graph_model, route_search, queries));
+        // Against the first configuration
+        size_t mismatch_count = 0;
+        for (size_t i = 0; i < queries.size(); ++i) {
+          if (abs(all_stats.front().total_times[i] - stats.total_times[i]) > 1e-6) {
+            ++mismatch_count;
+          }
+        }
+        cout << graph_model << "  " << route_search << "  " << stats.build_ms << "  " << stats.vertex_count << "  "
+             << stats.edge_count << "  " << stats.query_us << "  " << stats.settled_vertex_count << "  "
+             << mismatch_count << endl;
+      }
+    }
+  }
+
+  // Popular stop pairs are asked for far more often: the k-th most popular pair has weight 1 / k
+  void BenchmarkRouteCache(const Network& network, const NetworkParams& params, mt19937& generator) {
+    const size_t pair_count = params.query_count;
+    uniform_int_distribution<size_t> stop_idx_distribution(0, params.stop_count - 1);
+    vector<pair<NameId, NameId>> stop_pairs;
+    vector<double> pair_weights;
+    for (size_t i = 0; i < pair_count; ++i) {
+      const auto& stop_from = network.stops[stop_idx_distribution(generator)];
+      const auto& stop_to = network.stops[stop_idx_distribution(generator)];
+      stop_pairs.emplace_back(network.stop_names.GetId(stop_from.name), network.stop_names.GetId(stop_to.name));
+      pair_weights.push_back(1.0 / (i + 1));
+    }
+    discrete_distribution<size_t> pair_idx_distribution(begin(pair_weights), end(pair_weights));
+    vector<pair<NameId, NameId>> queries;
+    queries.reserve(params.query_count * 10);
+    for (size_t i = 0; i < params.query_count * 10; ++i) {
+      queries.push_back(stop_pairs[pair_idx_distribution(generator)]);
+    }
+
+    cout << "route_cache_size  query_us  hits  misses  evictions" << endl;
+    for (const size_t cache_size : {0, 10, 100, 1000}) {
+      Json::Dict routing_settings = MakeRoutingSettings("rides", "dijkstra");
+      routing_settings["route_cache_size"] = Json::Node(static_cast<int>(cache_size));
+      const TransportRouter router(network.stop_positions, network.bus_routes, routing_settings);
+
+      const auto start = chrono::steady_clock::now();
+      for (const auto& [stop_from, stop_to] : queries) {
+        router.FindRoute(stop_from, stop_to);
+      }
+      const double query_us = ComputeMilliseconds(chrono::steady_clock::now() - start) * 1000 / queries.size();
+      const auto cache_stats = router.GetRouteCacheStats().value_or(LruCacheStats{0, queries.size(), 0});
+      cout << cache_size << "  " << query_us << "  " << cache_stats.hit_count << "  " << cache_stats.miss_count
+           << "  " << cache_stats.eviction_count << endl;
+    }
+  }
+
+  // Travel times between 10 sources and all stops: one FindRoute per pair against one search per source
+  void BenchmarkRouteMatrix(const Network& network, const NetworkParams& params) {
+    vector<NameId> stops_to(params.stop_count);
+    iota(begin(stops_to), end(stops_to), 0);
+    const vector<NameId> stops_from(begin(stops_to), begin(stops_to) + min<size_t>(10, params.stop_count));
+    const TransportRouter router(network.stop_positions, network.bus_routes, MakeRoutingSettings("rides", "dijkstra"));
+
+    cout << "route_matrix  threads  ms  time_mismatches" << endl;
+    vector<vector<optional<double>>> total_times(stops_from.size());
+    auto start = chrono::steady_clock::now();
+    for (size_t from_idx = 0; from_idx < stops_from.size(); ++from_idx) {
+      for (const NameId stop_to : stops_to) {
+        const auto route = router.FindRoute(stops_from[from_idx], stop_to);
+        total_times[from_idx].push_back(route ? optional(route->total_time) : nullopt);
+      }
+    }
+    cout << "find_route  1  " << ComputeMilliseconds(chrono::steady_clock::now() - start) << "  0" << endl;
+
+    for (const size_t thread_count : {1, 4}) {
+      start = chrono::steady_clock::now();
+      const auto matrix = router.FindRouteMatrix(stops_from, stops_to, {}, thread_count);
+      const double matrix_ms = ComputeMilliseconds(chrono::steady_clock::now() - start);
+      size_t mismatch_count = 0;
+      for (size_t from_idx = 0; from_idx < stops_from.size(); ++from_idx) {
+        for (size_t to_idx = 0; to_idx < stops_to.size(); ++to_idx) {
+          const auto& expected = total_times[from_idx][to_idx];
+          const auto& actual = matrix.total_times[from_idx][to_idx];
+          if (expected.has_value() != actual.has_value() || (expected && abs(*expected - *actual) > 1e-6)) {
+            ++mismatch_count;
+          }
+        }
+      }
+      cout << "find_route_matrix  " << thread_count << "  " << matrix_ms << "  " << mismatch_count << endl;
+    }
+  }
+
+  template <typename Queue>
+  vector<optional<double>> RunRouteQueries(const Graph::FrozenGraph<double>& graph,
+                                           const vector<pair<Graph::VertexId, Graph::VertexId>>& queries,
+                                           const string& queue_name) {
+    const Graph::Router<double, Queue> router(graph);
+    vector<optional<double>> weights;
+    weights.reserve(queries.size());
+    size_t settled_vertex_count = 0;
+    const auto start = chrono::steady_clock::now();
+    for (const auto& [from, to] : queries) {
+      const auto route = router.BuildRoute(from, to);
+      weights.push_back(route ? optional(route->weight) : nullopt);
+      settled_vertex_count += route ? route->settled_vertex_count : 0;
+    }
+    const double query_us = ComputeMilliseconds(chrono::steady_clock::now() - start) * 1000 / queries.size();
+    cout << queue_name << "  " << query_us << "  " << static_cast<double>(settled_vertex_count) / queries.size();
+    return weights;
+  }
+
+  // Queues of Router on a stop pairs graph: a bus edge from every stop to every later one of the bus,
+  // weighted by minutes of waiting and riding the way TransportRouter does with default settings
+  void BenchmarkRouteQueues(const Network& network, const NetworkParams& params, mt19937& generator) {
+    const double bus_wait_time = 6;
+    const double meters_per_minute = 40 * 1000.0 / 60;
+    Graph::DirectedWeightedGraph<double> builder(params.stop_count);
+    for (const auto& bus_route : network.bus_routes) {
+      for (size_t from_idx = 0; from_idx < bus_route.stop_ids.size(); ++from_idx) {
+        for (size_t to_idx = from_idx + 1; to_idx < bus_route.stop_ids.size(); ++to_idx) {
+          builder.AddEdge({bus_route.stop_ids[from_idx], bus_route.stop_ids[to_idx],
+                           bus_wait_time + bus_route.ComputeDistance(from_idx, to_idx) / meters_per_minute});
+        }
+      }
+    }
+    const Graph::FrozenGraph<double> graph(builder);
+
+    uniform_int_distribution<Graph::VertexId> vertex_distribution(0, params.stop_count - 1);
+    vector<pair<Graph::VertexId, Graph::VertexId>> queries;
+    queries.reserve(params.query_count);
+    for (size_t i = 0; i < params.query_count; ++i) {
+      queries.emplace_back(vertex_distribution(generator), vertex_distribution(generator));
+    }
+
+    cout << "route_queue  query_us  settled  weight_mismatches  (" << graph.GetEdgeCount() << " edges)" << endl;
+    const auto expected = RunRouteQueries<Graph::IndexedBinaryHeap<double>>(graph, queries, "indexed_binary_heap");
+    cout << "  0" << endl;
+    const auto actual = RunRouteQueries<Graph::RadixHeap<double>>(graph, queries, "radix_heap");
+    size_t mismatch_count = 0;
+    for (size_t i = 0; i < queries.size(); ++i) {
+      if (expected[i].has_value() != actual[i].has_value() || (expected[i] && abs(*expected[i] - *actual[i]) > 1e-6)) {
+        ++mismatch_count;
+      }
+    }
+    cout << "  " << mismatch_count << endl;
+  }
+
+  TransportCatalog BuildCatalog(const vector<Descriptions::Stop>& stops, const vector<Descriptions::Bus>& buses,
+                                const Json::Dict& routing_settings) {
+    vector<Descriptions::InputQuery> data(begin(stops), end(stops));
+    data.insert(end(data), begin(buses), end(buses));
+    return TransportCatalog(move(data), routing_settings);
+  }
+
+  // Sphere::Distance against distances between points of a Sphere::PointSet, which must be exactly the same
+  void BenchmarkSphereDistances(const Network& network) {
+    const size_t repeat_count = 100;
+    const Sphere::PointSet stop_points(network.stop_positions);
+    size_t route_distance_count = 0;
+    for (const auto& bus_route : network.bus_routes) {
+      route_distance_count += bus_route.stop_ids.size() - 1;
+    }
+
+    cout << "distances  kernel  ns_per_distance  max_difference_m" << endl;
+    vector<double> expected(network.bus_routes.size());
+    auto start = chrono::steady_clock::now();
+    for (size_t i = 0; i < repeat_count; ++i) {
+      for (size_t bus_idx = 0; bus_idx < network.bus_routes.size(); ++bus_idx) {
+        const auto& stop_ids = network.bus_routes[bus_idx].stop_ids;
+        double distance = 0;
+        for (size_t stop_idx = 1; stop_idx < stop_ids.size(); ++stop_idx) {
+          distance += Sphere::Distance(network.stop_positions[stop_ids[stop_idx - 1]],
+                                       network.stop_positions[stop_ids[stop_idx]]);
+        }
+        expected[bus_idx] = distance;
+      }
+    }
+    double ns_per_distance = ComputeMilliseconds(chrono::steady_clock::now() - start) * 1e6
+        / (repeat_count * route_distance_count);
+    cout << "routes  scalar  " << ns_per_distance << "  0" << endl;
+
+    vector<double> actual(network.bus_routes.size());
+    start = chrono::steady_clock::now();
+    for (size_t i = 0; i < repeat_count; ++i) {
+      for (size_t bus_idx = 0; bus_idx < network.bus_routes.size(); ++bus_idx) {
+        actual[bus_idx] = stop_points.ComputeRouteDistance(network.bus_routes[bus_idx].stop_ids);
+      }
+    }
+    ns_per_distance = ComputeMilliseconds(chrono::steady_clock::now() - start) * 1e6
+        / (repeat_count * route_distance_count);
+    double max_difference = 0;
+    for (size_t bus_idx = 0; bus_idx < network.bus_routes.size(); ++bus_idx) {
+      max_difference = max(max_difference, abs(expected[bus_idx] - actual[bus_idx]));
+    }
+    cout << "routes  point_set  " << ns_per_distance << "  " << max_difference << endl;
+
+    const size_t point_count = network.stop_positions.size();
+    vector<double> expected_row(point_count);
+    vector<double> row;
+    max_difference = 0;
+    chrono::steady_clock::duration scalar_duration{};
+    chrono::steady_clock::duration point_set_duration{};
+    for (size_t from_idx = 0; from_idx < point_count; ++from_idx) {
+      start = chrono::steady_clock::now();
+      for (size_t to_idx = 0; to_idx < point_count; ++to_idx) {
+        expected_row[to_idx] = Sphere::Distance(network.stop_positions[from_idx], network.stop_positions[to_idx]);
+      }
+      scalar_duration += chrono::steady_clock::now() - start;
+
+      start = chrono::steady_clock::now();
+      stop_points.ComputeDistancesFrom(from_idx, row);
+      point_set_duration += chrono::steady_clock::now() - start;
+
+      for (size_t to_idx = 0; to_idx < point_count; ++to_idx) {
+        // acos gives NaN for coinciding points either way
+        if (!isnan(expected_row[to_idx]) || !isnan(row[to_idx])) {
+          max_difference = max(max_difference, abs(expected_row[to_idx] - row[to_idx]));
+        }
+      }
+    }
+    const double pair_count = static_cast<double>(point_count) * point_count;
+    cout << "all_pairs  scalar  " << ComputeMilliseconds(scalar_duration) * 1e6 / pair_count << "  0" << endl;
+    cout << "all_pairs  point_set  " << ComputeMilliseconds(point_set_duration) * 1e6 / pair_count << "  "
+         << max_difference << endl;
+  }
+
+  // Nearest stops to random points by a linear scan and by the spatial index; the distances must be the same
+  void BenchmarkNearestStops(const Network& network, const NetworkParams& params, mt19937& generator) {
+    uniform_real_distribution<double> latitude(55.5, 55.9);
+    uniform_real_distribution<double> longitude(37.3, 37.9);
+    vector<Sphere::Point> points(params.query_count);
+    for (auto& point : points) {
+      point = {latitude(generator), longitude(generator)};
+    }
+    auto compute_distance = [&](Sphere::Point point, uint32_t stop_id) {
+      const double distance = Sphere::Distance(point, network.stop_positions[stop_id]);
+      return distance > 0 ? distance : 0;
+    };
+
+    const auto build_start = chrono::steady_clock::now();
+    const SpatialIndex index(network.stop_positions);
+    const double build_ms = ComputeMilliseconds(chrono::steady_clock::now() - build_start);
+    cout << "nearest_stops  build_ms=" << build_ms << endl;
+    cout << "count  scan_us  index_us  mismatches" << endl;
+
+    for (const size_t count : {1, 10, 100}) {
+      vector<vector<double>> expected(points.size());
+      vector<pair<double, uint32_t>> stop_distances(network.stop_positions.size());
+      auto start = chrono::steady_clock::now();
+      for (size_t point_idx = 0; point_idx < points.size(); ++point_idx) {
+        for (uint32_t stop_id = 0; stop_id < stop_distances.size(); ++stop_id) {
+          stop_distances[stop_id] = {compute_distance(points[point_idx], stop_id), stop_id};
+        }
+        const size_t found_count = min(count, stop_distances.size());
+        partial_sort(begin(stop_distances), begin(stop_distances) + found_count, end(stop_distances));
+        for (size_t i = 0; i < found_count; ++i) {
+          expected[point_idx].push_back(stop_distances[i].first);
+        }
+      }
+      const double scan_us = ComputeMilliseconds(chrono::steady_clock::now() - start) * 1000 / points.size();
+
+      vector<vector<uint32_t>> actual(points.size());
+      start = chrono::steady_clock::now();
+      for (size_t point_idx = 0; point_idx < points.size(); ++point_idx) {
+        actual[point_idx] = index.FindNearest(points[point_idx], count);
+      }
+      const double index_us = ComputeMilliseconds(chrono::steady_clock::now() - start) * 1000 / points.size();
+
+      // Ties and rounding may order stops differently, so only distances are compared
+      size_t mismatch_count = 0;
+      for (size_t point_idx = 0; point_idx < points.size(); ++point_idx) {
+        bool mismatch = actual[point_idx].size() != expected[point_idx].size();
+        for (size_t i = 0; !mismatch && i < actual[point_idx].size(); ++i) {
+          mismatch = abs(compute_distance(points[point_idx], actual[point_idx][i]) - expected[point_idx][i]) > 1e-6;
+        }
+        mismatch_count += mismatch;
+      }
+      cout << count << "  " << scan_us << "  " << index_us << "  " << mismatch_count << endl;
+    }
+  }
+
+  // Bus routes, bus stats and graph edges are made per bus on a thread pool; routes must not depend on thread count
+  void BenchmarkParallelBuild(const Network& network, const NetworkParams& params, mt19937& generator) {
+    uniform_int_distribution<size_t> stop_idx_distribution(0, params.stop_count - 1);
+    vector<pair<string, string>> queries;
+    for (size_t i = 0; i < params.query_count; ++i) {
+      queries.emplace_back(network.stops[stop_idx_distribution(generator)].name,
+                           network.stops[stop_idx_distribution(generator)].name);
+    }
+
+    cout << "graph_model  threads  build_ms  time_mismatches" << endl;
+    for (const string graph_model : {"stop_pairs", "rides"}) {
+      vector<double> expected_total_times;
+      for (const size_t thread_count : {1, 2, 4}) {
+        vector<Descriptions::InputQuery> data(begin(network.stops), end(network.stops));
+        data.insert(end(data), begin(network.buses), end(network.buses));
+        const auto start = chrono::steady_clock::now();
+        const TransportCatalog catalog(move(data), MakeRoutingSettings(graph_model, "dijkstra"), thread_count);
+        catalog.BuildDeferred();
+        const double build_ms = ComputeMilliseconds(chrono::steady_clock::now() - start);
+
+        vector<double> total_times;
+        for (const auto& [stop_from, stop_to] : queries) {
+          const auto route = catalog.FindRoute(stop_from, stop_to);
+          total_times.push_back(route ? route->total_time : -1);
+        }
+        if (expected_total_times.empty()) {
+          expected_total_times = total_times;
+        }
+        size_t mismatch_count = 0;
+        for (size_t i = 0; i < queries.size(); ++i) {
+          mismatch_count += total_times[i] != expected_total_times[i];
+        }
+        cout << graph_model << "  " << thread_count << "  " << build_ms << "  " << mismatch_count << endl;
+      }
+    }
+  }
+
+  // Updates of a catalog with precomputed routes and a warm route cache against building the changed one anew
+  void BenchmarkCatalogUpdates(const Network& network, const NetworkParams& params, mt19937& generator) {
+    uniform_int_distribution<size_t> stop_idx_distribution(0, params.stop_count - 1);
+    vector<pair<string, string>> queries;
+    for (size_t i = 0; i < params.query_count; ++i) {
+      queries.emplace_back(network.stops[stop_idx_distribution(generator)].name,
+                           network.stops[stop_idx_distribution(generator)].name);
+    }
+
+    struct Change {
+      string name;
+      Descriptions::Update update;
+      vector<Descriptions::Stop> stops;
+      vector<Descriptions::Bus> buses;
+    };
+    vector<Change> changes;
+    {
+      Change& change = changes.emplace_back(Change{"change_distance", {}, network.stops, network.buses});
+      auto& stop = change.stops.front();
+      auto& distance = begin(stop.distances)->second;
+      distance *= 2;
+      change.update.stops.push_back({stop.name, stop.position, {{begin(stop.distances)->first, distance}}});
+    }
+    {
+      // Distances are given one way only, the other way is looked up as well
+      Change& change = changes.emplace_back(Change{"add_bus", {}, network.stops, network.buses});
+      Descriptions::Bus bus{"Bus new", network.buses.front().stops};
+      reverse(begin(bus.stops), end(bus.stops));
+      change.buses.push_back(bus);
+      change.update.buses.push_back(move(bus));
+    }
+    {
+      Change& change = changes.emplace_back(Change{"remove_bus", {}, network.stops, network.buses});
+      change.update.removed_buses.push_back(change.buses.back().name);
+      change.buses.pop_back();
+    }
+
+    cout << "graph_model  change  update_ms  rebuild_ms  time_mismatches" << endl;
+    for (const string graph_model : {"stop_pairs", "rides"}) {
+      Json::Dict routing_settings = MakeRoutingSettings(graph_model, "dijkstra");
+      routing_settings["precompute_routes"] = Json::Node(true);
+      routing_settings["route_cache_size"] = Json::Node(static_cast<int>(params.query_count));
+      const TransportCatalog catalog = BuildCatalog(network.stops, network.buses, routing_settings);
+      for (const auto& [stop_from, stop_to] : queries) {
+        catalog.FindRoute(stop_from, stop_to);
+      }
+
+      for (const auto& change : changes) {
+        auto start = chrono::steady_clock::now();
+        const TransportCatalog updated_catalog = catalog.Update(change.update);
+        const double update_ms = ComputeMilliseconds(chrono::steady_clock::now() - start);
+
+        start = chrono::steady_clock::now();
+        const TransportCatalog rebuilt_catalog = BuildCatalog(change.stops, change.buses, routing_settings);
+        rebuilt_catalog.BuildDeferred();
+        const double rebuild_ms = ComputeMilliseconds(chrono::steady_clock::now() - start);
+
+        size_t mismatch_count = 0;
+        for (const auto& [stop_from, stop_to] : queries) {
+          const auto expected = rebuilt_catalog.FindRoute(stop_from, stop_to);
+          const auto actual = updated_catalog.FindRoute(stop_from, stop_to);
+          if (expected.has_value() != actual.has_value()
+              || (expected && abs(expected->total_time - actual->total_time) > 1e-6)) {
+            ++mismatch_count;
+          }
+        }
+        cout << graph_model << "  " << change.name << "  " << update_ms << "  " << rebuild_ms << "  "
+             << mismatch_count << endl;
+      }
+    }
+  }
+
+  // Earliest arrival by a time-dependent Dijkstra over stops: a bus of every route through a settled stop is taken
+  // at the first departure not earlier than the arrival there. Slow, but shares nothing with the connection scan.
+  double FindEarliestArrival(const vector<BusRoute>& bus_routes, size_t stop_count, double meters_per_minute,
+                             NameId stop_from, NameId stop_to, double departure_time) {
+    vector<vector<pair<size_t, size_t>>> stop_visits(stop_count);  // (bus index, stop index)
+    for (size_t bus_idx = 0; bus_idx < bus_routes.size(); ++bus_idx) {
+      for (size_t stop_idx = 0; stop_idx + 1 < bus_routes[bus_idx].stop_ids.size(); ++stop_idx) {
+        stop_visits[bus_routes[bus_idx].stop_ids[stop_idx]].emplace_back(bus_idx, stop_idx);
+      }
+    }
+    vector<double> arrival_times(stop_count, numeric_limits<double>::infinity());
+    vector<bool> settled(stop_count);
+    arrival_times[stop_from] = departure_time;
+    for (size_t settled_count = 0; settled_count < stop_count; ++settled_count) {
+      NameId stop_id = 0;
+      for (NameId candidate = 0; candidate < stop_count; ++candidate) {
+        if (!settled[candidate] && (settled[stop_id] || arrival_times[candidate] < arrival_times[stop_id])) {
+          stop_id = candidate;
+        }
+      }
+      if (stop_id == stop_to || arrival_times[stop_id] == numeric_limits<double>::infinity()) {
+        break;
+      }
+      settled[stop_id] = true;
+      for (const auto& [bus_idx, stop_idx] : stop_visits[stop_id]) {
+        const auto& bus_route = bus_routes[bus_idx];
+        const double offset = bus_route.distances_from_start[stop_idx] / meters_per_minute;
+        const auto departure = find_if(begin(bus_route.departures), end(bus_route.departures), [&](int departure) {
+          return departure + offset >= arrival_times[stop_id];
+        });
+        if (departure == end(bus_route.departures)) {
+          continue;
+        }
+        for (size_t next_idx = stop_idx + 1; next_idx < bus_route.stop_ids.size(); ++next_idx) {
+          double& arrival_time = arrival_times[bus_route.stop_ids[next_idx]];
+          arrival_time = min(arrival_time, *departure + bus_route.distances_from_start[next_idx] / meters_per_minute);
+        }
+      }
+    }
+    return arrival_times[stop_to];
+  }
+
+  // Earliest arrival queries by the connection scan of TimetableRouter against FindEarliestArrival
+  void BenchmarkTimetableRoutes(const Network& network, const NetworkParams& params, mt19937& generator) {
+    const double bus_velocity = 40;
+    const Json::Dict routing_settings = MakeRoutingSettings("stop_pairs", "dijkstra");
+    cout << "timetable  headway_min  connections  build_ms  query_us  found  arrival_mismatches" << endl;
+    for (const int headway : {30, 10, 5}) {
+      vector<BusRoute> bus_routes = network.bus_routes;
+      uniform_int_distribution<int> first_departure(5 * 60, 5 * 60 + headway - 1);
+      for (auto& bus_route : bus_routes) {
+        for (int departure = first_departure(generator); departure <= 23 * 60; departure += headway) {
+          bus_route.departures.push_back(departure);
+        }
+      }
+
+      const auto build_start = chrono::steady_clock::now();
+      const TimetableRouter router(network.stop_positions.size(), bus_routes, routing_settings);
+      const double build_ms = ComputeMilliseconds(chrono::steady_clock::now() - build_start);
+
+      uniform_int_distribution<NameId> stop_id_distribution(0, params.stop_count - 1);
+      uniform_int_distribution<int> departure_time_distribution(5 * 60, 22 * 60);
+      struct Query {
+        NameId stop_from;
+        NameId stop_to;
+        double departure_time;
+      };
+      vector<Query> queries(params.query_count);
+      for (auto& query : queries) {
+        query = {stop_id_distribution(generator), stop_id_distribution(generator),
+                 static_cast<double>(departure_time_distribution(generator))};
+      }
+
+      vector<double> arrival_times;
+      const auto start = chrono::steady_clock::now();
+      for (const auto& query : queries) {
+        const auto route = router.FindRoute(query.stop_from, query.stop_to, query.departure_time);
+        arrival_times.push_back(route ? route->arrival_time : numeric_limits<double>::infinity());
+      }
+      const double query_us = ComputeMilliseconds(chrono::steady_clock::now() - start) * 1000 / queries.size();
+
+      // The reference is slow, so only some of the queries are checked
+      const size_t checked_count = min<size_t>(queries.size(), 100);
+      size_t found_count = 0;
+      size_t mismatch_count = 0;
+      for (size_t query_idx = 0; query_idx < queries.size(); ++query_idx) {
+        found_count += arrival_times[query_idx] != numeric_limits<double>::infinity();
+        if (query_idx < checked_count) {
+          const auto& query = queries[query_idx];
+          mismatch_count += arrival_times[query_idx] != FindEarliestArrival(
+              bus_routes, network.stop_positions.size(), bus_velocity * 1000.0 / 60,
+              query.stop_from, query.stop_to, query.departure_time
+          );
+        }
+      }
+      cout << headway << "  " << router.GetConnectionCount() << "  " << build_ms << "  " << query_us << "  "
+           << found_count << "  " << mismatch_count << endl;
+    }
+  }
+
+  // Route queries with metrics disabled and enabled; the disabled ones should take as long as before metrics
+  void BenchmarkMetricsOverhead(const Network& network, const NetworkParams& params, mt19937& generator) {
+    uniform_int_distribution<NameId> stop_id_distribution(0, params.stop_count - 1);
+    vector<pair<NameId, NameId>> queries(params.query_count);
+    for (auto& [stop_from, stop_to] : queries) {
+      stop_from = stop_id_distribution(generator);
+      stop_to = stop_id_distribution(generator);
+    }
+    const TransportRouter router(network.stop_positions, network.bus_routes,
+                                 MakeRoutingSettings("stop_pairs", "dijkstra"));
+    // Warms up caches and search states, so that the first measured pass is not slower for that
+    for (const auto& [stop_from, stop_to] : queries) {
+      router.FindRoute(stop_from, stop_to);
+    }
+
+    cout << "metrics  query_us  relaxations_per_search  heap_pops_per_search" << endl;
+    for (const bool is_enabled : {false, true}) {
+      Metrics::Reset();
+      Metrics::Enable(is_enabled);
+      const auto start = chrono::steady_clock::now();
+      for (const auto& [stop_from, stop_to] : queries) {
+        router.FindRoute(stop_from, stop_to);
+      }
+      const double query_us = ComputeMilliseconds(chrono::steady_clock::now() - start) * 1000 / queries.size();
+      string metrics;
+      Json::Writer writer(metrics);
+      Metrics::Write(writer);
+      const Json::ViewNode metrics_node = Json::LoadView(metrics);
+      const auto& per_search = metrics_node.AsMap().at("per_search").AsMap();
+      cout << (is_enabled ? "enabled" : "disabled") << "  " << query_us << "  "
+           << per_search.at("relaxations").AsDouble() << "  " << per_search.at("heap_pops").AsDouble() << endl;
+    }
+    Metrics::Enable(false);
+  }
+
+  // Sends requests over one connection of the server, keeping up to window of them unanswered.
+  // Returns latencies of requests in microseconds and counts responses other than expected.
+  vector<double> LoadServer(const string& socket_path, const vector<string>& requests,
+                            const vector<string>& expected_responses, size_t window, size_t& mismatch_count) {
+    const int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    sockaddr_un address{};
+    address.sun_family = AF_UNIX;
+    strcpy(address.sun_path, socket_path.c_str());
+    if (fd < 0 || connect(fd, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) != 0) {
+      throw system_error(errno, generic_category(), "connect " + socket_path);
+    }
+
+    vector<chrono::steady_clock::time_point> send_times(requests.size());
+    vector<double> latencies_us;
+    latencies_us.reserve(requests.size());
+    size_t sent_count = 0;
+    string input;
+    char buffer[64 * 1024];
+    while (latencies_us.size() < requests.size()) {
+      while (sent_count < requests.size() && sent_count - latencies_us.size() < window) {
+        send_times[sent_count] = chrono::steady_clock::now();
+        const string& request = requests[sent_count++];
+        for (size_t written_size = 0; written_size < request.size();) {
+          written_size += send(fd, request.data() + written_size, request.size() - written_size, MSG_NOSIGNAL);
+        }
+      }
+      const ssize_t read_size = read(fd, buffer, sizeof(buffer));
+      if (read_size <= 0) {
+        break;
+      }
+      input.append(buffer, read_size);
+      size_t line_begin = 0;
+      for (size_t line_end = input.find('\n'); line_end != string::npos;
+           line_begin = line_end + 1, line_end = input.find('\n', line_begin)) {
+        const size_t request_idx = latencies_us.size();
+        latencies_us.push_back(ComputeMilliseconds(chrono::steady_clock::now() - send_times[request_idx]) * 1000);
+        mismatch_count += string_view(input).substr(line_begin, line_end - line_begin)
+            != expected_responses[request_idx];
+      }
+      input.erase(0, line_begin);
+    }
+    close(fd);
+    mismatch_count += requests.size() - latencies_us.size();
+    return latencies_us;
+  }
+
+  // Sustained throughput and latency of the server against local clients pipelining Stop, Bus and Route requests;
+  // responses are compared to those of Requests::Process
+  void BenchmarkServer(const Network& network, const NetworkParams& params, mt19937& generator) {
+    vector<Descriptions::InputQuery> data(begin(network.stops), end(network.stops));
+    data.insert(end(data), begin(network.buses), end(network.buses));
+    const TransportCatalog catalog(move(data), MakeRoutingSettings("stop_pairs", "dijkstra"));
+
+    uniform_int_distribution<size_t> stop_idx_distribution(0, network.stops.size() - 1);
+    uniform_int_distribution<size_t> bus_idx_distribution(0, network.buses.size() - 1);
+    auto random_stop = [&]() -> const string& { return network.stops[stop_idx_distribution(generator)].name; };
+    vector<string> requests;
+    vector<string> expected_responses;
+    for (size_t i = 0; i < params.query_count; ++i) {
+      string request;
+      Json::Writer writer(request);
+      const int request_id = static_cast<int>(i);
+      writer.BeginObject().Key("id").Int(request_id);
+      switch (i % 3) {
+        case 0:
+          writer.Key("type").String("Stop").Key("name").String(random_stop());
+          break;
+        case 1:
+          writer.Key("type").String("Bus").Key("name").String(network.buses[bus_idx_distribution(generator)].name);
+          break;
+        default:
+          writer.Key("type").String("Route").Key("from").String(random_stop()).Key("to").String(random_stop());
+      }
+      writer.EndObject();
+
+      string response;
+      Json::Writer response_writer(response);
+      Requests::Process(catalog, Json::LoadView(request), response_writer);
+      requests.push_back(move(request) + '\n');
+      expected_responses.push_back(move(response));
+    }
+
+    const string socket_path = "/tmp/transport_guide_benchmark_" + to_string(getpid()) + ".sock";
+    const size_t window = 32;
+    cout << "server  window=" << window << endl;
+    cout << "workers  connections  qps  p50_us  p99_us  max_us  response_mismatches" << endl;
+    for (const size_t worker_count : {1, 4}) {
+      for (const size_t connection_count : {1, 4, 16}) {
+        Server server(catalog, socket_path, worker_count);
+        thread server_thread([&server] { server.Run(); });
+
+        vector<vector<double>> connection_latencies(connection_count);
+        vector<size_t> mismatch_counts(connection_count);
+        vector<thread> clients;
+        const auto start = chrono::steady_clock::now();
+        for (size_t connection_idx = 0; connection_idx < connection_count; ++connection_idx) {
+          clients.emplace_back([&, connection_idx] {
+            connection_latencies[connection_idx] = LoadServer(
+                socket_path, requests, expected_responses, window, mismatch_counts[connection_idx]
+            );
+          });
+        }
+        for (auto& client : clients) {
+          client.join();
+        }
+        const double elapsed_ms = ComputeMilliseconds(chrono::steady_clock::now() - start);
+        server.Stop();
+        server_thread.join();
+
+        vector<double> latencies;
+        for (const auto& latencies_of_connection : connection_latencies) {
+          latencies.insert(end(latencies), begin(latencies_of_connection), end(latencies_of_connection));
+        }
+        sort(begin(latencies), end(latencies));
+        auto percentile = [&latencies](double share) {
+          return latencies[min(latencies.size() - 1, static_cast<size_t>(share * latencies.size()))];
+        };
+        cout << worker_count << "  " << connection_count << "  " << latencies.size() * 1000 / elapsed_ms << "  "
+             << percentile(0.5) << "  " << percentile(0.99) << "  " << latencies.back() << "  "
+             << accumulate(begin(mismatch_counts), end(mismatch_counts), size_t{0}) << endl;
+      }
+    }
+  }
+
+  struct NodeStats {
+    size_t node_count = 0;
+    size_t string_size = 0;  // of strings and keys
+  };
+
+  void VisitNodes(const Json::ViewNode& node, NodeStats& stats) {
+    ++stats.node_count;
+    visit([&stats](const auto& value) {
+      using Value = decay_t<decltype(value)>;
+      if constexpr (is_same_v<Value, Json::ViewArray>) {
+        for (const auto& item : value) {
+          VisitNodes(item, stats);
+        }
+      } else if constexpr (is_same_v<Value, Json::ViewDict>) {
+        for (const auto& [key, item] : value) {
+          stats.string_size += key.size();
+          VisitNodes(item, stats);
+        }
+      } else if constexpr (is_same_v<Value, string_view>) {
+        stats.string_size += value.size();
+      }
+    }, node.GetBase());
+  }
+
+  // Loading, walking and freeing the pipeline document with nodes allocated one by one and from an arena;
+  // both ways must see the same nodes
+  void BenchmarkJsonArena(const Network& network, const NetworkParams& params, mt19937& generator) {
+    const string document = MakeInputDocument(network, params, generator);
+    const size_t round_count = 3;
+
+    cout << "json_nodes  allocator  load_ms  visit_ms  descriptions_ms  free_ms  node_mismatches" << endl;
+    optional<NodeStats> expected_stats;
+    for (const bool is_arena : {false, true}) {
+      // Minimums over rounds, as the first one also pays for mapping fresh memory
+      double load_ms = numeric_limits<double>::infinity();
+      double visit_ms = numeric_limits<double>::infinity();
+      double descriptions_ms = numeric_limits<double>::infinity();
+      double free_ms = numeric_limits<double>::infinity();
+      size_t mismatch_count = 0;
+      for (size_t round = 0; round < round_count; ++round) {
+        auto start = chrono::steady_clock::now();
+        unique_ptr<Json::ViewDocument> arena_document;
+        unique_ptr<Json::ViewNode> root_holder;
+        if (is_arena) {
+          arena_document = make_unique<Json::ViewDocument>(document);
+        } else {
+          root_holder = make_unique<Json::ViewNode>(Json::LoadView(document));
+        }
+        const Json::ViewNode& root = is_arena ? arena_document->GetRoot() : *root_holder;
+        load_ms = min(load_ms, ComputeMilliseconds(chrono::steady_clock::now() - start));
+
+        start = chrono::steady_clock::now();
+        NodeStats stats;
+        VisitNodes(root, stats);
+        visit_ms = min(visit_ms, ComputeMilliseconds(chrono::steady_clock::now() - start));
+        if (!expected_stats) {
+          expected_stats = stats;
+        }
+        mismatch_count += stats.node_count != expected_stats->node_count
+            || stats.string_size != expected_stats->string_size;
+
+        start = chrono::steady_clock::now();
+        const auto descriptions = Descriptions::ReadDescriptions(root.AsMap().at("base_requests").AsArray());
+        descriptions_ms = min(descriptions_ms, ComputeMilliseconds(chrono::steady_clock::now() - start));
+
+        start = chrono::steady_clock::now();
+        arena_document.reset();
+        root_holder.reset();
+        free_ms = min(free_ms, ComputeMilliseconds(chrono::steady_clock::now() - start));
+      }
+      cout << (is_arena ? "arena" : "default") << "  " << load_ms << "  " << visit_ms << "  "
+           << descriptions_ms << "  " << free_ms << "  " << mismatch_count << endl;
+    }
+    cout << "nodes=" << expected_stats->node_count << endl;
+  }
+
+  // Time to the first answers of a catalog leaving bus stats and routers for first requests, against building
+  // everything at once; stats computed by concurrent requests must be those of BuildDeferred
+  void BenchmarkLazyCatalog(const Network& network, const NetworkParams& params, mt19937& generator) {
+    const size_t thread_count = 4;
+    uniform_int_distribution<size_t> bus_idx_distribution(0, network.buses.size() - 1);
+    vector<string> bus_names;
+    for (size_t i = 0; i < params.query_count; ++i) {
+      bus_names.push_back(network.buses[bus_idx_distribution(generator)].name);
+    }
+    const string& stop_from = network.stops.front().name;
+    const string& stop_to = network.stops.back().name;
+
+    auto build_catalog = [&network] {
+      vector<Descriptions::InputQuery> data(begin(network.stops), end(network.stops));
+      data.insert(end(data), begin(network.buses), end(network.buses));
+      return TransportCatalog(move(data), MakeRoutingSettings("stop_pairs", "dijkstra"));
+    };
+
+    auto start = chrono::steady_clock::now();
+    const TransportCatalog lazy_catalog = build_catalog();
+    const double build_ms = ComputeMilliseconds(chrono::steady_clock::now() - start);
+    start = chrono::steady_clock::now();
+    lazy_catalog.GetBus(bus_names.front());
+    const double first_bus_ms = ComputeMilliseconds(chrono::steady_clock::now() - start);
+    vector<Responses::Bus> lazy_stats(bus_names.size());
+    ParallelFor(bus_names.size(), thread_count, [&](size_t idx) {
+      lazy_stats[idx] = *lazy_catalog.GetBus(bus_names[idx]);
+    });
+    start = chrono::steady_clock::now();
+    lazy_catalog.FindRoute(stop_from, stop_to);
+    const double first_route_ms = ComputeMilliseconds(chrono::steady_clock::now() - start);
+
+    start = chrono::steady_clock::now();
+    const TransportCatalog eager_catalog = build_catalog();
+    eager_catalog.BuildDeferred();
+    const double eager_build_ms = ComputeMilliseconds(chrono::steady_clock::now() - start);
+    size_t mismatch_count = 0;
+    for (size_t idx = 0; idx < bus_names.size(); ++idx) {
+      const auto& expected = *eager_catalog.GetBus(bus_names[idx]);
+      const auto& actual = lazy_stats[idx];
+      mismatch_count += actual.stop_count != expected.stop_count
+          || actual.unique_stop_count != expected.unique_stop_count
+          || actual.road_route_length != expected.road_route_length
+          || actual.geo_route_length != expected.geo_route_length;
+    }
+
+    cout << "lazy_catalog  build_ms  first_bus_ms  first_route_ms  eager_build_ms  stats_mismatches" << endl;
+    cout << build_ms << "  " << first_bus_ms << "  " << first_route_ms << "  " << eager_build_ms << "  "
+         << mismatch_count << endl;
+  }
+
+}
+
+// Usage: sanitize_transport_guide_benchmark [STOP_COUNT [BUS_COUNT [STOPS_PER_BUS [QUERY_COUNT
+//            [NEXT_STOP_CANDIDATES [ROUNDTRIP_PERCENT [EXTRA_DISTANCES_PER_STOP]]]]]]]
+// The same parameters give the same network and the same queries.
+int main(int argc, const char* argv[]) {
+  NetworkParams params;
+  size_t* const positional_params[] = {
+      &params.stop_count, &params.bus_count, &params.stops_per_bus, &params.query_count,
+      &params.next_stop_candidates, &params.roundtrip_percent, &params.extra_distances_per_stop
+  };
+  for (int arg_idx = 1; arg_idx < argc && arg_idx <= static_cast<int>(size(positional_params)); ++arg_idx) {
+    *positional_params[arg_idx - 1] = stoul(argv[arg_idx]);
+  }
+
+  mt19937 generator(42);
+  const Network network = GenerateNetwork(params, generator);
+  cout << fixed << setprecision(3);
+  // Goes first, so that peak RSS is that of the pipeline alone; its own generator leaves the other queries as they were
+  mt19937 pipeline_generator(43);
+  BenchmarkPipeline(network, params, pipeline_generator);
+  cout << endl;
+  mt19937 json_generator(43);
+  BenchmarkJsonArena(network, params, json_generator);
+  cout << endl;
+  BenchmarkGraphModels(network, params, generator);
+  cout << endl;
+  BenchmarkRouteCache(network, params, generator);
+  cout << endl;
+  BenchmarkRouteMatrix(network, params);
+  cout << endl;
+  // Its own generator leaves the queries of the later sections as they were
+  mt19937 queue_generator(44);
+  BenchmarkRouteQueues(network, params, queue_generator);
+  cout << endl;
+  BenchmarkSphereDistances(network);
+  cout << endl;
+  BenchmarkNearestStops(network, params, generator);
+  cout << endl;
+  BenchmarkParallelBuild(network, params, generator);
+  cout << endl;
+  BenchmarkCatalogUpdates(network, params, generator);
+  cout << endl;
+  BenchmarkTimetableRoutes(network, params, generator);
+  cout << endl;
+  BenchmarkMetricsOverhead(network, params, generator);
+  cout << endl;
+  BenchmarkServer(network, params, generator);
+  cout << endl;
+  BenchmarkLazyCatalog(network, params, generator);
+  cout << endl;
+  cout << "peak_rss_mb=" << GetPeakRssMegabytes() << endl;
+
+  return 0;
+}
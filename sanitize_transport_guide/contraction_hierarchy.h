@@ -0,0 +1,556 @@
+#pragma once
+
+#include "graph.h"
+#include "graph_search.h"
+#include "priority_queues.h"
+#include "snapshot.h"
+
+#include <algorithm>
+#include <functional>
+#include <limits>
+#include <optional>
+#include <queue>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+namespace Graph {
+
+  // Contraction hierarchies over a FrozenGraph.
+  // Preprocessing contracts vertices one by one, cheapest first by edge difference, adding a shortcut
+  // u -> w for a contracted v whenever u -> v -> w may be the only shortest route between u and w.
+  // Contraction stops once the graph left gets too dense, as shortcuts would then grow quadratically;
+  // the vertices left form the core, whose edges lead both ways.
+  // Queries run Dijkstra from both ends, going only to vertices contracted later; the backward search
+  // stops at the core, which only the forward search goes through, so that the core is searched once,
+  // and unpack shortcuts back to edge ids of the original graph.
+  template <typename Weight, typename Queue = IndexedBinaryHeap<Weight>>
+  class ContractionHierarchy {
+  private:
+    using Graph = FrozenGraph<Weight>;
+
+  public:
+    using RouteInfo = ::Graph::RouteInfo<Weight>;
+
+    ContractionHierarchy() = default;
+    // The graph has to outlive the hierarchy
+    explicit ContractionHierarchy(const Graph& graph);
+
+    // Safe to call concurrently. The route weight is summed up along the unpacked route,
+    // the same way Router::BuildRoute does.
+    std::optional<RouteInfo> BuildRoute(VertexId from, VertexId to) const;
+
+    size_t GetShortcutCount() const;
+    // Vertices left uncontracted; queries between them are plain Dijkstra over the core
+    size_t GetCoreVertexCount() const;
+
+    void Save(Snapshot::Writer& writer) const;
+    static ContractionHierarchy Load(Snapshot::Reader& reader, const Graph& graph);
+
+  private:
+    static constexpr EdgeId NO_EDGE = std::numeric_limits<EdgeId>::max();
+    // Witness searches are cut short; a missed witness only costs a needless shortcut.
+    // Priorities are estimates anyway, so they get cheaper searches than the contraction itself.
+    static constexpr size_t WITNESS_SETTLE_LIMIT = 200;
+    static constexpr size_t PRIORITY_WITNESS_SETTLE_LIMIT = 40;
+    // The core starts once vertices left have this many outgoing edges on average
+    static constexpr size_t CORE_AVERAGE_DEGREE = 32;
+
+    // An edge of the original graph if second_child is NO_EDGE, first_child being its id there,
+    // or a shortcut for two consecutive edges of the hierarchy
+    struct HierarchyEdge {
+      VertexId from;
+      VertexId to;
+      Weight weight;
+      EdgeId first_child;
+      EdgeId second_child;
+    };
+
+    // Edges between vertices not contracted yet
+    class ContractionGraph;
+
+    struct SearchStates {
+      SearchState<Weight, Queue> forward;
+      SearchState<Weight, Queue> backward;
+    };
+    static SearchStates& GetThreadSearchStates();
+
+    void BuildUpwardEdges(const std::vector<size_t>& ranks, size_t core_rank);
+    void UnpackEdge(EdgeId edge_id, std::vector<EdgeId>& original_edges) const;
+
+    const Graph* graph_ = nullptr;
+    size_t vertex_count_ = 0;
+    size_t core_vertex_count_ = 0;
+    std::vector<HierarchyEdge> edges_;
+    // Edges to vertices contracted later, leaving the vertex for forward search
+    // and entering it for backward search
+    std::vector<size_t> forward_offsets_;
+    std::vector<EdgeId> forward_edges_;
+    std::vector<size_t> backward_offsets_;
+    std::vector<EdgeId> backward_edges_;
+  };
+
+
+  template <typename Weight, typename Queue>
+  class ContractionHierarchy<Weight, Queue>::ContractionGraph {
+  public:
+    ContractionGraph(std::vector<HierarchyEdge>& edges, size_t vertex_count)
+        : edges_(edges), out_edges_(vertex_count), in_edges_(vertex_count),
+          is_contracted_(vertex_count, false), contracted_neighbour_counts_(vertex_count, 0),
+          target_generations_(vertex_count, 0)
+    {
+      for (EdgeId edge_id = 0; edge_id < edges_.size(); ++edge_id) {
+        out_edges_[edges_[edge_id].from].push_back(edge_id);
+        in_edges_[edges_[edge_id].to].push_back(edge_id);
+      }
+      edge_count_ = edges_.size();
+    }
+
+    // Cheaper vertices go first: fewer edges added than removed, fewer neighbours contracted already
+    int ComputePriority(VertexId vertex) {
+      const int shortcut_count = static_cast<int>(FindShortcuts(vertex, PRIORITY_WITNESS_SETTLE_LIMIT).size());
+      const int removed_count = static_cast<int>(GetOutEdges(vertex).size() + GetInEdges(vertex).size());
+      return shortcut_count - removed_count + contracted_neighbour_counts_[vertex];
+    }
+
+    void Contract(VertexId vertex) {
+      for (const auto& shortcut : FindShortcuts(vertex, WITNESS_SETTLE_LIMIT)) {
+        AddOrImproveEdge(shortcut);
+      }
+      is_contracted_[vertex] = true;
+      edge_count_ -= GetOutEdges(vertex).size() + GetInEdges(vertex).size();
+      for (const EdgeId edge_id : GetOutEdges(vertex)) {
+        ++contracted_neighbour_counts_[edges_[edge_id].to];
+      }
+      for (const EdgeId edge_id : GetInEdges(vertex)) {
+        ++contracted_neighbour_counts_[edges_[edge_id].from];
+      }
+    }
+
+    // Edges between vertices not contracted yet
+    size_t GetEdgeCount() const {
+      return edge_count_;
+    }
+
+  private:
+    const std::vector<EdgeId>& GetOutEdges(VertexId vertex) {
+      return Compact(out_edges_[vertex], [](const HierarchyEdge& edge) { return edge.to; });
+    }
+
+    const std::vector<EdgeId>& GetInEdges(VertexId vertex) {
+      return Compact(in_edges_[vertex], [](const HierarchyEdge& edge) { return edge.from; });
+    }
+
+    // Drops edges to contracted vertices
+    template <typename GetNeighbour>
+    std::vector<EdgeId>& Compact(std::vector<EdgeId>& edge_ids, GetNeighbour get_neighbour) {
+      edge_ids.erase(std::remove_if(std::begin(edge_ids), std::end(edge_ids), [&](EdgeId edge_id) {
+                       return is_contracted_[get_neighbour(edges_[edge_id])];
+                     }),
+                     std::end(edge_ids));
+      return edge_ids;
+    }
+
+    std::vector<HierarchyEdge> FindShortcuts(VertexId vertex, size_t settle_limit) {
+      std::vector<HierarchyEdge> shortcuts;
+      const auto& out_edges = GetOutEdges(vertex);
+      if (out_edges.empty()) {
+        return shortcuts;
+      }
+      Weight max_out_weight = 0;
+      for (const EdgeId out_edge_id : out_edges) {
+        max_out_weight = std::max(max_out_weight, edges_[out_edge_id].weight);
+      }
+
+      for (const EdgeId in_edge_id : GetInEdges(vertex)) {
+        const auto& in_edge = edges_[in_edge_id];
+        FindWitnesses(in_edge.from, vertex, out_edges, in_edge.weight + max_out_weight, settle_limit);
+        for (const EdgeId out_edge_id : out_edges) {
+          const auto& out_edge = edges_[out_edge_id];
+          if (out_edge.to == in_edge.from) {
+            continue;
+          }
+          const Weight weight = in_edge.weight + out_edge.weight;
+          if (witness_state_.IsReached(out_edge.to) && !(weight < witness_state_.weights[out_edge.to])) {
+            continue;
+          }
+          shortcuts.push_back({in_edge.from, out_edge.to, weight, in_edge_id, out_edge_id});
+        }
+      }
+      return shortcuts;
+    }
+
+    // Bounded Dijkstra from source avoiding the vertex being contracted, done once every target is settled;
+    // reached weights above the real shortest ones only add needless shortcuts
+    void FindWitnesses(VertexId source, VertexId contracted_vertex, const std::vector<EdgeId>& target_edges,
+                       Weight max_weight, size_t settle_limit) {
+      witness_state_.Start(out_edges_.size());
+      witness_state_.Reach(source, 0, ROUTE_START);
+      ++target_generation_;
+      size_t target_count = 0;
+      for (const EdgeId edge_id : target_edges) {
+        const VertexId target = edges_[edge_id].to;
+        if (target_generations_[target] != target_generation_) {
+          target_generations_[target] = target_generation_;
+          ++target_count;
+        }
+      }
+      size_t settled_count = 0;
+      while (!witness_state_.queue.IsEmpty() && settled_count < settle_limit && target_count > 0) {
+        const auto [vertex_weight, vertex] = witness_state_.queue.PopMin();
+        if (witness_state_.IsSettled(vertex)) {
+          continue;
+        }
+        if (max_weight < vertex_weight) {
+          break;
+        }
+        witness_state_.Settle(vertex);
+        ++settled_count;
+        if (target_generations_[vertex] == target_generation_) {
+          --target_count;
+        }
+        for (const EdgeId edge_id : GetOutEdges(vertex)) {
+          const auto& edge = edges_[edge_id];
+          if (edge.to == contracted_vertex || witness_state_.IsSettled(edge.to)) {
+            continue;
+          }
+          const Weight weight = vertex_weight + edge.weight;
+          if (!witness_state_.IsReached(edge.to) || witness_state_.weights[edge.to] > weight) {
+            witness_state_.Reach(edge.to, weight, edge_id);
+          }
+        }
+      }
+    }
+
+    // Edges between two vertices not contracted yet are nobody's children,
+    // so a longer one can be replaced in place
+    void AddOrImproveEdge(const HierarchyEdge& new_edge) {
+      for (const EdgeId edge_id : GetOutEdges(new_edge.from)) {
+        auto& edge = edges_[edge_id];
+        if (edge.to == new_edge.to) {
+          if (new_edge.weight < edge.weight) {
+            edge = new_edge;
+          }
+          return;
+        }
+      }
+      const EdgeId edge_id = edges_.size();
+      edges_.push_back(new_edge);
+      out_edges_[new_edge.from].push_back(edge_id);
+      in_edges_[new_edge.to].push_back(edge_id);
+      ++edge_count_;
+    }
+
+    std::vector<HierarchyEdge>& edges_;
+    std::vector<std::vector<EdgeId>> out_edges_;
+    std::vector<std::vector<EdgeId>> in_edges_;
+    std::vector<bool> is_contracted_;
+    std::vector<int> contracted_neighbour_counts_;
+    size_t edge_count_ = 0;
+    SearchState<Weight, Queue> witness_state_;
+    std::vector<size_t> target_generations_;
+    size_t target_generation_ = 0;
+  };
+
+
+  template <typename Weight, typename Queue>
+  ContractionHierarchy<Weight, Queue>::ContractionHierarchy(const Graph& graph)
+      : graph_(&graph),
+        vertex_count_(graph.GetVertexCount())
+  {
+    // Only the lightest of parallel edges can be on a shortest route; the first one wins ties
+    std::vector<EdgeId> lightest_edges(vertex_count_, NO_EDGE);
+    std::vector<VertexId> targets;
+    for (VertexId vertex = 0; vertex < vertex_count_; ++vertex) {
+      targets.clear();
+      for (const EdgeId edge_id : graph.GetIncidentEdges(vertex)) {
+        const auto edge = graph.GetEdge(edge_id);
+        if (edge.to == vertex) {
+          continue;
+        }
+        EdgeId& lightest_edge = lightest_edges[edge.to];
+        if (lightest_edge == NO_EDGE) {
+          targets.push_back(edge.to);
+          lightest_edge = edge_id;
+        } else if (edge.weight < graph.GetEdge(lightest_edge).weight) {
+          lightest_edge = edge_id;
+        }
+      }
+      for (const VertexId target : targets) {
+        const EdgeId edge_id = lightest_edges[target];
+        edges_.push_back({vertex, target, graph.GetEdge(edge_id).weight, edge_id, NO_EDGE});
+        lightest_edges[target] = NO_EDGE;
+      }
+    }
+
+    ContractionGraph contraction_graph(edges_, vertex_count_);
+    using PriorityItem = std::pair<int, VertexId>;
+    std::priority_queue<PriorityItem, std::vector<PriorityItem>, std::greater<>> queue;
+    // A graph dense from the start is all core
+    const bool is_dense = edges_.size() > CORE_AVERAGE_DEGREE * vertex_count_;
+    for (VertexId vertex = 0; vertex < vertex_count_; ++vertex) {
+      queue.push({is_dense ? 0 : contraction_graph.ComputePriority(vertex), vertex});
+    }
+
+    // Priorities change as neighbours get contracted; they are refreshed lazily on pop
+    std::vector<size_t> ranks(vertex_count_);
+    size_t next_rank = 0;
+    while (!queue.empty()) {
+      if (contraction_graph.GetEdgeCount() > CORE_AVERAGE_DEGREE * queue.size()) {
+        break;
+      }
+      const VertexId vertex = queue.top().second;
+      queue.pop();
+      const int priority = contraction_graph.ComputePriority(vertex);
+      if (!queue.empty() && priority > queue.top().first) {
+        queue.push({priority, vertex});
+        continue;
+      }
+      contraction_graph.Contract(vertex);
+      ranks[vertex] = next_rank++;
+    }
+
+    const size_t core_rank = next_rank;
+    core_vertex_count_ = vertex_count_ - core_rank;
+    for (; !queue.empty(); queue.pop()) {
+      ranks[queue.top().second] = next_rank++;
+    }
+    BuildUpwardEdges(ranks, core_rank);
+  }
+
+  template <typename Weight, typename Queue>
+  void ContractionHierarchy<Weight, Queue>::BuildUpwardEdges(const std::vector<size_t>& ranks, size_t core_rank) {
+    const auto is_core_edge = [&ranks, core_rank](const HierarchyEdge& edge) {
+      return ranks[edge.from] >= core_rank && ranks[edge.to] >= core_rank;
+    };
+    const auto is_forward_edge = [&](const HierarchyEdge& edge) {
+      return ranks[edge.from] < ranks[edge.to] || is_core_edge(edge);
+    };
+    // Core edges are for the forward search only
+    const auto is_backward_edge = [&](const HierarchyEdge& edge) {
+      return ranks[edge.from] > ranks[edge.to] && ranks[edge.to] < core_rank;
+    };
+
+    forward_offsets_.assign(vertex_count_ + 1, 0);
+    backward_offsets_.assign(vertex_count_ + 1, 0);
+    for (const auto& edge : edges_) {
+      if (is_forward_edge(edge)) {
+        ++forward_offsets_[edge.from + 1];
+      }
+      if (is_backward_edge(edge)) {
+        ++backward_offsets_[edge.to + 1];
+      }
+    }
+    for (VertexId vertex = 0; vertex < vertex_count_; ++vertex) {
+      forward_offsets_[vertex + 1] += forward_offsets_[vertex];
+      backward_offsets_[vertex + 1] += backward_offsets_[vertex];
+    }
+
+    forward_edges_.resize(forward_offsets_.back());
+    backward_edges_.resize(backward_offsets_.back());
+    std::vector<size_t> forward_positions(std::begin(forward_offsets_), std::end(forward_offsets_) - 1);
+    std::vector<size_t> backward_positions(std::begin(backward_offsets_), std::end(backward_offsets_) - 1);
+    for (EdgeId edge_id = 0; edge_id < edges_.size(); ++edge_id) {
+      const auto& edge = edges_[edge_id];
+      if (is_forward_edge(edge)) {
+        forward_edges_[forward_positions[edge.from]++] = edge_id;
+      }
+      if (is_backward_edge(edge)) {
+        backward_edges_[backward_positions[edge.to]++] = edge_id;
+      }
+    }
+  }
+
+  template <typename Weight, typename Queue>
+  typename ContractionHierarchy<Weight, Queue>::SearchStates&
+  ContractionHierarchy<Weight, Queue>::GetThreadSearchStates() {
+    thread_local SearchStates states;
+    return states;
+  }
+
+  template <typename Weight, typename Queue>
+  std::optional<typename ContractionHierarchy<Weight, Queue>::RouteInfo>
+  ContractionHierarchy<Weight, Queue>::BuildRoute(VertexId from, VertexId to) const {
+    if (from == to) {
+      return RouteInfo{0, {}, 1};
+    }
+
+    SearchStates& states = GetThreadSearchStates();
+    auto& forward = states.forward;
+    auto& backward = states.backward;
+    forward.Start(vertex_count_);
+    backward.Start(vertex_count_);
+    forward.Reach(from, 0, ROUTE_START);
+    backward.Reach(to, 0, ROUTE_START);
+
+    std::optional<Weight> best_weight;
+    VertexId meeting_vertex = 0;
+    // A side is done once its next vertex is not lighter than the best route found;
+    // within the core the forward search is plain Dijkstra, which stops the same way
+    bool is_forward_done = false;
+    bool is_backward_done = false;
+    bool is_forward_turn = true;
+    while (!is_forward_done || !is_backward_done) {
+      const bool is_forward = is_backward_done || (!is_forward_done && is_forward_turn);
+      is_forward_turn = !is_forward_turn;
+      auto& state = is_forward ? forward : backward;
+      const auto& other_state = is_forward ? backward : forward;
+      bool& is_done = is_forward ? is_forward_done : is_backward_done;
+
+      if (state.queue.IsEmpty()) {
+        is_done = true;
+        continue;
+      }
+      const VertexId vertex = state.PopMin();
+      if (state.IsSettled(vertex)) {
+        continue;
+      }
+      const Weight vertex_weight = state.weights[vertex];
+      if (best_weight && !(vertex_weight < *best_weight)) {
+        is_done = true;
+        continue;
+      }
+      state.Settle(vertex);
+
+      if (other_state.IsReached(vertex)) {
+        const Weight weight = vertex_weight + other_state.weights[vertex];
+        if (!best_weight || weight < *best_weight) {
+          best_weight = weight;
+          meeting_vertex = vertex;
+        }
+      }
+
+      const auto& offsets = is_forward ? forward_offsets_ : backward_offsets_;
+      const auto& upward_edges = is_forward ? forward_edges_ : backward_edges_;
+      for (size_t idx = offsets[vertex]; idx < offsets[vertex + 1]; ++idx) {
+        const EdgeId edge_id = upward_edges[idx];
+        const auto& edge = edges_[edge_id];
+        const VertexId next_vertex = is_forward ? edge.to : edge.from;
+        if (state.IsSettled(next_vertex)) {
+          continue;
+        }
+        const Weight weight = vertex_weight + edge.weight;
+        if (!state.IsReached(next_vertex) || state.weights[next_vertex] > weight) {
+          state.Reach(next_vertex, weight, edge_id);
+        }
+      }
+    }
+    RecordSearch(forward, backward);
+
+    if (!best_weight) {
+      return std::nullopt;
+    }
+
+    std::vector<EdgeId> hierarchy_edges;
+    for (EdgeId edge_id = forward.prev_edges[meeting_vertex];
+         edge_id != ROUTE_START;
+         edge_id = forward.prev_edges[edges_[edge_id].from]) {
+      hierarchy_edges.push_back(edge_id);
+    }
+    std::reverse(std::begin(hierarchy_edges), std::end(hierarchy_edges));
+    for (EdgeId edge_id = backward.prev_edges[meeting_vertex];
+         edge_id != ROUTE_START;
+         edge_id = backward.prev_edges[edges_[edge_id].to]) {
+      hierarchy_edges.push_back(edge_id);
+    }
+
+    RouteInfo route_info{0, {}, forward.settled_vertices.size() + backward.settled_vertices.size()};
+    for (const EdgeId edge_id : hierarchy_edges) {
+      UnpackEdge(edge_id, route_info.edges);
+    }
+    for (const EdgeId edge_id : route_info.edges) {
+      route_info.weight += graph_->GetEdge(edge_id).weight;
+    }
+    return route_info;
+  }
+
+  template <typename Weight, typename Queue>
+  void ContractionHierarchy<Weight, Queue>::UnpackEdge(EdgeId edge_id, std::vector<EdgeId>& original_edges) const {
+    std::vector<EdgeId> stack = {edge_id};
+    while (!stack.empty()) {
+      const auto& edge = edges_[stack.back()];
+      stack.pop_back();
+      if (edge.second_child == NO_EDGE) {
+        original_edges.push_back(edge.first_child);
+      } else {
+        stack.push_back(edge.second_child);
+        stack.push_back(edge.first_child);
+      }
+    }
+  }
+
+  template <typename Weight, typename Queue>
+  size_t ContractionHierarchy<Weight, Queue>::GetShortcutCount() const {
+    return std::count_if(std::begin(edges_), std::end(edges_), [](const HierarchyEdge& edge) {
+      return edge.second_child != NO_EDGE;
+    });
+  }
+
+  template <typename Weight, typename Queue>
+  size_t ContractionHierarchy<Weight, Queue>::GetCoreVertexCount() const {
+    return core_vertex_count_;
+  }
+
+  template <typename Weight, typename Queue>
+  void ContractionHierarchy<Weight, Queue>::Save(Snapshot::Writer& writer) const {
+    writer.Write<uint64_t>(core_vertex_count_);
+    // Field by field, as Weight may leave padding
+    writer.Write<uint64_t>(edges_.size());
+    for (const HierarchyEdge& edge : edges_) {
+      writer.Write<uint64_t>(edge.from);
+      writer.Write<uint64_t>(edge.to);
+      writer.Write(edge.weight);
+      writer.Write<uint64_t>(edge.first_child);
+      writer.Write<uint64_t>(edge.second_child);
+    }
+    writer.WriteVector(forward_offsets_);
+    writer.WriteVector(forward_edges_);
+    writer.WriteVector(backward_offsets_);
+    writer.WriteVector(backward_edges_);
+  }
+
+  template <typename Weight, typename Queue>
+  ContractionHierarchy<Weight, Queue> ContractionHierarchy<Weight, Queue>::Load(Snapshot::Reader& reader,
+                                                                                const Graph& graph) {
+    ContractionHierarchy hierarchy;
+    hierarchy.graph_ = &graph;
+    hierarchy.vertex_count_ = graph.GetVertexCount();
+    hierarchy.core_vertex_count_ = reader.Read<uint64_t>();
+    const size_t edge_count = reader.ReadSize(4 * sizeof(uint64_t) + sizeof(Weight));
+    hierarchy.edges_.reserve(edge_count);
+    for (size_t edge_idx = 0; edge_idx < edge_count; ++edge_idx) {
+      HierarchyEdge& edge = hierarchy.edges_.emplace_back();
+      edge.from = reader.Read<uint64_t>();
+      edge.to = reader.Read<uint64_t>();
+      edge.weight = reader.Read<Weight>();
+      edge.first_child = reader.Read<uint64_t>();
+      edge.second_child = reader.Read<uint64_t>();
+    }
+    hierarchy.forward_offsets_ = reader.ReadVector<size_t>();
+    hierarchy.forward_edges_ = reader.ReadVector<EdgeId>();
+    hierarchy.backward_offsets_ = reader.ReadVector<size_t>();
+    hierarchy.backward_edges_ = reader.ReadVector<EdgeId>();
+
+    auto is_consistent = [&hierarchy](const std::vector<size_t>& offsets, const std::vector<EdgeId>& edge_ids) {
+      return offsets.size() == hierarchy.vertex_count_ + 1 && offsets.back() == edge_ids.size()
+          && std::is_sorted(std::begin(offsets), std::end(offsets))
+          && std::all_of(std::begin(edge_ids), std::end(edge_ids), [&hierarchy](EdgeId edge_id) {
+               return edge_id < hierarchy.edges_.size();
+             });
+    };
+    const bool are_edges_consistent = std::all_of(
+        std::begin(hierarchy.edges_), std::end(hierarchy.edges_), [&hierarchy](const HierarchyEdge& edge) {
+          return edge.from < hierarchy.vertex_count_ && edge.to < hierarchy.vertex_count_
+              && (edge.second_child == NO_EDGE
+                  ? edge.first_child < hierarchy.graph_->GetEdgeCount()
+                  : edge.first_child < hierarchy.edges_.size() && edge.second_child < hierarchy.edges_.size());
+        });
+    if (hierarchy.core_vertex_count_ > hierarchy.vertex_count_ || !are_edges_consistent
+        || !is_consistent(hierarchy.forward_offsets_, hierarchy.forward_edges_)
+        || !is_consistent(hierarchy.backward_offsets_, hierarchy.backward_edges_)) {
+      throw std::runtime_error("inconsistent contraction hierarchy in snapshot");
+    }
+    return hierarchy;
+  }
+
+}
@@ -1,12 +1,14 @@
 #include "descriptions.h"
+#include "json_sax.h"
 
 using namespace std;
 
 namespace Descriptions {
 
-  Stop Stop::ParseFrom(const Json::Dict& attrs) {
+  template <typename DictT>
+  static Stop ParseStop(const DictT& attrs) {
     Stop stop = {
-        .name = attrs.at("name").AsString(),
+        .name = string(attrs.at("name").AsString()),
         .position = {
             .latitude = attrs.at("latitude").AsDouble(),
             .longitude = attrs.at("longitude").AsDouble(),
@@ -14,18 +16,21 @@ namespace Descriptions {
     };
     if (attrs.count("road_distances") > 0) {
       for (const auto& [neighbour_stop, distance_node] : attrs.at("road_distances").AsMap()) {
-        stop.distances[neighbour_stop] = distance_node.AsInt();
+        stop.distances[string(neighbour_stop)] = distance_node.AsInt();
       }
     }
     return stop;
   }
 
-  vector<string> ParseStops(const vector<Json::Node>& stop_nodes, bool is_roundtrip) {
-    vector<string> stops;
-    stops.reserve(stop_nodes.size());
-    for (const Json::Node& stop_node : stop_nodes) {
-      stops.push_back(stop_node.AsString());
-    }
+  Stop Stop::ParseFrom(const Json::Dict& attrs) {
+    return ParseStop(attrs);
+  }
+
+  Stop Stop::ParseFrom(const Json::ViewDict& attrs) {
+    return ParseStop(attrs);
+  }
+
+  static vector<string> ExpandStops(vector<string> stops, bool is_roundtrip) {
     if (is_roundtrip || stops.size() <= 1) {
       return stops;
     }
@@ -36,6 +41,24 @@ namespace Descriptions {
     return stops;
   }
 
+  template <typename NodeT, typename Allocator>
+  static vector<string> ParseStopNames(const vector<NodeT, Allocator>& stop_nodes, bool is_roundtrip) {
+    vector<string> stops;
+    stops.reserve(stop_nodes.size());
+    for (const NodeT& stop_node : stop_nodes) {
+      stops.emplace_back(stop_node.AsString());
+    }
+    return ExpandStops(move(stops), is_roundtrip);
+  }
+
+  vector<string> ParseStops(const vector<Json::Node>& stop_nodes, bool is_roundtrip) {
+    return ParseStopNames(stop_nodes, is_roundtrip);
+  }
+
+  vector<string> ParseStops(const Json::ViewArray& stop_nodes, bool is_roundtrip) {
+    return ParseStopNames(stop_nodes, is_roundtrip);
+  }
+
   int ComputeStopsDistance(const Stop& lhs, const Stop& rhs) {
     if (auto it = lhs.distances.find(rhs.name); it != lhs.distances.end()) {
       return it->second;
@@ -44,18 +67,34 @@ namespace Descriptions {
     }
   }
 
-  Bus Bus::ParseFrom(const Json::Dict& attrs) {
-    return Bus{
-        .name = attrs.at("name").AsString(),
+  template <typename DictT>
+  static Bus ParseBus(const DictT& attrs) {
+    Bus bus{
+        .name = string(attrs.at("name").AsString()),
         .stops = ParseStops(attrs.at("stops").AsArray(), attrs.at("is_roundtrip").AsBool()),
     };
+    if (attrs.count("departures") > 0) {
+      for (const auto& departure_node : attrs.at("departures").AsArray()) {
+        bus.departures.push_back(departure_node.AsInt());
+      }
+    }
+    return bus;
   }
 
-  vector<InputQuery> ReadDescriptions(const vector<Json::Node>& nodes) {
+  Bus Bus::ParseFrom(const Json::Dict& attrs) {
+    return ParseBus(attrs);
+  }
+
+  Bus Bus::ParseFrom(const Json::ViewDict& attrs) {
+    return ParseBus(attrs);
+  }
+
+  template <typename NodeT, typename Allocator>
+  static vector<InputQuery> ReadDescriptionNodes(const vector<NodeT, Allocator>& nodes) {
     vector<InputQuery> result;
     result.reserve(nodes.size());
 
-    for (const Json::Node& node : nodes) {
+    for (const NodeT& node : nodes) {
       const auto& node_dict = node.AsMap();
       if (node_dict.at("type").AsString() == "Bus") {
         result.push_back(Bus::ParseFrom(node_dict));
@@ -67,4 +106,175 @@ namespace Descriptions {
     return result;
   }
 
+  vector<InputQuery> ReadDescriptions(const vector<Json::Node>& nodes) {
+    return ReadDescriptionNodes(nodes);
+  }
+
+  vector<InputQuery> ReadDescriptions(const Json::ViewArray& nodes) {
+    return ReadDescriptionNodes(nodes);
+  }
+
+  void DescriptionsBuilder::StartArray() {
+    ++depth_;
+  }
+
+  void DescriptionsBuilder::EndArray() {
+    --depth_;
+  }
+
+  void DescriptionsBuilder::StartObject() {
+    if (++depth_ == 2) {
+      type_.clear();
+      name_.clear();
+      position_ = {};
+      distances_.clear();
+      stops_.clear();
+      departures_.clear();
+      is_roundtrip_ = false;
+    }
+  }
+
+  void DescriptionsBuilder::Key(string_view key) {
+    if (depth_ == 2) {
+      key_ = key;
+    } else if (depth_ == 3 && key_ == "road_distances") {
+      distance_key_ = key;
+    }
+  }
+
+  void DescriptionsBuilder::EndObject() {
+    if (depth_-- != 2) {
+      return;
+    }
+    if (type_ == "Bus") {
+      descriptions_.push_back(Bus{move(name_), ExpandStops(move(stops_), is_roundtrip_), move(departures_)});
+    } else {
+      descriptions_.push_back(Stop{move(name_), position_, move(distances_)});
+    }
+  }
+
+  void DescriptionsBuilder::String(string_view value) {
+    if (depth_ == 2 && key_ == "type") {
+      type_ = value;
+    } else if (depth_ == 2 && key_ == "name") {
+      name_ = value;
+    } else if (depth_ == 3 && key_ == "stops") {
+      stops_.emplace_back(value);
+    }
+  }
+
+  void DescriptionsBuilder::Int(int value) {
+    if (depth_ == 3 && key_ == "road_distances") {
+      distances_[distance_key_] = value;
+    } else if (depth_ == 3 && key_ == "departures") {
+      departures_.push_back(value);
+    } else {
+      SetNumber(value);
+    }
+  }
+
+  void DescriptionsBuilder::Double(double value) {
+    SetNumber(value);
+  }
+
+  void DescriptionsBuilder::SetNumber(double value) {
+    if (depth_ == 2 && key_ == "latitude") {
+      position_.latitude = value;
+    } else if (depth_ == 2 && key_ == "longitude") {
+      position_.longitude = value;
+    }
+  }
+
+  void DescriptionsBuilder::Bool(bool value) {
+    if (depth_ == 2 && key_ == "is_roundtrip") {
+      is_roundtrip_ = value;
+    }
+  }
+
+  namespace {
+    // Sends every top-level section either to DescriptionsBuilder or to Json::NodeBuilder
+    class InputDocumentBuilder {
+    public:
+      void StartArray() { StartValue([](auto& builder) { builder.StartArray(); }); }
+      void StartObject() {
+        if (depth_ == 0) {
+          depth_ = 1;
+        } else {
+          StartValue([](auto& builder) { builder.StartObject(); });
+        }
+      }
+      void Key(string_view key) {
+        if (depth_ == 1) {
+          section_ = key;
+        } else {
+          Forward([key](auto& builder) { builder.Key(key); });
+        }
+      }
+      void EndArray() { EndValue([](auto& builder) { builder.EndArray(); }); }
+      void EndObject() {
+        if (depth_ == 1) {
+          depth_ = 0;
+        } else {
+          EndValue([](auto& builder) { builder.EndObject(); });
+        }
+      }
+
+      void String(string_view value) { ScalarValue([value](auto& builder) { builder.String(value); }); }
+      void Int(int value) { ScalarValue([value](auto& builder) { builder.Int(value); }); }
+      void Double(double value) { ScalarValue([value](auto& builder) { builder.Double(value); }); }
+      void Bool(bool value) { ScalarValue([value](auto& builder) { builder.Bool(value); }); }
+
+      InputDocument Release() {
+        return {descriptions_builder_.Release(), move(sections_)};
+      }
+
+    private:
+      template <typename Event>
+      void Forward(Event event) {
+        if (section_ == "base_requests") {
+          event(descriptions_builder_);
+        } else {
+          event(node_builder_);
+        }
+      }
+
+      template <typename Event>
+      void StartValue(Event event) {
+        Forward(event);
+        ++depth_;
+      }
+
+      template <typename Event>
+      void EndValue(Event event) {
+        --depth_;
+        Forward(event);
+        FinishSectionIfComplete();
+      }
+
+      template <typename Event>
+      void ScalarValue(Event event) {
+        Forward(event);
+        FinishSectionIfComplete();
+      }
+
+      void FinishSectionIfComplete() {
+        if (depth_ == 1 && section_ != "base_requests") {
+          sections_[section_] = node_builder_.Release();
+        }
+      }
+
+      int depth_ = 0;
+      string section_;
+      DescriptionsBuilder descriptions_builder_;
+      Json::NodeBuilder node_builder_;
+      Json::Dict sections_;
+    };
+  }
+
+  InputDocument ReadInputDocument(string_view input) {
+    InputDocumentBuilder builder;
+    Json::ParseSax(input, builder);
+    return builder.Release();
+  }
+
 }
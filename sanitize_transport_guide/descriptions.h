@@ -1,9 +1,11 @@
 #pragma once
 
 #include "json.h"
+#include "json_view.h"
 #include "sphere.h"
 
 #include <string>
+#include <string_view>
 #include <unordered_map>
 #include <variant>
 #include <vector>
@@ -15,22 +17,81 @@ namespace Descriptions {
     std::unordered_map<std::string, int> distances;
 
     static Stop ParseFrom(const Json::Dict& attrs);
+    static Stop ParseFrom(const Json::ViewDict& attrs);
   };
 
   int ComputeStopsDistance(const Stop& lhs, const Stop& rhs);
 
   std::vector<std::string> ParseStops(const std::vector<Json::Node>& stop_nodes, bool is_roundtrip);
+  std::vector<std::string> ParseStops(const Json::ViewArray& stop_nodes, bool is_roundtrip);
 
   struct Bus {
     std::string name;
     std::vector<std::string> stops;
+    std::vector<int> departures;  // of trips from the first stop, in minutes after midnight
 
     static Bus ParseFrom(const Json::Dict& attrs);
+    static Bus ParseFrom(const Json::ViewDict& attrs);
   };
 
   using InputQuery = std::variant<Stop, Bus>;
 
+  // Changes to a built catalog. Stops and buses replace the known ones with the same names or are added;
+  // distances of a stop are merged into the known ones, and as on building, distances to unknown stops are dropped.
+  // Removals go first. Removed stops must not be left on any bus.
+  struct Update {
+    std::vector<Stop> stops;
+    std::vector<Bus> buses;
+    std::vector<std::string> removed_stops;
+    std::vector<std::string> removed_buses;
+  };
+
   std::vector<InputQuery> ReadDescriptions(const std::vector<Json::Node>& nodes);
+  std::vector<InputQuery> ReadDescriptions(const Json::ViewArray& nodes);
+
+  // Json::SaxParser handler reading the base_requests array straight into descriptions
+  class DescriptionsBuilder {
+  public:
+    void StartArray();
+    void EndArray();
+    void StartObject();
+    void Key(std::string_view key);
+    void EndObject();
+
+    void String(std::string_view value);
+    void Int(int value);
+    void Double(double value);
+    void Bool(bool value);
+
+    std::vector<InputQuery> Release() { return std::move(descriptions_); }
+
+  private:
+    void SetNumber(double value);
+
+    // Depth 1 is the base_requests array, 2 is a description, 3 is a value of its field
+    int depth_ = 0;
+    std::string key_;
+    std::string distance_key_;
+
+    std::string type_;
+    std::string name_;
+    Sphere::Point position_{};
+    std::unordered_map<std::string, int> distances_;
+    std::vector<std::string> stops_;
+    std::vector<int> departures_;
+    bool is_roundtrip_ = false;
+
+    std::vector<InputQuery> descriptions_;
+  };
+
+  // Input document read in one pass over a buffer: base_requests go through DescriptionsBuilder
+  // without building Json nodes, other top-level sections are kept as nodes
+  struct InputDocument {
+    std::vector<InputQuery> descriptions;
+    Json::Dict sections;
+  };
+
+  InputDocument ReadInputDocument(std::string_view input);
 
   template <typename Object>
   using Dict = std::unordered_map<std::string, const Object*>;
@@ -4,6 +4,7 @@
 
 #include <cstdlib>
 #include <deque>
+#include <iterator>
 #include <vector>
 
 namespace Graph {
@@ -39,6 +40,66 @@ namespace Graph {
   };
 
 
+  // Iterates over consecutive edge ids without storing them
+  class EdgeIdIterator {
+  public:
+    using iterator_category = std::forward_iterator_tag;
+    using value_type = EdgeId;
+    using difference_type = std::ptrdiff_t;
+    using pointer = const EdgeId*;
+    using reference = EdgeId;
+
+    explicit EdgeIdIterator(EdgeId id) : id_(id) {}
+    EdgeId operator*() const { return id_; }
+    EdgeIdIterator& operator++() { ++id_; return *this; }
+    bool operator==(EdgeIdIterator other) const { return id_ == other.id_; }
+    bool operator!=(EdgeIdIterator other) const { return id_ != other.id_; }
+
+  private:
+    EdgeId id_;
+  };
+
+  // Saves and loads frozen graphs, see graph_snapshot.h
+  template <typename Weight>
+  class FrozenGraphSnapshot;
+
+  // Immutable compressed sparse row form of DirectedWeightedGraph.
+  // Edges are renumbered so that edges leaving one vertex are contiguous,
+  // keeping the builder order among them. Edges entering a vertex are indexed too,
+  // for searches running backwards from the target.
+  template <typename Weight>
+  class FrozenGraph {
+  private:
+    using IncidentEdgesRange = Range<EdgeIdIterator>;
+    using IncomingEdgesRange = Range<std::vector<EdgeId>::const_iterator>;
+
+  public:
+    FrozenGraph() = default;
+    // builder_edge_ids, if given, receives the builder edge id for every frozen edge id
+    explicit FrozenGraph(const DirectedWeightedGraph<Weight>& graph,
+                         std::vector<EdgeId>* builder_edge_ids = nullptr);
+
+    size_t GetVertexCount() const;
+    size_t GetEdgeCount() const;
+    Edge<Weight> GetEdge(EdgeId edge_id) const;
+    IncidentEdgesRange GetIncidentEdges(VertexId vertex) const;
+    IncomingEdgesRange GetIncomingEdges(VertexId vertex) const;
+
+  private:
+    friend class FrozenGraphSnapshot<Weight>;
+
+    void IndexIncomingEdges();
+
+    std::vector<EdgeId> offsets_;
+    std::vector<VertexId> sources_;
+    std::vector<VertexId> targets_;
+    std::vector<Weight> weights_;
+
+    std::vector<size_t> incoming_offsets_;
+    std::vector<EdgeId> incoming_edges_;
+  };
+
+
   template <typename Weight>
   DirectedWeightedGraph<Weight>::DirectedWeightedGraph(size_t vertex_count) : incidence_lists_(vertex_count) {}
 
@@ -71,4 +132,81 @@ namespace Graph {
     const auto& edges = incidence_lists_[vertex];
     return {std::begin(edges), std::end(edges)};
   }
+
+  template <typename Weight>
+  FrozenGraph<Weight>::FrozenGraph(const DirectedWeightedGraph<Weight>& graph,
+                                   std::vector<EdgeId>* builder_edge_ids)
+      : offsets_(graph.GetVertexCount() + 1)
+  {
+    const size_t vertex_count = graph.GetVertexCount();
+    const size_t edge_count = graph.GetEdgeCount();
+    for (VertexId vertex = 0; vertex < vertex_count; ++vertex) {
+      offsets_[vertex + 1] = offsets_[vertex] + graph.GetIncidentEdges(vertex).end() - graph.GetIncidentEdges(vertex).begin();
+    }
+
+    sources_.reserve(edge_count);
+    targets_.reserve(edge_count);
+    weights_.reserve(edge_count);
+    if (builder_edge_ids) {
+      builder_edge_ids->clear();
+      builder_edge_ids->reserve(edge_count);
+    }
+    for (VertexId vertex = 0; vertex < vertex_count; ++vertex) {
+      for (const EdgeId edge_id : graph.GetIncidentEdges(vertex)) {
+        const auto& edge = graph.GetEdge(edge_id);
+        sources_.push_back(edge.from);
+        targets_.push_back(edge.to);
+        weights_.push_back(edge.weight);
+        if (builder_edge_ids) {
+          builder_edge_ids->push_back(edge_id);
+        }
+      }
+    }
+    IndexIncomingEdges();
+  }
+
+  template <typename Weight>
+  void FrozenGraph<Weight>::IndexIncomingEdges() {
+    const size_t vertex_count = GetVertexCount();
+    incoming_offsets_.assign(vertex_count + 1, 0);
+    for (const VertexId target : targets_) {
+      ++incoming_offsets_[target + 1];
+    }
+    for (VertexId vertex = 0; vertex < vertex_count; ++vertex) {
+      incoming_offsets_[vertex + 1] += incoming_offsets_[vertex];
+    }
+    incoming_edges_.resize(targets_.size());
+    std::vector<size_t> next_positions(std::begin(incoming_offsets_), std::end(incoming_offsets_) - 1);
+    for (EdgeId edge_id = 0; edge_id < targets_.size(); ++edge_id) {
+      incoming_edges_[next_positions[targets_[edge_id]]++] = edge_id;
+    }
+  }
+
+  template <typename Weight>
+  size_t FrozenGraph<Weight>::GetVertexCount() const {
+    return offsets_.empty() ? 0 : offsets_.size() - 1;
+  }
+
+  template <typename Weight>
+  size_t FrozenGraph<Weight>::GetEdgeCount() const {
+    return targets_.size();
+  }
+
+  template <typename Weight>
+  Edge<Weight> FrozenGraph<Weight>::GetEdge(EdgeId edge_id) const {
+    return {sources_[edge_id], targets_[edge_id], weights_[edge_id]};
+  }
+
+  template <typename Weight>
+  typename FrozenGraph<Weight>::IncidentEdgesRange
+  FrozenGraph<Weight>::GetIncidentEdges(VertexId vertex) const {
+    return {EdgeIdIterator{offsets_[vertex]}, EdgeIdIterator{offsets_[vertex + 1]}};
+  }
+
+  template <typename Weight>
+  typename FrozenGraph<Weight>::IncomingEdgesRange
+  FrozenGraph<Weight>::GetIncomingEdges(VertexId vertex) const {
+    return {std::begin(incoming_edges_) + incoming_offsets_[vertex],
+            std::begin(incoming_edges_) + incoming_offsets_[vertex + 1]};
+  }
 }
@@ -0,0 +1,104 @@
+#pragma once
+
+#include "graph.h"
+#include "metrics.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <iterator>
+#include <limits>
+#include <vector>
+
+namespace Graph {
+
+  template <typename Weight>
+  struct RouteInfo {
+    Weight weight;
+    std::vector<EdgeId> edges;
+    size_t settled_vertex_count = 0;  // by the search answering the query, 0 for precomputed routes
+  };
+
+  // Marks of prev_edges
+  inline constexpr EdgeId NO_ROUTE = std::numeric_limits<EdgeId>::max();
+  inline constexpr EdgeId ROUTE_START = NO_ROUTE - 1;
+
+  // Per-query Dijkstra state, sized once and reused between queries.
+  // A vertex weight is valid only if its generation matches the current one,
+  // so starting a new search does not touch all vertices.
+  template <typename Weight, typename Queue>
+  struct SearchState {
+    std::vector<Weight> weights;
+    std::vector<EdgeId> prev_edges;
+    std::vector<uint32_t> generations;
+    std::vector<uint64_t> settled_bitmap;
+    std::vector<VertexId> settled_vertices;
+    uint32_t generation = 0;
+    Queue queue;
+    // Work of the current search
+    size_t relaxation_count = 0;
+    size_t heap_pop_count = 0;
+
+    void Start(size_t vertex_count);
+    bool IsReached(VertexId vertex) const { return generations[vertex] == generation; }
+    bool IsSettled(VertexId vertex) const { return settled_bitmap[vertex / 64] >> (vertex % 64) & 1; }
+    void Settle(VertexId vertex);
+    void Reach(VertexId vertex, Weight weight, EdgeId prev_edge);
+    VertexId PopMin() {
+      ++heap_pop_count;
+      return queue.PopMin().second;
+    }
+  };
+
+  // Adds the work of a search answering a query, made with one state or two, to Metrics
+  template <typename... States>
+  void RecordSearch(const States&... states) {
+    if (!Metrics::IsEnabled()) {
+      return;
+    }
+    Metrics::Add(Metrics::Counter::SEARCHES, 1);
+    Metrics::Add(Metrics::Counter::SETTLED_VERTICES, (states.settled_vertices.size() + ...));
+    Metrics::Add(Metrics::Counter::RELAXATIONS, (states.relaxation_count + ...));
+    Metrics::Add(Metrics::Counter::HEAP_POPS, (states.heap_pop_count + ...));
+  }
+
+
+  template <typename Weight, typename Queue>
+  void SearchState<Weight, Queue>::Start(size_t vertex_count) {
+    if (generations.size() != vertex_count) {
+      weights.resize(vertex_count);
+      prev_edges.resize(vertex_count);
+      generations.assign(vertex_count, 0);
+      settled_bitmap.assign((vertex_count + 63) / 64, 0);
+      settled_vertices.clear();
+      generation = 0;
+      queue.Reset(vertex_count);
+    }
+    for (const VertexId vertex : settled_vertices) {
+      settled_bitmap[vertex / 64] &= ~(uint64_t{1} << (vertex % 64));
+    }
+    settled_vertices.clear();
+    queue.Clear();
+    relaxation_count = 0;
+    heap_pop_count = 0;
+    if (++generation == 0) {
+      std::fill(std::begin(generations), std::end(generations), 0);
+      generation = 1;
+    }
+  }
+
+  template <typename Weight, typename Queue>
+  void SearchState<Weight, Queue>::Settle(VertexId vertex) {
+    settled_bitmap[vertex / 64] |= uint64_t{1} << (vertex % 64);
+    settled_vertices.push_back(vertex);
+  }
+
+  template <typename Weight, typename Queue>
+  void SearchState<Weight, Queue>::Reach(VertexId vertex, Weight weight, EdgeId prev_edge) {
+    weights[vertex] = weight;
+    prev_edges[vertex] = prev_edge;
+    generations[vertex] = generation;
+    queue.PushOrDecrease(vertex, weight);
+    ++relaxation_count;
+  }
+
+}
@@ -0,0 +1,55 @@
+#pragma once
+
+#include "graph.h"
+#include "snapshot.h"
+
+#include <algorithm>
+#include <iterator>
+#include <stdexcept>
+
+namespace Graph {
+
+  template <typename Weight>
+  class FrozenGraphSnapshot {
+  public:
+    // Incoming edges are not saved, Load indexes them again
+    static void Save(const FrozenGraph<Weight>& graph, Snapshot::Writer& writer);
+    static FrozenGraph<Weight> Load(Snapshot::Reader& reader);
+  };
+
+
+  template <typename Weight>
+  void FrozenGraphSnapshot<Weight>::Save(const FrozenGraph<Weight>& graph, Snapshot::Writer& writer) {
+    writer.WriteVector(graph.offsets_);
+    writer.WriteVector(graph.sources_);
+    writer.WriteVector(graph.targets_);
+    writer.WriteVector(graph.weights_);
+  }
+
+  template <typename Weight>
+  FrozenGraph<Weight> FrozenGraphSnapshot<Weight>::Load(Snapshot::Reader& reader) {
+    FrozenGraph<Weight> graph;
+    graph.offsets_ = reader.ReadVector<EdgeId>();
+    graph.sources_ = reader.ReadVector<VertexId>();
+    graph.targets_ = reader.ReadVector<VertexId>();
+    graph.weights_ = reader.ReadVector<Weight>();
+    const size_t edge_count = graph.targets_.size();
+    if (graph.sources_.size() != edge_count || graph.weights_.size() != edge_count
+        || (graph.offsets_.empty()
+            ? edge_count != 0
+            : graph.offsets_.front() != 0 || graph.offsets_.back() != edge_count)
+        || !std::is_sorted(std::begin(graph.offsets_), std::end(graph.offsets_))) {
+      throw std::runtime_error("inconsistent graph in snapshot");
+    }
+    const size_t vertex_count = graph.GetVertexCount();
+    for (VertexId vertex = 0; vertex < vertex_count; ++vertex) {
+      for (EdgeId edge_id = graph.offsets_[vertex]; edge_id < graph.offsets_[vertex + 1]; ++edge_id) {
+        if (graph.sources_[edge_id] != vertex || graph.targets_[edge_id] >= vertex_count) {
+          throw std::runtime_error("inconsistent graph in snapshot");
+        }
+      }
+    }
+    graph.IndexIncomingEdges();
+    return graph;
+  }
+}
@@ -0,0 +1,32 @@
+#include "json_sax.h"
+
+using namespace std;
+
+namespace Json {
+
+  Node NodeBuilder::Release() {
+    Node result = move(*root_);
+    root_.reset();
+    return result;
+  }
+
+  void NodeBuilder::EndFrame() {
+    Node node = visit([](auto& value) { return Node(move(value)); }, frames_.back().value);
+    frames_.pop_back();
+    AddValue(move(node));
+  }
+
+  void NodeBuilder::AddValue(Node node) {
+    if (frames_.empty()) {
+      root_ = move(node);
+      return;
+    }
+    Frame& frame = frames_.back();
+    if (auto* array = get_if<vector<Node>>(&frame.value)) {
+      array->push_back(move(node));
+    } else {
+      get<Dict>(frame.value).emplace(move(frame.key), move(node));
+    }
+  }
+
+}
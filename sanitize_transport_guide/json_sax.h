@@ -0,0 +1,191 @@
+#pragma once
+
+#include "json.h"
+
+#include <cctype>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <variant>
+#include <vector>
+
+namespace Json {
+
+  // Event-based parser over an in-memory buffer that builds no nodes by itself.
+  // Handler gets a call for every value:
+  //   StartArray(), EndArray(), StartObject(), Key(std::string_view), EndObject(),
+  //   String(std::string_view), Int(int), Double(double), Bool(bool).
+  // String views point into the buffer. Numbers and strings are read the same way as Json::Load does.
+  // Every value consumes input or throws std::invalid_argument, so malformed input cannot stall the parser;
+  // null is rejected, as Json::Node has no place for it.
+  template <typename Handler>
+  class SaxParser {
+  public:
+    SaxParser(std::string_view input, Handler& handler) : input_(input), handler_(handler) {}
+
+    void Parse() {
+      ParseValue();
+    }
+
+  private:
+    void ParseValue() {
+      const char c = NextToken();
+      if (c == '[') {
+        ParseArray();
+      } else if (c == '{') {
+        ParseObject();
+      } else if (c == '"') {
+        handler_.String(ParseString());
+      } else if (c == 't' || c == 'f') {
+        ParseBool();
+      } else if (c == '-' || isdigit(c)) {
+        ParseNumber();
+      } else if (c == 'n') {
+        throw std::invalid_argument("unsupported JSON null");
+      } else {
+        throw std::invalid_argument(std::string("unexpected '") + c + "' in JSON input");
+      }
+    }
+
+    void ParseArray() {
+      handler_.StartArray();
+      Skip('[');
+      while (NextToken() != ']') {
+        ParseValue();
+        if (NextToken() == ',') {
+          Skip(',');
+        }
+      }
+      Skip(']');
+      handler_.EndArray();
+    }
+
+    void ParseObject() {
+      handler_.StartObject();
+      Skip('{');
+      while (NextToken() != '}') {
+        handler_.Key(ParseString());
+        Skip(':');
+        ParseValue();
+        if (NextToken() == ',') {
+          Skip(',');
+        }
+      }
+      Skip('}');
+      handler_.EndObject();
+    }
+
+    std::string_view ParseString() {
+      Skip('"');
+      const size_t end = input_.find('"', pos_);
+      if (end == std::string_view::npos) {
+        throw std::invalid_argument("unterminated JSON string");
+      }
+      const std::string_view result = input_.substr(pos_, end - pos_);
+      pos_ = end + 1;
+      return result;
+    }
+
+    void ParseBool() {
+      const size_t begin = pos_;
+      while (pos_ < input_.size() && isalpha(input_[pos_])) {
+        ++pos_;
+      }
+      const std::string_view word = input_.substr(begin, pos_ - begin);
+      if (word != "true" && word != "false") {
+        throw std::invalid_argument("unexpected '" + std::string(word) + "' in JSON input");
+      }
+      handler_.Bool(word == "true");
+    }
+
+    void ParseNumber() {
+      bool is_negative = false;
+      if (Peek() == '-') {
+        is_negative = true;
+        ++pos_;
+      }
+      if (!isdigit(Peek())) {
+        throw std::invalid_argument("expected a digit in JSON input");
+      }
+      int int_part = 0;
+      while (isdigit(Peek())) {
+        int_part *= 10;
+        int_part += input_[pos_++] - '0';
+      }
+      if (Peek() != '.') {
+        handler_.Int(int_part * (is_negative ? -1 : 1));
+        return;
+      }
+      ++pos_;  // '.'
+      double result = int_part;
+      double frac_mult = 0.1;
+      while (isdigit(Peek())) {
+        result += frac_mult * (input_[pos_++] - '0');
+        frac_mult /= 10;
+      }
+      handler_.Double(result * (is_negative ? -1 : 1));
+    }
+
+    char Peek() const {
+      return pos_ < input_.size() ? input_[pos_] : '\0';
+    }
+
+    char NextToken() {
+      while (pos_ < input_.size() && isspace(input_[pos_])) {
+        ++pos_;
+      }
+      if (pos_ == input_.size()) {
+        throw std::invalid_argument("unexpected end of JSON input");
+      }
+      return input_[pos_];
+    }
+
+    void Skip(char expected) {
+      if (NextToken() != expected) {
+        throw std::invalid_argument(std::string("expected '") + expected + "' in JSON input");
+      }
+      ++pos_;
+    }
+
+    std::string_view input_;
+    size_t pos_ = 0;
+    Handler& handler_;
+  };
+
+  template <typename Handler>
+  void ParseSax(std::string_view input, Handler& handler) {
+    SaxParser<Handler>(input, handler).Parse();
+  }
+
+  // Sax handler building a Json::Node, e.g. for a part of a document
+  class NodeBuilder {
+  public:
+    void StartArray() { frames_.push_back({std::vector<Node>{}, {}}); }
+    void StartObject() { frames_.push_back({Dict{}, {}}); }
+    void Key(std::string_view key) { frames_.back().key = key; }
+    void EndArray() { EndFrame(); }
+    void EndObject() { EndFrame(); }
+
+    void String(std::string_view value) { AddValue(Node(std::string(value))); }
+    void Int(int value) { AddValue(Node(value)); }
+    void Double(double value) { AddValue(Node(value)); }
+    void Bool(bool value) { AddValue(Node(value)); }
+
+    bool IsComplete() const { return frames_.empty() && root_.has_value(); }
+    Node Release();
+
+  private:
+    void EndFrame();
+    void AddValue(Node node);
+
+    struct Frame {
+      std::variant<std::vector<Node>, Dict> value;
+      std::string key;
+    };
+    std::vector<Frame> frames_;
+    std::optional<Node> root_;
+  };
+
+}
@@ -0,0 +1,209 @@
+#include "descriptions.h"
+#include "json.h"
+#include "json_sax.h"
+#include "json_view.h"
+#include "json_writer.h"
+#include "test_utils.h"
+
+#include "test_runner.h"
+
+#include <algorithm>
+#include <iomanip>
+#include <limits>
+#include <sstream>
+#include <string>
+#include <variant>
+#include <vector>
+
+using namespace std;
+
+namespace {
+  // Numbers are printed in full, so that nodes print the same only if they hold the same values
+  string ToString(const Json::Node& node) {
+    ostringstream output;
+    output << setprecision(numeric_limits<double>::max_digits10);
+    Json::PrintNode(node, output);
+    return output.str();
+  }
+
+  string ToString(const Descriptions::InputQuery& query) {
+    ostringstream output;
+    output << setprecision(numeric_limits<double>::max_digits10);
+    if (const auto* stop = get_if<Descriptions::Stop>(&query)) {
+      output << "Stop " << stop->name << " " << stop->position.latitude << " " << stop->position.longitude;
+      vector<pair<string, int>> distances(begin(stop->distances), end(stop->distances));
+      sort(begin(distances), end(distances));
+      for (const auto& [neighbour_name, distance] : distances) {
+        output << " " << neighbour_name << ":" << distance;
+      }
+    } else {
+      const auto& bus = get<Descriptions::Bus>(query);
+      output << "Bus " << bus.name << " stops";
+      for (const auto& stop_name : bus.stops) {
+        output << " " << stop_name;
+      }
+      output << " departures";
+      for (const int departure : bus.departures) {
+        output << " " << departure;
+      }
+    }
+    return output.str();
+  }
+
+  vector<string> ToStrings(const vector<Descriptions::InputQuery>& queries) {
+    vector<string> result;
+    for (const auto& query : queries) {
+      result.push_back(ToString(query));
+    }
+    return result;
+  }
+
+  const string MIXED_VALUES_INPUT =
+      R"({"a": [-1, 2.5, -0.25, 0, true, false, "x y", {}, []], "b": {"c": {"d": [[1], [2, 3]]}}, "e": ""})";
+
+  void TestSaxParserMatchesLoad() {
+    for (const string& input : {SAMPLE_INPUT, MIXED_VALUES_INPUT}) {
+      Json::NodeBuilder builder;
+      Json::ParseSax(input, builder);
+      ASSERT(builder.IsComplete());
+      ASSERT_EQUAL(ToString(builder.Release()), ToString(LoadJson(input).GetRoot()));
+    }
+  }
+
+  void TestViewMatchesLoad() {
+    for (const string& input : {SAMPLE_INPUT, MIXED_VALUES_INPUT}) {
+      const string expected = ToString(LoadJson(input).GetRoot());
+      ASSERT_EQUAL(ToString(Json::ToNode(Json::LoadView(input))), expected);
+      const Json::ViewDocument document(input);
+      ASSERT_EQUAL(ToString(Json::ToNode(document.GetRoot())), expected);
+    }
+  }
+
+  void TestViewDictLookup() {
+    const Json::ViewDocument document(SAMPLE_INPUT);
+    const auto& root = document.GetRoot().AsMap();
+    ASSERT_EQUAL(root.size(), 3u);
+    ASSERT_EQUAL(root.count("stat_requests"), 1u);
+    ASSERT_EQUAL(root.count("missing"), 0u);
+    ASSERT_EQUAL(root.at("routing_settings").AsMap().at("bus_wait_time").AsInt(), 6);
+  }
+
+  // The SAX reader of main builds descriptions straight from the input, skipping nodes
+  void TestInputDocumentMatchesLoad() {
+    const auto input_doc = Descriptions::ReadInputDocument(SAMPLE_INPUT);
+    const Json::Document expected_doc = LoadJson(SAMPLE_INPUT);
+    const auto& expected_map = expected_doc.GetRoot().AsMap();
+
+    ASSERT_EQUAL(ToStrings(input_doc.descriptions),
+                 ToStrings(Descriptions::ReadDescriptions(expected_map.at("base_requests").AsArray())));
+    const Json::ViewDocument view_doc(SAMPLE_INPUT);
+    ASSERT_EQUAL(ToStrings(input_doc.descriptions),
+                 ToStrings(Descriptions::ReadDescriptions(view_doc.GetRoot().AsMap().at("base_requests").AsArray())));
+
+    Json::Dict expected_sections = expected_map;
+    expected_sections.erase("base_requests");
+    ASSERT_EQUAL(ToString(Json::Node(input_doc.sections)), ToString(Json::Node(expected_sections)));
+  }
+
+  void TestResponsesMatchForViewRequests() {
+    const TransportCatalog db = BuildCatalog(SAMPLE_INPUT);
+    const Json::ViewDocument view_doc(SAMPLE_INPUT);
+    ostringstream view_output;
+    Requests::ProcessAll(db, view_doc.GetRoot().AsMap().at("stat_requests").AsArray(), view_output);
+    ASSERT_EQUAL(view_output.str(), AnswerRequests(db, SAMPLE_INPUT));
+  }
+
+  // Every value has to consume input or throw, otherwise arrays and objects would loop forever
+  void WriteNode(const Json::Node& node, Json::Writer& writer) {
+    if (const auto* items = get_if<vector<Json::Node>>(&node.GetBase())) {
+      writer.BeginArray();
+      for (const auto& item : *items) {
+        WriteNode(item, writer);
+      }
+      writer.EndArray();
+    } else if (const auto* dict = get_if<Json::Dict>(&node.GetBase())) {
+      writer.BeginObject();
+      for (const auto& [key, value] : *dict) {
+        writer.Key(key);
+        WriteNode(value, writer);
+      }
+      writer.EndObject();
+    } else if (const auto* value = get_if<bool>(&node.GetBase())) {
+      writer.Bool(*value);
+    } else if (const auto* value = get_if<int>(&node.GetBase())) {
+      writer.Int(*value);
+    } else if (const auto* value = get_if<double>(&node.GetBase())) {
+      writer.Double(*value);
+    } else {
+      writer.String(node.AsString());
+    }
+  }
+
+  // Responses used to be printed with Json::Print, and the writer has to keep them byte for byte
+  void TestWriterMatchesPrint() {
+    vector<Json::Node> ints;
+    for (const int value : {0, 1, -1, 42, 1000000, numeric_limits<int>::max(), numeric_limits<int>::min()}) {
+      ints.emplace_back(value);
+    }
+    // Around the 6 significant digits of the default precision, and where fixed turns into scientific
+    vector<Json::Node> doubles;
+    for (const double value : {0.0, -0.0, 1.0, -2.5, 0.1, 1.0 / 3, 2.0 / 3, 123456.0, 123456.5, 123457.5,
+                               999999.4, 999999.5, 1234567.0, 0.0001, 0.00001234565, 1e-5, 9.999995e-5,
+                               1e21, 5e-324, numeric_limits<double>::max(), numeric_limits<double>::infinity(),
+                               -numeric_limits<double>::infinity(), 405.23499999999996, 1.0000005}) {
+      doubles.emplace_back(value);
+    }
+    // Neither escapes anything, so escape sequences and control characters go through as they are
+    vector<Json::Node> strings;
+    for (const string value : {"", "plain", R"(quote \" inside)", R"(back\\slash)", R"(\n \t A)",
+                               "tab\tand\nnewline", "Бирюлёво", "key: value, [1, 2]"}) {
+      strings.emplace_back(value);
+    }
+    Json::Dict dict{
+        {"ints", ints},
+        {"doubles", doubles},
+        {"strings", strings},
+        {"bools", vector<Json::Node>{true, false}},
+        {"nested", Json::Dict{{"empty array", vector<Json::Node>{}}, {"empty object", Json::Dict{}}}},
+    };
+    for (const auto& [key, value] : Json::Dict(dict)) {
+      dict.emplace(R"(key \" )" + key, value);
+    }
+    const Json::Node root(move(dict));
+
+    ostringstream expected;
+    Json::Print(Json::Document(root), expected);
+    string output;
+    Json::Writer writer(output);
+    WriteNode(root, writer);
+    ASSERT_EQUAL(output, expected.str());
+
+    for (const Json::Node& node : {ints, doubles, strings}) {
+      ostringstream node_expected;
+      Json::PrintNode(node, node_expected);
+      string node_output;
+      Json::Writer node_writer(node_output);
+      WriteNode(node, node_writer);
+      ASSERT_EQUAL(node_output, node_expected.str());
+    }
+  }
+
+  void TestMalformedInputThrows() {
+    for (const string input : {"{\"a\": [1, 2", "{\"a\" 1}", "{\"a\": \"x}", "", "[null]", "[x]", "{\"a\":-}",
+                               "{\"a\": null}", "[1, -, 2]", "[tru]", "[.5]", "{\"a\": [1, }]}"}) {
+      Json::NodeBuilder builder;
+      ASSERT_THROWS(Json::ParseSax(input, builder), invalid_argument);
+      ASSERT_THROWS(Json::LoadView(input), invalid_argument);
+    }
+  }
+}
+
+void TestJson(TestRunner& tr) {
+  RUN_TEST(tr, TestSaxParserMatchesLoad);
+  RUN_TEST(tr, TestViewMatchesLoad);
+  RUN_TEST(tr, TestViewDictLookup);
+  RUN_TEST(tr, TestInputDocumentMatchesLoad);
+  RUN_TEST(tr, TestResponsesMatchForViewRequests);
+  RUN_TEST(tr, TestWriterMatchesPrint);
+  RUN_TEST(tr, TestMalformedInputThrows);
+}
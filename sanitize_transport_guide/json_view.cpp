@@ -0,0 +1,175 @@
+#include "json_view.h"
+#include "json_sax.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <new>
+#include <optional>
+#include <stdexcept>
+
+using namespace std;
+
+namespace Json {
+
+  MappedFile::MappedFile(const string& path) {
+    const int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+      throw runtime_error("cannot open " + path + ": " + strerror(errno));
+    }
+    struct stat file_stat;
+    if (fstat(fd, &file_stat) != 0) {
+      const int error = errno;
+      close(fd);
+      throw runtime_error("cannot stat " + path + ": " + strerror(error));
+    }
+    size_ = file_stat.st_size;
+    if (size_ > 0) {
+      void* data = mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+      if (data == MAP_FAILED) {
+        const int error = errno;
+        close(fd);
+        throw runtime_error("cannot map " + path + ": " + strerror(error));
+      }
+      madvise(data, size_, MADV_SEQUENTIAL);
+      data_ = static_cast<const char*>(data);
+    }
+    close(fd);
+  }
+
+  MappedFile::~MappedFile() {
+    if (data_) {
+      munmap(const_cast<char*>(data_), size_);
+    }
+  }
+
+  ViewDict::ViewDict(pmr::vector<Member> members) : members_(move(members)) {
+    // Stable, so that the first of duplicate keys wins as in Json::Dict
+    stable_sort(members_.begin(), members_.end(), [](const Member& lhs, const Member& rhs) {
+      return lhs.first < rhs.first;
+    });
+  }
+
+  pmr::vector<ViewDict::Member>::const_iterator ViewDict::Find(string_view key) const {
+    auto it = lower_bound(members_.begin(), members_.end(), key, [](const Member& member, string_view key) {
+      return member.first < key;
+    });
+    return it != members_.end() && it->first == key ? it : members_.end();
+  }
+
+  const ViewNode& ViewDict::at(string_view key) const {
+    if (auto it = Find(key); it != members_.end()) {
+      return it->second;
+    }
+    throw out_of_range("no key " + string(key) + " in JSON object");
+  }
+
+  size_t ViewDict::count(string_view key) const {
+    return Find(key) != members_.end() ? 1 : 0;
+  }
+
+  namespace {
+    class ViewNodeBuilder {
+    public:
+      explicit ViewNodeBuilder(pmr::memory_resource* resource) : resource_(resource) {}
+
+      void StartArray() { frames_.push_back({false, stack_.size()}); }
+      void StartObject() { frames_.push_back({true, stack_.size()}); }
+      void Key(string_view key) { keys_.push_back(key); }
+      void EndArray() {
+        const auto begin = stack_.begin() + frames_.back().stack_size;
+        ViewArray items(make_move_iterator(begin), make_move_iterator(stack_.end()), resource_);
+        stack_.erase(begin, stack_.end());
+        frames_.pop_back();
+        AddValue(ViewNode(move(items)));
+      }
+      void EndObject() {
+        const size_t stack_size = frames_.back().stack_size;
+        const size_t member_count = stack_.size() - stack_size;
+        pmr::vector<ViewDict::Member> members(resource_);
+        members.reserve(member_count);
+        for (size_t i = 0; i < member_count; ++i) {
+          members.emplace_back(keys_[keys_.size() - member_count + i], move(stack_[stack_size + i]));
+        }
+        stack_.resize(stack_size);
+        keys_.resize(keys_.size() - member_count);
+        frames_.pop_back();
+        AddValue(ViewNode(ViewDict(move(members))));
+      }
+
+      void String(string_view value) { AddValue(ViewNode(value)); }
+      void Int(int value) { AddValue(ViewNode(value)); }
+      void Double(double value) { AddValue(ViewNode(value)); }
+      void Bool(bool value) { AddValue(ViewNode(value)); }
+
+      ViewNode Release() { return move(*root_); }
+      // Builds the root in place, so that it is not moved out of its resource
+      ViewNode* ReleaseInto(pmr::memory_resource* resource) {
+        return new (resource->allocate(sizeof(ViewNode), alignof(ViewNode))) ViewNode(move(*root_));
+      }
+
+    private:
+      void AddValue(ViewNode node) {
+        if (frames_.empty()) {
+          root_ = move(node);
+        } else {
+          stack_.push_back(move(node));
+        }
+      }
+
+      struct Frame {
+        bool is_object;
+        size_t stack_size;
+      };
+      pmr::memory_resource* resource_;  // of finished containers
+      // Values and keys of unfinished containers share two stacks, which are reused across containers
+      vector<Frame> frames_;
+      vector<ViewNode> stack_;
+      vector<string_view> keys_;
+      optional<ViewNode> root_;
+    };
+  }
+
+  ViewNode LoadView(string_view input, pmr::memory_resource* resource) {
+    ViewNodeBuilder builder(resource);
+    ParseSax(input, builder);
+    return builder.Release();
+  }
+
+  // Nodes usually take a few times the size of the input, so blocks start at its size
+  ViewDocument::ViewDocument(string_view input) : resource_(max<size_t>(input.size(), 4096)) {
+    ViewNodeBuilder builder(&resource_);
+    ParseSax(input, builder);
+    root_ = builder.ReleaseInto(&resource_);
+  }
+
+  Node ToNode(const ViewNode& node) {
+    return visit([](const auto& value) -> Node {
+      using Value = decay_t<decltype(value)>;
+      if constexpr (is_same_v<Value, ViewArray>) {
+        vector<Node> items;
+        items.reserve(value.size());
+        for (const ViewNode& item : value) {
+          items.push_back(ToNode(item));
+        }
+        return Node(move(items));
+      } else if constexpr (is_same_v<Value, ViewDict>) {
+        Dict dict;
+        for (const auto& [key, item] : value) {
+          dict.emplace(string(key), ToNode(item));
+        }
+        return Node(move(dict));
+      } else if constexpr (is_same_v<Value, string_view>) {
+        return Node(string(value));
+      } else {
+        return Node(value);
+      }
+    }, node.GetBase());
+  }
+
+}
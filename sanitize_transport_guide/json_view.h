@@ -0,0 +1,108 @@
+#pragma once
+
+#include "json.h"
+
+#include <memory_resource>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <variant>
+#include <vector>
+
+namespace Json {
+
+  // Read-only memory mapping of a whole file
+  class MappedFile {
+  public:
+    explicit MappedFile(const std::string& path);
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+    ~MappedFile();
+
+    std::string_view GetContents() const {
+      return {data_, size_};
+    }
+
+  private:
+    const char* data_ = nullptr;
+    size_t size_ = 0;
+  };
+
+  class ViewNode;
+  // Arrays and objects take their memory from the resource the document was loaded with
+  using ViewArray = std::pmr::vector<ViewNode>;
+
+  // Object with members sorted by key, looked up by binary search
+  class ViewDict {
+  public:
+    using Member = std::pair<std::string_view, ViewNode>;
+
+    ViewDict() = default;
+    explicit ViewDict(std::pmr::vector<Member> members);
+
+    const ViewNode& at(std::string_view key) const;
+    size_t count(std::string_view key) const;
+    std::pmr::vector<Member>::const_iterator begin() const;
+    std::pmr::vector<Member>::const_iterator end() const;
+    size_t size() const;
+
+  private:
+    std::pmr::vector<Member>::const_iterator Find(std::string_view key) const;
+
+    std::pmr::vector<Member> members_;
+  };
+
+  // Counterpart of Json::Node whose strings and keys point into the parsed buffer,
+  // so the buffer has to outlive the nodes
+  class ViewNode : std::variant<ViewArray, ViewDict, bool, int, double, std::string_view> {
+  public:
+    using variant::variant;
+    const variant& GetBase() const { return *this; }
+
+    const auto& AsArray() const { return std::get<ViewArray>(*this); }
+    const auto& AsMap() const { return std::get<ViewDict>(*this); }
+    bool AsBool() const { return std::get<bool>(*this); }
+    int AsInt() const { return std::get<int>(*this); }
+    double AsDouble() const {
+        return std::holds_alternative<double>(*this) ? std::get<double>(*this) : std::get<int>(*this);
+    }
+    std::string_view AsString() const { return std::get<std::string_view>(*this); }
+  };
+
+  inline std::pmr::vector<ViewDict::Member>::const_iterator ViewDict::begin() const {
+    return members_.begin();
+  }
+
+  inline std::pmr::vector<ViewDict::Member>::const_iterator ViewDict::end() const {
+    return members_.end();
+  }
+
+  inline size_t ViewDict::size() const {
+    return members_.size();
+  }
+
+  // Nodes are allocated from resource, which has to outlive them
+  ViewNode LoadView(std::string_view input,
+                    std::pmr::memory_resource* resource = std::pmr::get_default_resource());
+
+  // Nodes of a whole input allocated from a few large blocks, which are freed at once
+  // without visiting the nodes when the document is destroyed
+  class ViewDocument {
+  public:
+    explicit ViewDocument(std::string_view input);
+    ViewDocument(const ViewDocument&) = delete;
+    ViewDocument& operator=(const ViewDocument&) = delete;
+
+    const ViewNode& GetRoot() const {
+      return *root_;
+    }
+
+  private:
+    std::pmr::monotonic_buffer_resource resource_;
+    ViewNode* root_;  // in resource_, never destroyed, as nodes own nothing but memory from resource_
+  };
+
+  // Deep copy owning its strings
+  Node ToNode(const ViewNode& node);
+
+}
@@ -0,0 +1,94 @@
+#include "json_writer.h"
+
+#include <charconv>
+
+using namespace std;
+
+namespace Json {
+
+  void Writer::BeginValue() {
+    if (after_key_) {
+      after_key_ = false;
+      return;
+    }
+    if (!scope_is_empty_.empty()) {
+      if (!scope_is_empty_.back()) {
+        output_ += ", ";
+      }
+      scope_is_empty_.back() = false;
+    }
+  }
+
+  Writer& Writer::BeginArray() {
+    BeginValue();
+    output_ += '[';
+    scope_is_empty_.push_back(true);
+    return *this;
+  }
+
+  Writer& Writer::EndArray() {
+    scope_is_empty_.pop_back();
+    output_ += ']';
+    return *this;
+  }
+
+  Writer& Writer::BeginObject() {
+    BeginValue();
+    output_ += '{';
+    scope_is_empty_.push_back(true);
+    return *this;
+  }
+
+  Writer& Writer::EndObject() {
+    scope_is_empty_.pop_back();
+    output_ += '}';
+    return *this;
+  }
+
+  Writer& Writer::Key(string_view key) {
+    BeginValue();
+    output_ += '"';
+    output_ += key;
+    output_ += "\": ";
+    after_key_ = true;
+    return *this;
+  }
+
+  Writer& Writer::String(string_view value) {
+    BeginValue();
+    output_ += '"';
+    output_ += value;
+    output_ += '"';
+    return *this;
+  }
+
+  Writer& Writer::Int(int64_t value) {
+    BeginValue();
+    char buffer[24];
+    const auto result = to_chars(begin(buffer), end(buffer), value);
+    output_.append(buffer, result.ptr);
+    return *this;
+  }
+
+  Writer& Writer::Double(double value) {
+    BeginValue();
+    // Same as std::ostream with default precision, i.e. printf("%.6g")
+    char buffer[32];
+    const auto result = to_chars(begin(buffer), end(buffer), value, chars_format::general, 6);
+    output_.append(buffer, result.ptr);
+    return *this;
+  }
+
+  Writer& Writer::Bool(bool value) {
+    BeginValue();
+    output_ += value ? "true" : "false";
+    return *this;
+  }
+
+  Writer& Writer::Null() {
+    BeginValue();
+    output_ += "null";
+    return *this;
+  }
+
+}
@@ -0,0 +1,39 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace Json {
+
+  // Streams JSON straight into a string buffer, byte for byte like Json::Print does:
+  // ", " between items, ": " after keys, strings are not escaped and
+  // numbers look like std::ostream output with default settings.
+  // Json::Print orders object members by key, so callers write keys in sorted order to match it.
+  class Writer {
+  public:
+    explicit Writer(std::string& output) : output_(output) {}
+
+    Writer& BeginArray();
+    Writer& EndArray();
+    Writer& BeginObject();
+    Writer& EndObject();
+    Writer& Key(std::string_view key);
+
+    Writer& String(std::string_view value);
+    Writer& Int(int64_t value);
+    Writer& Double(double value);
+    Writer& Bool(bool value);
+    // Json::Node has no null, so nothing written with it can be read back as a Json::Node
+    Writer& Null();
+
+  private:
+    void BeginValue();
+
+    std::string& output_;
+    std::vector<bool> scope_is_empty_;
+    bool after_key_ = false;
+  };
+
+}
@@ -0,0 +1,104 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <functional>
+#include <list>
+#include <mutex>
+#include <optional>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+struct LruCacheStats {
+  size_t hit_count;
+  size_t miss_count;
+  size_t eviction_count;
+};
+
+// Bounded cache evicting the least recently used entries, safe to share between threads.
+// Keys are spread over shards, each with its own mutex and its own part of the capacity,
+// so that concurrent lookups of different keys rarely wait for each other.
+template <typename Key, typename Value, typename Hash = std::hash<Key>>
+class LruCache {
+public:
+  using Stats = LruCacheStats;
+
+  explicit LruCache(size_t capacity, size_t shard_count = 16)
+      : shards_(std::max<size_t>(1, std::min(shard_count, capacity)))
+  {
+    for (size_t shard_idx = 0; shard_idx < shards_.size(); ++shard_idx) {
+      shards_[shard_idx].capacity = capacity / shards_.size() + (shard_idx < capacity % shards_.size());
+    }
+  }
+
+  // Values are copied out under the lock, so they had better be cheap to copy
+  std::optional<Value> Find(const Key& key) {
+    Shard& shard = GetShard(key);
+    std::lock_guard guard(shard.mutex);
+    const auto it = shard.positions.find(key);
+    if (it == shard.positions.end()) {
+      miss_count_.fetch_add(1, std::memory_order_relaxed);
+      return std::nullopt;
+    }
+    hit_count_.fetch_add(1, std::memory_order_relaxed);
+    shard.items.splice(shard.items.begin(), shard.items, it->second);
+    return it->second->second;
+  }
+
+  // Keeps the present value if another thread has inserted the key already
+  void Insert(const Key& key, Value value) {
+    Shard& shard = GetShard(key);
+    if (shard.capacity == 0) {
+      return;
+    }
+    std::lock_guard guard(shard.mutex);
+    if (shard.positions.count(key)) {
+      return;
+    }
+    if (shard.items.size() == shard.capacity) {
+      shard.positions.erase(shard.items.back().first);
+      shard.items.pop_back();
+      eviction_count_.fetch_add(1, std::memory_order_relaxed);
+    }
+    shard.items.emplace_front(key, std::move(value));
+    shard.positions.emplace(key, shard.items.begin());
+  }
+
+  // Least recently used entries of a shard go first
+  template <typename Callback>
+  void ForEach(Callback callback) const {
+    for (const Shard& shard : shards_) {
+      std::lock_guard guard(shard.mutex);
+      for (auto it = shard.items.rbegin(); it != shard.items.rend(); ++it) {
+        callback(it->first, it->second);
+      }
+    }
+  }
+
+  Stats GetStats() const {
+    return {
+        hit_count_.load(std::memory_order_relaxed),
+        miss_count_.load(std::memory_order_relaxed),
+        eviction_count_.load(std::memory_order_relaxed),
+    };
+  }
+
+private:
+  struct Shard {
+    mutable std::mutex mutex;
+    size_t capacity = 0;
+    std::list<std::pair<Key, Value>> items;  // most recently used first
+    std::unordered_map<Key, typename std::list<std::pair<Key, Value>>::iterator, Hash> positions;
+  };
+
+  Shard& GetShard(const Key& key) {
+    return shards_[hash_(key) % shards_.size()];
+  }
+
+  Hash hash_;
+  std::vector<Shard> shards_;
+  std::atomic<size_t> hit_count_ = 0;
+  std::atomic<size_t> miss_count_ = 0;
+  std::atomic<size_t> eviction_count_ = 0;
+};
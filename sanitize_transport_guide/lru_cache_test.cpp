@@ -0,0 +1,106 @@
+#include "lru_cache.h"
+
+#include "test_runner.h"
+
+#include <string>
+#include <utility>
+#include <vector>
+
+using namespace std;
+
+namespace {
+  using Cache = LruCache<int, string>;
+
+  // Keys from the least recently used on
+  vector<int> GetKeys(const Cache& cache) {
+    vector<int> keys;
+    cache.ForEach([&keys](int key, const string&) { keys.push_back(key); });
+    return keys;
+  }
+
+  void TestEvictsLeastRecentlyInserted() {
+    Cache cache(3, 1);
+    for (int key = 1; key <= 5; ++key) {
+      cache.Insert(key, to_string(key));
+    }
+    ASSERT_EQUAL(GetKeys(cache), (vector<int>{3, 4, 5}));
+    ASSERT(!cache.Find(1));
+    ASSERT(!cache.Find(2));
+    ASSERT_EQUAL(*cache.Find(3), "3");
+  }
+
+  void TestFindRefreshesRecency() {
+    Cache cache(3, 1);
+    cache.Insert(1, "1");
+    cache.Insert(2, "2");
+    cache.Insert(3, "3");
+    ASSERT_EQUAL(*cache.Find(1), "1");
+    ASSERT_EQUAL(GetKeys(cache), (vector<int>{2, 3, 1}));
+
+    cache.Insert(4, "4");
+    ASSERT_EQUAL(GetKeys(cache), (vector<int>{3, 1, 4}));
+    ASSERT(!cache.Find(2));
+
+    ASSERT(cache.Find(3));
+    cache.Insert(5, "5");
+    ASSERT_EQUAL(GetKeys(cache), (vector<int>{4, 3, 5}));
+  }
+
+  void TestInsertKeepsPresentValue() {
+    Cache cache(2, 1);
+    cache.Insert(1, "first");
+    cache.Insert(2, "2");
+    cache.Insert(1, "second");
+    ASSERT_EQUAL(*cache.Find(1), "first");
+    // Inserting a present key does not make it recent either
+    cache.Insert(2, "2");
+    cache.Insert(3, "3");
+    ASSERT_EQUAL(GetKeys(cache), (vector<int>{1, 3}));
+  }
+
+  void TestStats() {
+    Cache cache(2, 1);
+    cache.Insert(1, "1");
+    cache.Insert(2, "2");
+    cache.Find(1);
+    cache.Find(3);
+    cache.Insert(3, "3");
+    cache.Insert(4, "4");
+    cache.Find(2);
+    const auto stats = cache.GetStats();
+    ASSERT_EQUAL(stats.hit_count, 1u);
+    ASSERT_EQUAL(stats.miss_count, 2u);
+    ASSERT_EQUAL(stats.eviction_count, 2u);
+  }
+
+  void TestZeroCapacity() {
+    Cache cache(0);
+    cache.Insert(1, "1");
+    ASSERT(!cache.Find(1));
+    ASSERT(GetKeys(cache).empty());
+    ASSERT_EQUAL(cache.GetStats().eviction_count, 0u);
+  }
+
+  // Every shard evicts by itself, and the shards hold the whole capacity together
+  void TestShardsKeepCapacity() {
+    const size_t capacity = 10;
+    Cache cache(capacity, 4);
+    for (int key = 0; key < 100; ++key) {
+      cache.Insert(key, to_string(key));
+    }
+    ASSERT(GetKeys(cache).size() <= capacity);
+    ASSERT_EQUAL(GetKeys(cache).size() + cache.GetStats().eviction_count, 100u);
+    for (const int key : GetKeys(cache)) {
+      ASSERT_EQUAL(*cache.Find(key), to_string(key));
+    }
+  }
+}
+
+void TestLruCache(TestRunner& tr) {
+  RUN_TEST(tr, TestEvictsLeastRecentlyInserted);
+  RUN_TEST(tr, TestFindRefreshesRecency);
+  RUN_TEST(tr, TestInsertKeepsPresentValue);
+  RUN_TEST(tr, TestStats);
+  RUN_TEST(tr, TestZeroCapacity);
+  RUN_TEST(tr, TestShardsKeepCapacity);
+}
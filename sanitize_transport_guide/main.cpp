@@ -1,28 +1,168 @@
 #include "descriptions.h"
 #include "json.h"
+#include "json_view.h"
+#include "json_writer.h"
+#include "metrics.h"
 #include "requests.h"
+#include "server.h"
 #include "sphere.h"
 #include "transport_catalog.h"
 #include "utils.h"
 
+#include <csignal>
+#include <fstream>
 #include <iostream>
+#include <optional>
+#include <stdexcept>
+#include <string_view>
+#include <thread>
 
 using namespace std;
 
-int main() {
-  const auto input_doc = Json::Load(cin);
+// Usage: transport_guide [--save-snapshot PATH | --snapshot PATH] [--serve PATH] [--metrics PATH] [INPUT_PATH]
+// --save-snapshot builds the catalog from base_requests and routing_settings, saves it and exits;
+// --snapshot takes the catalog from a saved snapshot and only reads stat_requests from the input;
+// --serve answers stat requests sent one per line to a Unix domain socket at PATH, instead of
+//   those of the input, until SIGINT or SIGTERM;
+// --metrics writes timings of the phases, graph search counters and request latencies as JSON when done.
+struct Options {
+  optional<string> input_path;
+  optional<string> save_snapshot_path;
+  optional<string> snapshot_path;
+  optional<string> metrics_path;
+  optional<string> serve_path;
+};
+
+Options ParseOptions(int argc, const char* argv[]) {
+  Options options;
+  for (int arg_idx = 1; arg_idx < argc; ++arg_idx) {
+    const string_view arg = argv[arg_idx];
+    if (arg == "--save-snapshot" || arg == "--snapshot" || arg == "--metrics" || arg == "--serve") {
+      if (++arg_idx == argc) {
+        throw invalid_argument(string(arg) + " requires a path");
+      }
+      (arg == "--snapshot" ? options.snapshot_path
+       : arg == "--metrics" ? options.metrics_path
+       : arg == "--serve" ? options.serve_path
+       : options.save_snapshot_path) = argv[arg_idx];
+    } else {
+      options.input_path = argv[arg_idx];
+    }
+  }
+  if (options.snapshot_path && options.save_snapshot_path) {
+    throw invalid_argument("--snapshot and --save-snapshot cannot be combined");
+  }
+  if (options.serve_path && options.save_snapshot_path) {
+    throw invalid_argument("--serve and --save-snapshot cannot be combined");
+  }
+  return options;
+}
+
+void WriteMetrics(const string& path) {
+  string metrics;
+  Json::Writer writer(metrics);
+  Metrics::Write(writer);
+  ofstream output(path);
+  output << metrics << endl;
+  if (!output) {
+    throw runtime_error("cannot write metrics to " + path);
+  }
+}
+
+Server* running_server = nullptr;
+
+void StopServer(int) {
+  running_server->Stop();
+}
+
+void Serve(const TransportCatalog& db, const string& socket_path) {
+  // So that first requests do not wait for bus stats or routers
+  db.BuildDeferred();
+  Server server(db, socket_path, thread::hardware_concurrency());
+  running_server = &server;
+  signal(SIGINT, StopServer);
+  signal(SIGTERM, StopServer);
+  server.Run();
+  signal(SIGINT, SIG_DFL);
+  signal(SIGTERM, SIG_DFL);
+  running_server = nullptr;
+}
+
+template <typename Nodes, typename MakeCatalog>
+void Process(const Options& options, const Nodes& stat_requests, MakeCatalog make_catalog) {
+  const TransportCatalog db = options.snapshot_path
+      ? TransportCatalog::LoadSnapshot(*options.snapshot_path)
+      : make_catalog();
+
+  if (options.save_snapshot_path) {
+    db.SaveSnapshot(*options.save_snapshot_path);
+  } else if (options.serve_path) {
+    Serve(db, *options.serve_path);
+  } else {
+    Requests::ProcessAll(db, stat_requests, cout, thread::hardware_concurrency());
+    cout << endl;
+  }
+
+  if (options.metrics_path) {
+    WriteMetrics(*options.metrics_path);
+  }
+}
+
+// Maps the input file into memory and reads it into nodes pointing into the mapping, allocated from an arena
+void ProcessMappedFile(const Options& options) {
+  const Json::MappedFile input_file(*options.input_path);
+  const Json::ViewDocument input_doc = [&input_file] {
+    const Metrics::ScopedTimer timer(Metrics::Phase::PARSE);
+    return Json::ViewDocument(input_file.GetContents());
+  }();
   const auto& input_map = input_doc.GetRoot().AsMap();
 
-  const TransportCatalog db(
-    Descriptions::ReadDescriptions(input_map.at("base_requests").AsArray()),
-    input_map.at("routing_settings").AsMap()
-  );
+  const Json::ViewArray no_requests;
+  const auto& stat_requests = input_map.count("stat_requests") ? input_map.at("stat_requests").AsArray() : no_requests;
+  Process(options, stat_requests, [&input_map] {
+    auto descriptions = [&input_map] {
+      const Metrics::ScopedTimer timer(Metrics::Phase::DESCRIPTIONS);
+      return Descriptions::ReadDescriptions(input_map.at("base_requests").AsArray());
+    }();
+    return TransportCatalog(
+      move(descriptions),
+      Json::ToNode(input_map.at("routing_settings")).AsMap(),
+      thread::hardware_concurrency()
+    );
+  });
+}
+
+int main(int argc, const char* argv[]) {
+  const Options options = ParseOptions(argc, argv);
+  Metrics::Enable(options.metrics_path.has_value());
+  // Neither base_requests nor stat_requests are needed, so the input is not read at all
+  if (options.snapshot_path && options.serve_path) {
+    Process(options, vector<Json::Node>{}, [&options] {
+      return TransportCatalog::LoadSnapshot(*options.snapshot_path);
+    });
+    return 0;
+  }
+  if (options.input_path) {
+    ProcessMappedFile(options);
+    return 0;
+  }
+
+  auto input_doc = [] {
+    const string input = ReadAll(cin);
+    const Metrics::ScopedTimer timer(Metrics::Phase::PARSE);
+    return Descriptions::ReadInputDocument(input);
+  }();
+  const auto& input_map = input_doc.sections;
 
-  Json::PrintValue(
-    Requests::ProcessAll(db, input_map.at("stat_requests").AsArray()),
-    cout
-  );
-  cout << endl;
+  const vector<Json::Node> no_requests;
+  const auto& stat_requests = input_map.count("stat_requests") ? input_map.at("stat_requests").AsArray() : no_requests;
+  Process(options, stat_requests, [&input_doc, &input_map] {
+    return TransportCatalog(
+      move(input_doc.descriptions),
+      input_map.at("routing_settings").AsMap(),
+      thread::hardware_concurrency()
+    );
+  });
 
   return 0;
 }
@@ -0,0 +1,184 @@
+#include "metrics.h"
+
+#include <algorithm>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+using namespace std;
+
+namespace Metrics {
+
+  namespace {
+    constexpr size_t PHASE_COUNT = static_cast<size_t>(Phase::COUNT);
+    constexpr size_t COUNTER_COUNT = static_cast<size_t>(Counter::COUNT);
+
+    const array<string_view, PHASE_COUNT> PHASE_NAMES = {
+        "parse", "descriptions", "catalog_build", "graph_fill", "router_init",
+        "snapshot_save", "snapshot_load", "requests",
+    };
+    const array<string_view, COUNTER_COUNT> COUNTER_NAMES = {
+        "graph_vertices", "graph_edges", "timetable_connections",
+        "searches", "settled_vertices", "relaxations", "heap_pops",
+    };
+
+    array<atomic<uint64_t>, PHASE_COUNT> phase_times;  // in nanoseconds
+    array<atomic<uint64_t>, PHASE_COUNT> phase_counts;
+
+    // Bucket b counts latencies in [2^b, 2^(b+1)) nanoseconds, the first one from 0
+    struct Histogram {
+      array<atomic<uint64_t>, 64> buckets{};
+      atomic<uint64_t> count = 0;
+      atomic<uint64_t> total = 0;
+      atomic<uint64_t> max = 0;
+    };
+
+    mutex histograms_mutex;
+    // Histograms are never removed, so pointers to them stay valid after the lock is released
+    map<string, unique_ptr<Histogram>, less<>> histograms;
+
+    Histogram& GetHistogram(string_view request_type) {
+      lock_guard guard(histograms_mutex);
+      auto it = histograms.find(request_type);
+      if (it == histograms.end()) {
+        it = histograms.emplace(string(request_type), make_unique<Histogram>()).first;
+      }
+      return *it->second;
+    }
+
+    size_t GetBucket(uint64_t nanoseconds) {
+      size_t bucket = 0;
+      while (bucket + 1 < 64 && nanoseconds >> (bucket + 1) != 0) {
+        ++bucket;
+      }
+      return bucket;
+    }
+
+    // Names with their indices, in alphabetical order as Json::Print would write them
+    template <size_t N>
+    vector<pair<string_view, size_t>> SortNames(const array<string_view, N>& names) {
+      vector<pair<string_view, size_t>> sorted_names;
+      for (size_t idx = 0; idx < N; ++idx) {
+        sorted_names.emplace_back(names[idx], idx);
+      }
+      sort(begin(sorted_names), end(sorted_names));
+      return sorted_names;
+    }
+
+    void WriteHistogram(const Histogram& histogram, Json::Writer& writer) {
+      vector<uint64_t> bucket_counts(histogram.buckets.size());
+      for (size_t bucket = 0; bucket < bucket_counts.size(); ++bucket) {
+        bucket_counts[bucket] = histogram.buckets[bucket].load(memory_order_relaxed);
+      }
+      const uint64_t count = histogram.count.load(memory_order_relaxed);
+      // Upper bound of the bucket holding the latency share of requests do not exceed
+      auto percentile = [&](double share) {
+        uint64_t seen_count = 0;
+        for (size_t bucket = 0; bucket < bucket_counts.size(); ++bucket) {
+          seen_count += bucket_counts[bucket];
+          if (seen_count > 0 && seen_count >= share * count) {
+            return static_cast<int64_t>(uint64_t{2} << bucket);
+          }
+        }
+        return int64_t{0};
+      };
+
+      writer.BeginObject().Key("buckets").BeginArray();
+      for (size_t bucket = 0; bucket < bucket_counts.size(); ++bucket) {
+        if (bucket_counts[bucket] > 0) {
+          writer.BeginObject()
+              .Key("count").Int(bucket_counts[bucket])
+              .Key("upper_ns").Int(uint64_t{2} << bucket)
+              .EndObject();
+        }
+      }
+      writer.EndArray()
+          .Key("count").Int(count)
+          .Key("max_ns").Int(histogram.max.load(memory_order_relaxed))
+          .Key("p50_upper_ns").Int(percentile(0.5))
+          .Key("p90_upper_ns").Int(percentile(0.9))
+          .Key("p99_upper_ns").Int(percentile(0.99))
+          .Key("total_ns").Int(histogram.total.load(memory_order_relaxed))
+          .EndObject();
+    }
+  }
+
+  void Enable(bool enabled) {
+    Detail::enabled.store(enabled, memory_order_relaxed);
+  }
+
+  void Reset() {
+    for (auto& counter : Detail::counters) {
+      counter.store(0, memory_order_relaxed);
+    }
+    for (size_t phase_idx = 0; phase_idx < PHASE_COUNT; ++phase_idx) {
+      phase_times[phase_idx].store(0, memory_order_relaxed);
+      phase_counts[phase_idx].store(0, memory_order_relaxed);
+    }
+    lock_guard guard(histograms_mutex);
+    histograms.clear();
+  }
+
+  void AddPhaseTime(Phase phase, uint64_t nanoseconds) {
+    if (!IsEnabled()) {
+      return;
+    }
+    phase_times[static_cast<size_t>(phase)].fetch_add(nanoseconds, memory_order_relaxed);
+    phase_counts[static_cast<size_t>(phase)].fetch_add(1, memory_order_relaxed);
+  }
+
+  void AddRequestLatency(string_view request_type, uint64_t nanoseconds) {
+    if (!IsEnabled()) {
+      return;
+    }
+    Histogram& histogram = GetHistogram(request_type);
+    histogram.buckets[GetBucket(nanoseconds)].fetch_add(1, memory_order_relaxed);
+    histogram.count.fetch_add(1, memory_order_relaxed);
+    histogram.total.fetch_add(nanoseconds, memory_order_relaxed);
+    uint64_t max = histogram.max.load(memory_order_relaxed);
+    while (max < nanoseconds && !histogram.max.compare_exchange_weak(max, nanoseconds, memory_order_relaxed)) {
+    }
+  }
+
+  void Write(Json::Writer& writer) {
+    auto get_counter = [](Counter counter) {
+      return Detail::counters[static_cast<size_t>(counter)].load(memory_order_relaxed);
+    };
+
+    writer.BeginObject().Key("counters").BeginObject();
+    for (const auto& [name, idx] : SortNames(COUNTER_NAMES)) {
+      writer.Key(name).Int(Detail::counters[idx].load(memory_order_relaxed));
+    }
+    writer.EndObject();
+
+    const double search_count = max<uint64_t>(1, get_counter(Counter::SEARCHES));
+    writer.Key("per_search").BeginObject()
+        .Key("heap_pops").Double(get_counter(Counter::HEAP_POPS) / search_count)
+        .Key("relaxations").Double(get_counter(Counter::RELAXATIONS) / search_count)
+        .Key("settled_vertices").Double(get_counter(Counter::SETTLED_VERTICES) / search_count)
+        .EndObject();
+
+    writer.Key("phases").BeginObject();
+    for (const auto& [name, idx] : SortNames(PHASE_NAMES)) {
+      writer.Key(name).BeginObject()
+          .Key("count").Int(phase_counts[idx].load(memory_order_relaxed))
+          .Key("total_ns").Int(phase_times[idx].load(memory_order_relaxed))
+          .EndObject();
+    }
+    writer.EndObject();
+
+    writer.Key("requests").BeginObject();
+    {
+      lock_guard guard(histograms_mutex);
+      for (const auto& [request_type, histogram] : histograms) {
+        writer.Key(request_type);
+        WriteHistogram(*histogram, writer);
+      }
+    }
+    writer.EndObject().EndObject();
+  }
+
+}
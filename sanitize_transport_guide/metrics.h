@@ -0,0 +1,101 @@
+#pragma once
+
+#include "json_writer.h"
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <string_view>
+
+// Timings and counters of the transport guide pipeline, collected while enabled and dumped as JSON on demand.
+// They are process-wide and may be updated from any thread. While disabled, recording costs one relaxed load.
+namespace Metrics {
+
+  enum class Phase {
+    PARSE,  // input document into nodes, or straight into descriptions for the standard input
+    DESCRIPTIONS,  // nodes into descriptions
+    CATALOG_BUILD,  // the whole catalog, routers included
+    GRAPH_FILL,  // graph of TransportRouter
+    ROUTER_INIT,  // the whole TransportRouter, graph included
+    SNAPSHOT_SAVE,
+    SNAPSHOT_LOAD,
+    REQUESTS,  // all stat requests
+    COUNT,
+  };
+
+  enum class Counter {
+    GRAPH_VERTICES,  // of the last graph built or loaded
+    GRAPH_EDGES,
+    TIMETABLE_CONNECTIONS,
+    SEARCHES,  // graph searches answering route queries
+    SETTLED_VERTICES,  // by those searches
+    RELAXATIONS,  // edges improving a vertex weight, each a heap push or decrease
+    HEAP_POPS,
+    COUNT,
+  };
+
+  namespace Detail {
+    inline std::atomic<bool> enabled = false;
+    inline std::array<std::atomic<uint64_t>, static_cast<size_t>(Counter::COUNT)> counters{};
+  }
+
+  inline bool IsEnabled() {
+    return Detail::enabled.load(std::memory_order_relaxed);
+  }
+
+  void Enable(bool enabled = true);
+  // Zeroes everything recorded so far
+  void Reset();
+
+  inline void Add(Counter counter, uint64_t value) {
+    if (IsEnabled()) {
+      Detail::counters[static_cast<size_t>(counter)].fetch_add(value, std::memory_order_relaxed);
+    }
+  }
+
+  inline void Set(Counter counter, uint64_t value) {
+    if (IsEnabled()) {
+      Detail::counters[static_cast<size_t>(counter)].store(value, std::memory_order_relaxed);
+    }
+  }
+
+  using Clock = std::chrono::steady_clock;
+
+  inline uint64_t GetNanosecondsSince(Clock::time_point start) {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - start).count();
+  }
+
+  void AddPhaseTime(Phase phase, uint64_t nanoseconds);
+  // Latencies of every request type go to a histogram with power of two buckets
+  void AddRequestLatency(std::string_view request_type, uint64_t nanoseconds);
+
+  // Adds the time of a scope to phase, if metrics were enabled when it started
+  class ScopedTimer {
+  public:
+    explicit ScopedTimer(Phase phase)
+        : phase_(phase),
+          is_enabled_(IsEnabled()),
+          start_(is_enabled_ ? Clock::now() : Clock::time_point{})
+    {
+    }
+
+    ScopedTimer(const ScopedTimer&) = delete;
+    ScopedTimer& operator=(const ScopedTimer&) = delete;
+
+    ~ScopedTimer() {
+      if (is_enabled_) {
+        AddPhaseTime(phase_, GetNanosecondsSince(start_));
+      }
+    }
+
+  private:
+    Phase phase_;
+    bool is_enabled_;
+    Clock::time_point start_;
+  };
+
+  // {"counters": {...}, "phases": {...}, "requests": {...}}, see metrics.cpp for the members
+  void Write(Json::Writer& writer);
+
+}
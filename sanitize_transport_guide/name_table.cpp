@@ -0,0 +1,29 @@
+#include "name_table.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+using namespace std;
+
+NameTable::NameTable(vector<string> names) : names_(move(names)) {
+  sort(begin(names_), end(names_));
+  names_.erase(unique(begin(names_), end(names_)), end(names_));
+  ids_.reserve(names_.size());
+  for (NameId id = 0; id < names_.size(); ++id) {
+    ids_.emplace(names_[id], id);
+  }
+}
+
+optional<NameId> NameTable::Find(string_view name) const {
+  if (auto it = ids_.find(name); it != ids_.end()) {
+    return it->second;
+  }
+  return nullopt;
+}
+
+NameId NameTable::GetId(string_view name) const {
+  if (auto it = ids_.find(name); it != ids_.end()) {
+    return it->second;
+  }
+  throw out_of_range("unknown name: " + string(name));
+}
@@ -0,0 +1,40 @@
+#pragma once
+
+#include <cstdint>
+#include <limits>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+using NameId = uint32_t;
+
+// Marks names without an id, e.g. removed ones in maps between ids of two tables
+inline constexpr NameId NO_NAME = std::numeric_limits<NameId>::max();
+
+// Interned names with dense ids. Ids follow the alphabetical order of names,
+// so sorting ids sorts the names too.
+class NameTable {
+public:
+  NameTable() = default;
+  explicit NameTable(std::vector<std::string> names);
+
+  // Lookup keys point into names_, which a copy would not preserve
+  NameTable(const NameTable&) = delete;
+  NameTable& operator=(const NameTable&) = delete;
+  NameTable(NameTable&&) = default;
+  NameTable& operator=(NameTable&&) = default;
+
+  std::optional<NameId> Find(std::string_view name) const;
+  // Throws std::out_of_range for unknown names
+  NameId GetId(std::string_view name) const;
+  const std::string& GetName(NameId id) const { return names_[id]; }
+
+  size_t size() const { return names_.size(); }
+  const std::vector<std::string>& GetNames() const { return names_; }
+
+private:
+  std::vector<std::string> names_;
+  std::unordered_map<std::string_view, NameId> ids_;
+};
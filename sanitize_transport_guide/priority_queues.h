@@ -0,0 +1,210 @@
+#pragma once
+
+#include "graph.h"
+
+#include <array>
+#include <cassert>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace Graph {
+
+  // Both queues share the interface used by Router:
+  //   Reset(vertex_count), Clear(), IsEmpty(), PushOrDecrease(vertex, weight), PopMin() -> {weight, vertex}.
+  // PopMin may return outdated entries for vertices that have already been popped,
+  // so the caller must skip vertices it has already settled.
+
+  // Binary heap over vertices with decrease-key; each vertex is stored at most once
+  template <typename Weight>
+  class IndexedBinaryHeap {
+  public:
+    void Reset(size_t vertex_count) {
+      heap_.clear();
+      positions_.assign(vertex_count, NO_POSITION);
+    }
+
+    void Clear() {
+      for (const auto& item : heap_) {
+        positions_[item.vertex] = NO_POSITION;
+      }
+      heap_.clear();
+    }
+
+    bool IsEmpty() const {
+      return heap_.empty();
+    }
+
+    void PushOrDecrease(VertexId vertex, Weight weight) {
+      size_t position = positions_[vertex];
+      if (position == NO_POSITION) {
+        position = heap_.size();
+        heap_.push_back({weight, vertex});
+      } else {
+        assert(!(heap_[position].weight < weight));
+        heap_[position].weight = weight;
+      }
+      SiftUp(position);
+    }
+
+    std::pair<Weight, VertexId> PopMin() {
+      const Item top = heap_.front();
+      positions_[top.vertex] = NO_POSITION;
+      if (heap_.size() > 1) {
+        heap_.front() = heap_.back();
+        heap_.pop_back();
+        SiftDown(0);
+      } else {
+        heap_.pop_back();
+      }
+      return {top.weight, top.vertex};
+    }
+
+  private:
+    struct Item {
+      Weight weight;
+      VertexId vertex;
+    };
+
+    static constexpr size_t NO_POSITION = std::numeric_limits<size_t>::max();
+
+    void Place(size_t position, const Item& item) {
+      heap_[position] = item;
+      positions_[item.vertex] = position;
+    }
+
+    void SiftUp(size_t position) {
+      const Item item = heap_[position];
+      while (position > 0) {
+        const size_t parent = (position - 1) / 2;
+        if (!(item.weight < heap_[parent].weight)) {
+          break;
+        }
+        Place(position, heap_[parent]);
+        position = parent;
+      }
+      Place(position, item);
+    }
+
+    void SiftDown(size_t position) {
+      const Item item = heap_[position];
+      const size_t size = heap_.size();
+      while (true) {
+        size_t child = position * 2 + 1;
+        if (child >= size) {
+          break;
+        }
+        if (child + 1 < size && heap_[child + 1].weight < heap_[child].weight) {
+          ++child;
+        }
+        if (!(heap_[child].weight < item.weight)) {
+          break;
+        }
+        Place(position, heap_[child]);
+        position = child;
+      }
+      Place(position, item);
+    }
+
+    std::vector<Item> heap_;
+    std::vector<size_t> positions_;
+  };
+
+
+  // Maps non-negative weights to unsigned keys preserving their order
+  template <typename Weight, typename = void>
+  struct RadixKey;
+
+  template <typename Weight>
+  struct RadixKey<Weight, std::enable_if_t<std::is_unsigned_v<Weight>>> {
+    static uint64_t From(Weight weight) { return weight; }
+  };
+
+  template <>
+  struct RadixKey<double> {
+    // IEEE 754 bit patterns of non-negative doubles are ordered like the values themselves
+    static uint64_t From(double weight) {
+      assert(weight >= 0);
+      uint64_t key;
+      std::memcpy(&key, &weight, sizeof(key));
+      return key;
+    }
+  };
+
+  // Monotone radix heap: popped keys never decrease, which holds for Dijkstra
+  // with non-negative weights. Decrease-key is done by pushing a duplicate entry.
+  template <typename Weight>
+  class RadixHeap {
+  public:
+    void Reset(size_t /* vertex_count */) {
+      Clear();
+    }
+
+    void Clear() {
+      for (auto& bucket : buckets_) {
+        bucket.clear();
+      }
+      last_key_ = 0;
+      size_ = 0;
+    }
+
+    bool IsEmpty() const {
+      return size_ == 0;
+    }
+
+    void PushOrDecrease(VertexId vertex, Weight weight) {
+      const uint64_t key = RadixKey<Weight>::From(weight);
+      assert(key >= last_key_);
+      buckets_[GetBucketIndex(key)].push_back({key, weight, vertex});
+      ++size_;
+    }
+
+    std::pair<Weight, VertexId> PopMin() {
+      if (buckets_[0].empty()) {
+        Redistribute();
+      }
+      const Item item = buckets_[0].back();
+      buckets_[0].pop_back();
+      --size_;
+      return {item.weight, item.vertex};
+    }
+
+  private:
+    struct Item {
+      uint64_t key;
+      Weight weight;
+      VertexId vertex;
+    };
+
+    static constexpr size_t BUCKET_COUNT = 65;
+
+    size_t GetBucketIndex(uint64_t key) const {
+      const uint64_t diff = key ^ last_key_;
+      return diff == 0 ? 0 : 64 - __builtin_clzll(diff);
+    }
+
+    void Redistribute() {
+      size_t bucket_idx = 1;
+      while (buckets_[bucket_idx].empty()) {
+        ++bucket_idx;
+      }
+      auto& bucket = buckets_[bucket_idx];
+      last_key_ = bucket.front().key;
+      for (const Item& item : bucket) {
+        last_key_ = std::min(last_key_, item.key);
+      }
+      for (const Item& item : bucket) {
+        buckets_[GetBucketIndex(item.key)].push_back(item);
+      }
+      bucket.clear();
+    }
+
+    std::array<std::vector<Item>, BUCKET_COUNT> buckets_;
+    uint64_t last_key_ = 0;
+    size_t size_ = 0;
+  };
+
+}
@@ -1,104 +1,345 @@
 #include "requests.h"
+#include "metrics.h"
 #include "transport_router.h"
+#include "utils.h"
 
+#include <algorithm>
+#include <ostream>
+#include <string_view>
 #include <vector>
 
 using namespace std;
 
 namespace Requests {
 
-  Json::Dict Stop::Process(const TransportCatalog& db) const {
+  // Response members go in key order, as Json::Print would output a Json::Dict
+
+  static void WriteError(int request_id, string_view message, Json::Writer& writer) {
+    writer.BeginObject()
+        .Key("error_message").String(message)
+        .Key("request_id").Int(request_id)
+        .EndObject();
+  }
+
+  static void WriteNotFound(int request_id, Json::Writer& writer) {
+    WriteError(request_id, "not found", writer);
+  }
+
+  void Stop::Process(const TransportCatalog& db, int request_id, Json::Writer& writer) const {
     const auto* stop = db.GetStop(name);
-    Json::Dict dict;
     if (!stop) {
-      dict["error_message"] = Json::Node("not found"s);
-    } else {
-      vector<Json::Node> bus_nodes;
-      bus_nodes.reserve(stop->bus_names.size());
-      for (const auto& bus_name : stop->bus_names) {
-        bus_nodes.emplace_back(bus_name);
-      }
-      dict["buses"] = Json::Node(move(bus_nodes));
+      WriteNotFound(request_id, writer);
+      return;
     }
-    return dict;
+    writer.BeginObject().Key("buses").BeginArray();
+    for (const NameId bus_id : stop->bus_ids) {
+      writer.String(db.GetBusName(bus_id));
+    }
+    writer.EndArray()
+        .Key("request_id").Int(request_id)
+        .EndObject();
   }
 
-  Json::Dict Bus::Process(const TransportCatalog& db) const {
+  void Bus::Process(const TransportCatalog& db, int request_id, Json::Writer& writer) const {
     const auto* bus = db.GetBus(name);
-    Json::Dict dict;
     if (!bus) {
-      dict["error_message"] = Json::Node("not found"s);
-    } else {
-      dict = {
-          {"stop_count", Json::Node(static_cast<int>(bus->stop_count))},
-          {"unique_stop_count", Json::Node(static_cast<int>(bus->unique_stop_count))},
-          {"route_length", Json::Node(bus->road_route_length)},
-          {"curvature", Json::Node(bus->road_route_length / bus->geo_route_length)},
-      };
+      WriteNotFound(request_id, writer);
+      return;
     }
-    return dict;
+    writer.BeginObject()
+        .Key("curvature").Double(bus->road_route_length / bus->geo_route_length)
+        .Key("request_id").Int(request_id)
+        .Key("route_length").Int(bus->road_route_length)
+        .Key("stop_count").Int(static_cast<int>(bus->stop_count))
+        .Key("unique_stop_count").Int(static_cast<int>(bus->unique_stop_count))
+        .EndObject();
   }
 
-  struct RouteItemResponseBuilder {
-    Json::Dict operator()(const TransportRouter::RouteInfo::BusItem& bus_item) const {
-      return Json::Dict{
-          {"type", Json::Node("Bus"s)},
-          {"bus", Json::Node(bus_item.bus_name)},
-          {"time", Json::Node(bus_item.time)},
-          {"span_count", Json::Node(static_cast<int>(bus_item.span_count))}
-      };
+  struct RouteItemResponseWriter {
+    const TransportCatalog& db;
+    Json::Writer& writer;
+
+    void operator()(const TransportRouter::RouteInfo::BusItem& bus_item) const {
+      writer.BeginObject()
+          .Key("bus").String(db.GetBusName(bus_item.bus_id))
+          .Key("span_count").Int(static_cast<int>(bus_item.span_count))
+          .Key("time").Double(bus_item.time)
+          .Key("type").String("Bus")
+          .EndObject();
     }
-    Json::Dict operator()(const TransportRouter::RouteInfo::WaitItem& wait_item) const {
-      return Json::Dict{
-          {"type", Json::Node("Wait"s)},
-          {"stop_name", Json::Node(wait_item.stop_name)},
-          {"time", Json::Node(wait_item.time)},
-      };
+    void operator()(const TransportRouter::RouteInfo::WaitItem& wait_item) const {
+      writer.BeginObject()
+          .Key("stop_name").String(db.GetStopName(wait_item.stop_id))
+          .Key("time").Double(wait_item.time)
+          .Key("type").String("Wait")
+          .EndObject();
     }
   };
 
-  Json::Dict Route::Process(const TransportCatalog& db) const {
-    Json::Dict dict;
+  void Route::Process(const TransportCatalog& db, int request_id, Json::Writer& writer) const {
     const auto route = db.FindRoute(stop_from, stop_to);
     if (!route) {
-      dict["error_message"] = Json::Node("not found"s);
-    } else {
-      dict["total_time"] = Json::Node(route->total_time);
-      vector<Json::Node> items;
-      items.reserve(route->items.size());
-      for (const auto& item : route->items) {
-        items.push_back(visit(RouteItemResponseBuilder{}, item));
+      WriteNotFound(request_id, writer);
+      return;
+    }
+    writer.BeginObject().Key("items").BeginArray();
+    for (const auto& item : route->items) {
+      visit(RouteItemResponseWriter{db, writer}, item);
+    }
+    writer.EndArray()
+        .Key("request_id").Int(request_id)
+        .Key("total_time").Double(route->total_time)
+        .EndObject();
+  }
+
+  void RouteMatrix::Process(const TransportCatalog& db, int request_id, Json::Writer& writer) const {
+    // Expanded pairs refer to the first occurrences of their stops
+    auto find_stop_idx = [](const vector<string>& stops, const string& stop) {
+      return static_cast<size_t>(find(begin(stops), end(stops), stop) - begin(stops));
+    };
+    vector<pair<size_t, size_t>> expanded_pairs;
+    expanded_pairs.reserve(routes.size());
+    for (const auto& [stop_from, stop_to] : routes) {
+      expanded_pairs.emplace_back(find_stop_idx(stops_from, stop_from), find_stop_idx(stops_to, stop_to));
+    }
+    auto is_known_stop = [&db](const string& stop) { return db.GetStop(stop) != nullptr; };
+    const bool are_pairs_known = all_of(begin(expanded_pairs), end(expanded_pairs), [this](const auto& pair) {
+      return pair.first < stops_from.size() && pair.second < stops_to.size();
+    });
+    if (!all_of(begin(stops_from), end(stops_from), is_known_stop)
+        || !all_of(begin(stops_to), end(stops_to), is_known_stop)
+        || !are_pairs_known) {
+      WriteNotFound(request_id, writer);
+      return;
+    }
+
+    const auto matrix = db.FindRouteMatrix(stops_from, stops_to, expanded_pairs);
+    writer.BeginObject()
+        .Key("request_id").Int(request_id)
+        .Key("routes").BeginArray();
+    for (size_t pair_idx = 0; pair_idx < routes.size(); ++pair_idx) {
+      const auto& route = matrix.routes[pair_idx];
+      writer.BeginObject();
+      if (!route) {
+        writer.Key("error_message").String("not found");
+      }
+      writer.Key("from").String(routes[pair_idx].first);
+      if (route) {
+        writer.Key("items").BeginArray();
+        for (const auto& item : route->items) {
+          visit(RouteItemResponseWriter{db, writer}, item);
+        }
+        writer.EndArray();
       }
+      writer.Key("to").String(routes[pair_idx].second);
+      if (route) {
+        writer.Key("total_time").Double(route->total_time);
+      }
+      writer.EndObject();
+    }
+    writer.EndArray()
+        .Key("total_times").BeginArray();
+    for (const auto& row : matrix.total_times) {
+      writer.BeginArray();
+      for (const auto& total_time : row) {
+        total_time ? writer.Double(*total_time) : writer.Null();
+      }
+      writer.EndArray();
+    }
+    writer.EndArray()
+        .EndObject();
+  }
 
-      dict["items"] = move(items);
+  void NearestStops::Process(const TransportCatalog& db, int request_id, Json::Writer& writer) const {
+    if (count < 0) {
+      WriteError(request_id, "bad request", writer);
+      return;
+    }
+    writer.BeginObject()
+        .Key("request_id").Int(request_id)
+        .Key("stops").BeginArray();
+    for (const auto& nearby_stop : db.FindNearestStops(point, static_cast<size_t>(count))) {
+      writer.BeginObject()
+          .Key("distance").Double(nearby_stop.distance)
+          .Key("name").String(db.GetStopName(nearby_stop.stop_id))
+          .EndObject();
     }
+    writer.EndArray()
+        .EndObject();
+  }
 
-    return dict;
+  void PointRoute::Process(const TransportCatalog& db, int request_id, Json::Writer& writer) const {
+    const auto nearest_stops_from = db.FindNearestStops(point_from, 1);
+    const auto nearest_stops_to = db.FindNearestStops(point_to, 1);
+    if (nearest_stops_from.empty() || nearest_stops_to.empty()) {
+      WriteNotFound(request_id, writer);
+      return;
+    }
+    const string& stop_from = db.GetStopName(nearest_stops_from.front().stop_id);
+    const string& stop_to = db.GetStopName(nearest_stops_to.front().stop_id);
+    const auto route = db.FindRoute(stop_from, stop_to);
+    if (!route) {
+      WriteNotFound(request_id, writer);
+      return;
+    }
+    writer.BeginObject().Key("items").BeginArray();
+    for (const auto& item : route->items) {
+      visit(RouteItemResponseWriter{db, writer}, item);
+    }
+    writer.EndArray()
+        .Key("request_id").Int(request_id)
+        .Key("stop_from").String(stop_from)
+        .Key("stop_to").String(stop_to)
+        .Key("total_time").Double(route->total_time)
+        .EndObject();
   }
 
-  variant<Stop, Bus, Route> Read(const Json::Dict& attrs) {
-    const string& type = attrs.at("type").AsString();
+  void TimetableRoute::Process(const TransportCatalog& db, int request_id, Json::Writer& writer) const {
+    if (!db.GetStop(stop_from) || !db.GetStop(stop_to)) {
+      WriteNotFound(request_id, writer);
+      return;
+    }
+    const auto route = db.FindTimetableRoute(stop_from, stop_to, departure_time);
+    if (!route) {
+      WriteNotFound(request_id, writer);
+      return;
+    }
+    writer.BeginObject()
+        .Key("arrival_time").Double(route->arrival_time)
+        .Key("items").BeginArray();
+    for (const auto& item : route->items) {
+      visit(RouteItemResponseWriter{db, writer}, item);
+    }
+    writer.EndArray()
+        .Key("request_id").Int(request_id)
+        .Key("total_time").Double(route->arrival_time - route->departure_time)
+        .EndObject();
+  }
+
+  template <typename NodeT>
+  static vector<string> ReadStrings(const NodeT& node) {
+    vector<string> strings;
+    for (const auto& item : node.AsArray()) {
+      strings.emplace_back(item.AsString());
+    }
+    return strings;
+  }
+
+  template <typename DictT>
+  static Sphere::Point ReadPoint(const DictT& attrs) {
+    return {attrs.at("latitude").AsDouble(), attrs.at("longitude").AsDouble()};
+  }
+
+  template <typename DictT>
+  static Request ReadRequest(const DictT& attrs) {
+    const auto type = attrs.at("type").AsString();
     if (type == "Bus") {
-      return Bus{attrs.at("name").AsString()};
+      return Bus{string(attrs.at("name").AsString())};
     } else if (type == "Stop") {
-      return Stop{attrs.at("name").AsString()};
+      return Stop{string(attrs.at("name").AsString())};
+    } else if (type == "RouteMatrix") {
+      RouteMatrix request{ReadStrings(attrs.at("from")), ReadStrings(attrs.at("to")), {}};
+      if (attrs.count("routes")) {
+        for (const auto& route : attrs.at("routes").AsArray()) {
+          const auto& route_attrs = route.AsMap();
+          request.routes.emplace_back(route_attrs.at("from").AsString(), route_attrs.at("to").AsString());
+        }
+      }
+      return request;
+    } else if (type == "NearestStops") {
+      return NearestStops{ReadPoint(attrs), attrs.at("count").AsInt()};
+    } else if (type == "PointRoute") {
+      return PointRoute{ReadPoint(attrs.at("from").AsMap()), ReadPoint(attrs.at("to").AsMap())};
+    } else if (type == "TimetableRoute") {
+      return TimetableRoute{
+          string(attrs.at("from").AsString()),
+          string(attrs.at("to").AsString()),
+          attrs.at("departure_time").AsDouble()
+      };
     } else {
-      return Route{attrs.at("from").AsString(), attrs.at("to").AsString()};
+      return Route{string(attrs.at("from").AsString()), string(attrs.at("to").AsString())};
     }
   }
 
-  vector<Json::Node> ProcessAll(const TransportCatalog& db, const vector<Json::Node>& requests) {
-    vector<Json::Node> responses;
-    responses.reserve(requests.size());
-    for (const Json::Node& request_node : requests) {
-      Json::Dict dict = visit([&db](const auto& request) {
-                                return request.Process(db);
-                              },
-                              Requests::Read(request_node.AsMap()));
-      dict["request_id"] = Json::Node(request_node.AsMap().at("id").AsInt());
-      responses.push_back(Json::Node(dict));
+  Request Read(const Json::Dict& attrs) {
+    return ReadRequest(attrs);
+  }
+
+  Request Read(const Json::ViewDict& attrs) {
+    return ReadRequest(attrs);
+  }
+
+  template <typename NodeT>
+  static void ProcessRequest(const TransportCatalog& db, const NodeT& request, Json::Writer& writer) {
+    const auto& attrs = request.AsMap();
+    const int request_id = attrs.at("id").AsInt();
+    auto process = [&] {
+      visit([&](const auto& request) {
+              request.Process(db, request_id, writer);
+            },
+            Requests::Read(attrs));
+    };
+    if (!Metrics::IsEnabled()) {
+      process();
+      return;
     }
-    return responses;
+    const auto start = Metrics::Clock::now();
+    process();
+    Metrics::AddRequestLatency(attrs.at("type").AsString(), Metrics::GetNanosecondsSince(start));
+  }
+
+  void Process(const TransportCatalog& db, const Json::Node& request, Json::Writer& writer) {
+    ProcessRequest(db, request, writer);
+  }
+
+  void Process(const TransportCatalog& db, const Json::ViewNode& request, Json::Writer& writer) {
+    ProcessRequest(db, request, writer);
+  }
+
+  template <typename NodeT, typename Allocator>
+  static void ProcessRequests(const TransportCatalog& db, const vector<NodeT, Allocator>& requests,
+                              ostream& output, size_t thread_count) {
+    const Metrics::ScopedTimer timer(Metrics::Phase::REQUESTS);
+    thread_count = min(thread_count, requests.size());
+    if (thread_count <= 1) {
+      string buffer;
+      Json::Writer writer(buffer);
+      writer.BeginArray();
+      for (const NodeT& request_node : requests) {
+        Process(db, request_node, writer);
+      }
+      writer.EndArray();
+      output << buffer;
+      return;
+    }
+
+    // Route requests vary a lot in cost, so workers take requests one by one
+    vector<string> responses(requests.size());
+    ParallelFor(requests.size(), thread_count, [&](size_t idx) {
+      Json::Writer writer(responses[idx]);
+      Process(db, requests[idx], writer);
+    });
+
+    output << '[';
+    bool first = true;
+    for (const string& response : responses) {
+      if (!first) {
+        output << ", ";
+      }
+      first = false;
+      output << response;
+    }
+    output << ']';
+  }
+
+  void ProcessAll(const TransportCatalog& db, const vector<Json::Node>& requests,
+                  ostream& output, size_t thread_count) {
+    ProcessRequests(db, requests, output, thread_count);
+  }
+
+  void ProcessAll(const TransportCatalog& db, const Json::ViewArray& requests,
+                  ostream& output, size_t thread_count) {
+    ProcessRequests(db, requests, output, thread_count);
   }
 
 }
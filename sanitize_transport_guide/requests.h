@@ -1,33 +1,86 @@
 #pragma once
 
 #include "json.h"
+#include "json_view.h"
+#include "json_writer.h"
+#include "sphere.h"
 #include "transport_catalog.h"
 
+#include <ostream>
 #include <string>
+#include <utility>
 #include <variant>
+#include <vector>
 
 
 namespace Requests {
   struct Stop {
     std::string name;
 
-    Json::Dict Process(const TransportCatalog& db) const;
+    void Process(const TransportCatalog& db, int request_id, Json::Writer& writer) const;
   };
 
   struct Bus {
     std::string name;
 
-    Json::Dict Process(const TransportCatalog& db) const;
+    void Process(const TransportCatalog& db, int request_id, Json::Writer& writer) const;
   };
 
   struct Route {
     std::string stop_from;
     std::string stop_to;
 
-    Json::Dict Process(const TransportCatalog& db) const;
+    void Process(const TransportCatalog& db, int request_id, Json::Writer& writer) const;
   };
 
-  std::variant<Stop, Bus, Route> Read(const Json::Dict& attrs);
+  // Travel times from every stop of from to every stop of to, null if there is no route,
+  // and full routes for the (from, to) pairs listed in routes only
+  struct RouteMatrix {
+    std::vector<std::string> stops_from;
+    std::vector<std::string> stops_to;
+    std::vector<std::pair<std::string, std::string>> routes;
 
-  std::vector<Json::Node> ProcessAll(const TransportCatalog& db, const std::vector<Json::Node>& requests);
+    void Process(const TransportCatalog& db, int request_id, Json::Writer& writer) const;
+  };
+
+  // Stops closest to a point, closest first; a negative count gets "bad request"
+  struct NearestStops {
+    Sphere::Point point;
+    int count;
+
+    void Process(const TransportCatalog& db, int request_id, Json::Writer& writer) const;
+  };
+
+  // Route between the stops closest to two points
+  struct PointRoute {
+    Sphere::Point point_from;
+    Sphere::Point point_to;
+
+    void Process(const TransportCatalog& db, int request_id, Json::Writer& writer) const;
+  };
+
+  // Earliest arrival by bus departures, leaving stop_from at departure_time minutes after midnight
+  struct TimetableRoute {
+    std::string stop_from;
+    std::string stop_to;
+    double departure_time;
+
+    void Process(const TransportCatalog& db, int request_id, Json::Writer& writer) const;
+  };
+
+  using Request = std::variant<Stop, Bus, Route, RouteMatrix, NearestStops, PointRoute, TimetableRoute>;
+
+  Request Read(const Json::Dict& attrs);
+  Request Read(const Json::ViewDict& attrs);
+
+  // Writes the response straight into writer
+  void Process(const TransportCatalog& db, const Json::Node& request, Json::Writer& writer);
+  void Process(const TransportCatalog& db, const Json::ViewNode& request, Json::Writer& writer);
+
+  // Writes the array of responses to output. Requests are spread over thread_count workers,
+  // responses keep the order of requests.
+  void ProcessAll(const TransportCatalog& db, const std::vector<Json::Node>& requests,
+                  std::ostream& output, size_t thread_count = 1);
+  void ProcessAll(const TransportCatalog& db, const Json::ViewArray& requests,
+                  std::ostream& output, size_t thread_count = 1);
 }
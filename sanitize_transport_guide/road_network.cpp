@@ -0,0 +1,109 @@
+#include "road_network.h"
+#include "utils.h"
+
+#include <algorithm>
+#include <stdexcept>
+#include <string>
+
+using namespace std;
+
+RoadDistances::RoadDistances(const Descriptions::StopsDict& stops_dict, const NameTable& stop_names)
+    : offsets_(stop_names.size() + 1)
+{
+  for (NameId stop_id = 0; stop_id < stop_names.size(); ++stop_id) {
+    const auto& stop = *stops_dict.at(stop_names.GetName(stop_id));
+    const auto first_neighbour = neighbours_.size();
+    for (const auto& [neighbour_name, distance] : stop.distances) {
+      // Distances to stops without a description can never be asked for
+      if (const auto neighbour_id = stop_names.Find(neighbour_name)) {
+        neighbours_.emplace_back(*neighbour_id, distance);
+      }
+    }
+    sort(begin(neighbours_) + first_neighbour, end(neighbours_));
+    offsets_[stop_id + 1] = neighbours_.size();
+  }
+}
+
+RoadDistances::RoadDistances(size_t stop_count, vector<Entry> entries)
+    : offsets_(stop_count + 1)
+{
+  stable_sort(begin(entries), end(entries), [](const Entry& lhs, const Entry& rhs) {
+    return pair(lhs.from, lhs.to) < pair(rhs.from, rhs.to);
+  });
+  neighbours_.reserve(entries.size());
+  for (size_t idx = 0; idx < entries.size(); ++idx) {
+    const auto& entry = entries[idx];
+    if (idx + 1 < entries.size() && entries[idx + 1].from == entry.from && entries[idx + 1].to == entry.to) {
+      continue;
+    }
+    neighbours_.emplace_back(entry.to, entry.distance);
+    ++offsets_.at(entry.from + 1);
+  }
+  for (size_t stop_id = 0; stop_id < stop_count; ++stop_id) {
+    offsets_[stop_id + 1] += offsets_[stop_id];
+  }
+}
+
+vector<RoadDistances::Entry> RoadDistances::GetEntries() const {
+  vector<Entry> entries;
+  entries.reserve(neighbours_.size());
+  for (NameId from = 0; from + 1 < offsets_.size(); ++from) {
+    for (size_t idx = offsets_[from]; idx < offsets_[from + 1]; ++idx) {
+      entries.push_back({from, neighbours_[idx].first, neighbours_[idx].second});
+    }
+  }
+  return entries;
+}
+
+const int* RoadDistances::Find(NameId from, NameId to) const {
+  const auto neighbours_begin = begin(neighbours_) + offsets_[from];
+  const auto neighbours_end = begin(neighbours_) + offsets_[from + 1];
+  const auto it = lower_bound(neighbours_begin, neighbours_end, to, [](const auto& neighbour, NameId id) {
+    return neighbour.first < id;
+  });
+  return it != neighbours_end && it->first == to ? &it->second : nullptr;
+}
+
+int RoadDistances::Get(NameId from, NameId to) const {
+  if (const int* distance = Find(from, to)) {
+    return *distance;
+  }
+  if (const int* distance = Find(to, from)) {
+    return *distance;
+  }
+  throw out_of_range("no road distance between stops " + to_string(from) + " and " + to_string(to));
+}
+
+BusRoute MakeBusRoute(NameId bus_id, vector<NameId> stop_ids, vector<int> departures,
+                      const RoadDistances& road_distances) {
+  sort(begin(departures), end(departures));
+  BusRoute bus_route{bus_id, move(stop_ids), {}, move(departures)};
+  bus_route.distances_from_start.reserve(bus_route.stop_ids.size());
+  for (size_t stop_idx = 0; stop_idx < bus_route.stop_ids.size(); ++stop_idx) {
+    bus_route.distances_from_start.push_back(
+        stop_idx == 0
+        ? 0
+        : bus_route.distances_from_start.back()
+          + road_distances.Get(bus_route.stop_ids[stop_idx - 1], bus_route.stop_ids[stop_idx])
+    );
+  }
+  return bus_route;
+}
+
+vector<BusRoute> MakeBusRoutes(const Descriptions::BusesDict& buses_dict,
+                               const NameTable& stop_names,
+                               const NameTable& bus_names,
+                               const RoadDistances& road_distances,
+                               size_t thread_count) {
+  vector<BusRoute> bus_routes(bus_names.size());
+  ParallelFor(bus_names.size(), thread_count, [&](size_t bus_id) {
+    const auto& bus = *buses_dict.at(bus_names.GetName(bus_id));
+    vector<NameId> stop_ids;
+    stop_ids.reserve(bus.stops.size());
+    for (const string& stop_name : bus.stops) {
+      stop_ids.push_back(stop_names.GetId(stop_name));
+    }
+    bus_routes[bus_id] = MakeBusRoute(bus_id, move(stop_ids), bus.departures, road_distances);
+  });
+  return bus_routes;
+}
@@ -0,0 +1,63 @@
+#pragma once
+
+#include "descriptions.h"
+#include "name_table.h"
+
+#include <utility>
+#include <vector>
+
+// Road distances between adjacent stops, indexed by stop id.
+// Neighbours of all stops are kept sorted by id in one flat array.
+class RoadDistances {
+public:
+  struct Entry {
+    NameId from;
+    NameId to;
+    int distance;
+  };
+
+  RoadDistances() = default;
+  RoadDistances(const Descriptions::StopsDict& stops_dict, const NameTable& stop_names);
+  // The last of entries given for the same stops wins
+  RoadDistances(size_t stop_count, std::vector<Entry> entries);
+
+  // Distance given for from -> to, or for to -> from if the former is not given.
+  // Throws std::out_of_range if neither is.
+  int Get(NameId from, NameId to) const;
+
+  // Sorted by stops
+  std::vector<Entry> GetEntries() const;
+
+private:
+  const int* Find(NameId from, NameId to) const;
+
+  std::vector<size_t> offsets_;  // neighbours of stop s are [offsets_[s], offsets_[s + 1])
+  std::vector<std::pair<NameId, int>> neighbours_;
+};
+
+// Stops of a bus resolved to ids, with prefix sums of road distances,
+// so the distance between any two stops of the bus is a subtraction
+struct BusRoute {
+  NameId bus_id;
+  std::vector<NameId> stop_ids;
+  std::vector<int> distances_from_start;  // for every stop of the bus
+  std::vector<int> departures;  // of trips from the first stop, sorted
+
+  int ComputeDistance(size_t from_idx, size_t to_idx) const {
+    return distances_from_start[to_idx] - distances_from_start[from_idx];
+  }
+  int GetLength() const {
+    return distances_from_start.empty() ? 0 : distances_from_start.back();
+  }
+};
+
+// Throws std::out_of_range if a road distance is missing
+BusRoute MakeBusRoute(NameId bus_id, std::vector<NameId> stop_ids, std::vector<int> departures,
+                      const RoadDistances& road_distances);
+
+// Routes of all buses, indexed by bus id, made on thread_count threads
+std::vector<BusRoute> MakeBusRoutes(const Descriptions::BusesDict& buses_dict,
+                                    const NameTable& stop_names,
+                                    const NameTable& bus_names,
+                                    const RoadDistances& road_distances,
+                                    size_t thread_count = 1);
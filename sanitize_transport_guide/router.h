@@ -1,118 +1,640 @@
 #pragma once
 
 #include "graph.h"
+#include "graph_search.h"
+#include "priority_queues.h"
+#include "snapshot.h"
 
 #include <algorithm>
 #include <cassert>
 #include <cstdint>
 #include <iterator>
+#include <limits>
 #include <optional>
-#include <set>
-#include <unordered_map>
+#include <stdexcept>
+#include <type_traits>
 #include <utility>
 #include <vector>
 
 namespace Graph {
 
-  template <typename Weight>
+  template <typename Weight, typename Queue = IndexedBinaryHeap<Weight>>
   class Router {
   private:
-    using Graph = DirectedWeightedGraph<Weight>;
+    using Graph = FrozenGraph<Weight>;
 
   public:
     Router(const Graph& graph);
 
-    using RouteId = uint64_t;
-
-    struct RouteInfo {
-      RouteId id;
-      Weight weight;
-      size_t edge_count;
-    };
+    using RouteInfo = ::Graph::RouteInfo<Weight>;
 
+    // Dijkstra stopping as soon as to is settled.
+    // Safe to call concurrently: every thread searches in its own scratch state
     std::optional<RouteInfo> BuildRoute(VertexId from, VertexId to) const;
-    EdgeId GetRouteEdge(RouteId route_id, size_t edge_idx) const;
-    void ReleaseRoute(RouteId route_id);
+
+    // One Dijkstra from `from` for all of targets, stopping once every target is settled.
+    // Route edges are collected only for targets with expand_edges set, weights for all of them.
+    // Every found route reports the vertices settled by the whole search.
+    std::vector<std::optional<RouteInfo>> BuildRoutes(VertexId from, const std::vector<VertexId>& targets,
+                                                      const std::vector<bool>& expand_edges) const;
+
+    // Bidirectional A*: searches from both ends over weights reduced by the average potential
+    // (lower_bound(v, to) - lower_bound(from, v)) / 2 and stops once no shorter route can be found.
+    // lower_bound(u, v) must not exceed the weight of any route from u to v and must satisfy
+    // the triangle inequality. Weight has to be a floating point type.
+    // The route weight is summed up along the route, the same way BuildRoute does.
+    template <typename LowerBound>
+    std::optional<RouteInfo> BuildRouteBidirectional(VertexId from, VertexId to, const LowerBound& lower_bound) const;
+
+    // Runs Dijkstra once from every vertex in sources and keeps shortest-path weights and
+    // predecessor edges in a flat table, so BuildRoute from these vertices becomes a table walk.
+    // Does nothing and returns false if the table would take more than memory_limit bytes.
+    bool PrecomputeRoutes(const std::vector<VertexId>& sources, size_t memory_limit);
+    bool HasPrecomputedRoutes() const;
+
+    // PrecomputeRoutes for a changed graph, repairing rows of previous, a router over the graph before the change.
+    // vertex_map and edge_map give ids in this graph of vertices and edges of the previous one,
+    // NO_VERTEX and NO_ROUTE for those gone; a mapped edge has to keep its weight. new_edges are edges of this graph
+    // that may make some route shorter; edges neither mapped to nor listed there must not be shorter than
+    // some previous edge between the same vertices. Routes of a row using gone edges and routes new edges shorten
+    // are searched anew, the rest of the row is kept. Sources without a previous row get a full Dijkstra.
+    bool PrecomputeRoutes(const std::vector<VertexId>& sources, size_t memory_limit,
+                            const Router& previous, const std::vector<VertexId>& vertex_map,
+                            const std::vector<EdgeId>& edge_map, const std::vector<EdgeId>& new_edges);
+
+    static constexpr VertexId NO_VERTEX = std::numeric_limits<VertexId>::max();
+
+    // Precomputed table only; the graph is saved separately
+    void SavePrecomputedRoutes(Snapshot::Writer& writer) const;
+    void LoadPrecomputedRoutes(Snapshot::Reader& reader);
 
   private:
+    static constexpr size_t NO_ROW = std::numeric_limits<size_t>::max();
+
+    using SearchState = ::Graph::SearchState<Weight, Queue>;
+
+    static SearchState& GetThreadSearchState();
+
+    struct BidirectionalSearchState {
+      SearchState forward;
+      SearchState backward;
+      // Potentials are computed once per query, valid if stamped with forward.generation
+      std::vector<Weight> potentials;
+      std::vector<uint32_t> potential_generations;
+    };
+
+    static BidirectionalSearchState& GetThreadBidirectionalSearchState();
+
+    // Runs until every reachable vertex is settled, or until target is
+    void ComputeRoutesFrom(VertexId from, SearchState& state, VertexId target = NO_VERTEX) const;
+    // Runs until every reachable vertex is settled, or until all of sorted_targets are
+    void ComputeRoutesFrom(VertexId from, SearchState& state, const std::vector<VertexId>& sorted_targets) const;
+    std::vector<EdgeId> ExpandRoute(const SearchState& state, VertexId to) const;
+    bool HasPrecomputedRoutesFrom(VertexId from) const;
+
+    struct PrecomputedRouteData;
+    enum class RouteTreeMark : uint8_t { UNKNOWN, KEPT, BROKEN };
+    // Routes of a row through broken_vertices are searched anew, as well as the ones new_edges shorten
+    void RepairRoutes(typename std::vector<PrecomputedRouteData>::iterator row_begin,
+                      const std::vector<VertexId>& broken_vertices, const std::vector<EdgeId>& new_edges,
+                      SearchState& state, std::vector<RouteTreeMark>& marks) const;
+    std::vector<EdgeId> ExpandRouteFromTable(size_t row, VertexId to) const;
+
     const Graph& graph_;
 
-    struct RouteInternalData {
+    struct PrecomputedRouteData {
       Weight weight;
-      std::optional<EdgeId> prev_edge;
+      EdgeId prev_edge;
     };
-    using RoutesInternalData = std::vector<std::optional<RouteInternalData>>;
-
-    using ExpandedRoute = std::vector<EdgeId>;
-    mutable RouteId next_route_id_ = 0;
-    mutable std::unordered_map<RouteId, ExpandedRoute> expanded_routes_cache_;
 
-    mutable RoutesInternalData routes_internal_data_;
+    // Row r holds routes from the r-th precomputed source to every vertex
+    std::vector<size_t> precomputed_rows_;
+    std::vector<PrecomputedRouteData> precomputed_routes_;
   };
 
 
-  template <typename Weight>
-  Router<Weight>::Router(const Graph& graph)
+  template <typename Weight, typename Queue>
+  Router<Weight, Queue>::Router(const Graph& graph)
       : graph_(graph)
   {
   }
 
-  template <typename Weight>
-  std::optional<typename Router<Weight>::RouteInfo> Router<Weight>::BuildRoute(VertexId from, VertexId to) const {
-    const size_t vertex_count = graph_.GetVertexCount();
-    routes_internal_data_.assign(vertex_count, std::nullopt);
-    routes_internal_data_[from] = RouteInternalData{.weight = 0};
-    std::set<std::pair<Weight, VertexId>> vertices_by_weight{{0, from}};
-    std::unordered_set<VertexId> done_vertices;
-
-    while (!vertices_by_weight.empty()) {
-      const auto min_vertex_it = vertices_by_weight.begin();
-      done_vertices.insert(min_vertex_it->second);
-
-      for (const EdgeId edge_id : graph_.GetIncidentEdges(min_vertex_it->second)) {
-        const auto& edge = graph_.GetEdge(edge_id);
-        if (done_vertices.count(edge.to)) {
+  template <typename Weight, typename Queue>
+  typename Router<Weight, Queue>::SearchState& Router<Weight, Queue>::GetThreadSearchState() {
+    // Shared by all routers of this type in the thread; Start() adapts it to the graph being searched
+    thread_local SearchState state;
+    return state;
+  }
+
+  template <typename Weight, typename Queue>
+  typename Router<Weight, Queue>::BidirectionalSearchState& Router<Weight, Queue>::GetThreadBidirectionalSearchState() {
+    thread_local BidirectionalSearchState state;
+    return state;
+  }
+
+  template <typename Weight, typename Queue>
+  void Router<Weight, Queue>::ComputeRoutesFrom(VertexId from, SearchState& state, VertexId target) const {
+    state.Start(graph_.GetVertexCount());
+    state.Reach(from, 0, ROUTE_START);
+
+    while (!state.queue.IsEmpty()) {
+      const VertexId vertex = state.PopMin();
+      if (state.IsSettled(vertex)) {
+        continue;
+      }
+      state.Settle(vertex);
+      if (vertex == target) {
+        break;
+      }
+      const Weight vertex_weight = state.weights[vertex];
+
+      for (const EdgeId edge_id : graph_.GetIncidentEdges(vertex)) {
+        const auto edge = graph_.GetEdge(edge_id);
+        if (state.IsSettled(edge.to)) {
+          continue;
+        }
+        const Weight weight = vertex_weight + edge.weight;
+        if (!state.IsReached(edge.to) || state.weights[edge.to] > weight) {
+          state.Reach(edge.to, weight, edge_id);
+        }
+      }
+    }
+  }
+
+  template <typename Weight, typename Queue>
+  void Router<Weight, Queue>::ComputeRoutesFrom(VertexId from, SearchState& state,
+                                                const std::vector<VertexId>& sorted_targets) const {
+    state.Start(graph_.GetVertexCount());
+    state.Reach(from, 0, ROUTE_START);
+
+    size_t target_count = sorted_targets.size();
+    while (!state.queue.IsEmpty() && target_count > 0) {
+      const VertexId vertex = state.PopMin();
+      if (state.IsSettled(vertex)) {
+        continue;
+      }
+      state.Settle(vertex);
+      if (std::binary_search(std::begin(sorted_targets), std::end(sorted_targets), vertex)) {
+        --target_count;
+      }
+      const Weight vertex_weight = state.weights[vertex];
+
+      for (const EdgeId edge_id : graph_.GetIncidentEdges(vertex)) {
+        const auto edge = graph_.GetEdge(edge_id);
+        if (state.IsSettled(edge.to)) {
           continue;
         }
-        if (!routes_internal_data_[edge.to] || routes_internal_data_[edge.to]->weight > min_vertex_it->first + edge.weight) {
-          if (routes_internal_data_[edge.to]) {
-            vertices_by_weight.erase({routes_internal_data_[edge.to]->weight, edge.to});
+        const Weight weight = vertex_weight + edge.weight;
+        if (!state.IsReached(edge.to) || state.weights[edge.to] > weight) {
+          state.Reach(edge.to, weight, edge_id);
+        }
+      }
+    }
+  }
+
+  template <typename Weight, typename Queue>
+  std::vector<EdgeId> Router<Weight, Queue>::ExpandRoute(const SearchState& state, VertexId to) const {
+    std::vector<EdgeId> edges;
+    for (EdgeId edge_id = state.prev_edges[to];
+         edge_id != ROUTE_START;
+         edge_id = state.prev_edges[graph_.GetEdge(edge_id).from]) {
+      edges.push_back(edge_id);
+    }
+    std::reverse(std::begin(edges), std::end(edges));
+    return edges;
+  }
+
+  template <typename Weight, typename Queue>
+  std::optional<typename Router<Weight, Queue>::RouteInfo>
+  Router<Weight, Queue>::BuildRoute(VertexId from, VertexId to) const {
+    if (HasPrecomputedRoutesFrom(from)) {
+      const size_t row = precomputed_rows_[from];
+      const auto& route_data = precomputed_routes_[row * graph_.GetVertexCount() + to];
+      if (route_data.prev_edge == NO_ROUTE) {
+        return std::nullopt;
+      }
+      return RouteInfo{route_data.weight, ExpandRouteFromTable(row, to), 0};
+    }
+
+    SearchState& state = GetThreadSearchState();
+    ComputeRoutesFrom(from, state, to);
+    RecordSearch(state);
+
+    if (!state.IsReached(to)) {
+      return std::nullopt;
+    }
+    return RouteInfo{state.weights[to], ExpandRoute(state, to), state.settled_vertices.size()};
+  }
+
+  template <typename Weight, typename Queue>
+  std::vector<std::optional<typename Router<Weight, Queue>::RouteInfo>>
+  Router<Weight, Queue>::BuildRoutes(VertexId from, const std::vector<VertexId>& targets,
+                                     const std::vector<bool>& expand_edges) const {
+    std::vector<std::optional<RouteInfo>> routes(targets.size());
+    if (HasPrecomputedRoutesFrom(from)) {
+      const size_t row = precomputed_rows_[from];
+      const auto row_begin = std::begin(precomputed_routes_) + row * graph_.GetVertexCount();
+      for (size_t target_idx = 0; target_idx < targets.size(); ++target_idx) {
+        const VertexId to = targets[target_idx];
+        if (row_begin[to].prev_edge != NO_ROUTE) {
+          routes[target_idx] = RouteInfo{row_begin[to].weight, {}, 0};
+          if (expand_edges[target_idx]) {
+            routes[target_idx]->edges = ExpandRouteFromTable(row, to);
           }
-          routes_internal_data_[edge.to] = RouteInternalData{.weight = min_vertex_it->first + edge.weight,
-                                                             .prev_edge = edge_id};
-          vertices_by_weight.emplace(routes_internal_data_[edge.to]->weight, edge.to);
         }
       }
-      vertices_by_weight.erase(min_vertex_it);
+      return routes;
+    }
+
+    std::vector<VertexId> sorted_targets = targets;
+    std::sort(std::begin(sorted_targets), std::end(sorted_targets));
+    sorted_targets.erase(std::unique(std::begin(sorted_targets), std::end(sorted_targets)), std::end(sorted_targets));
+    SearchState& state = GetThreadSearchState();
+    ComputeRoutesFrom(from, state, sorted_targets);
+    RecordSearch(state);
+
+    for (size_t target_idx = 0; target_idx < targets.size(); ++target_idx) {
+      const VertexId to = targets[target_idx];
+      if (state.IsReached(to)) {
+        routes[target_idx] = RouteInfo{state.weights[to], {}, state.settled_vertices.size()};
+        if (expand_edges[target_idx]) {
+          routes[target_idx]->edges = ExpandRoute(state, to);
+        }
+      }
     }
+    return routes;
+  }
 
-    const auto& route_internal_data = routes_internal_data_[to];
-    if (!route_internal_data) {
+  template <typename Weight, typename Queue>
+  template <typename LowerBound>
+  std::optional<typename Router<Weight, Queue>::RouteInfo>
+  Router<Weight, Queue>::BuildRouteBidirectional(VertexId from, VertexId to, const LowerBound& lower_bound) const {
+    static_assert(std::is_floating_point_v<Weight>);
+    if (from == to || HasPrecomputedRoutesFrom(from)) {
+      return BuildRoute(from, to);
+    }
+
+    const size_t vertex_count = graph_.GetVertexCount();
+    BidirectionalSearchState& search = GetThreadBidirectionalSearchState();
+    SearchState& forward = search.forward;
+    SearchState& backward = search.backward;
+    forward.Start(vertex_count);
+    backward.Start(vertex_count);
+    if (search.potentials.size() != vertex_count || forward.generation == 1) {
+      search.potentials.resize(vertex_count);
+      search.potential_generations.assign(vertex_count, 0);
+    }
+
+    auto potential = [&](VertexId vertex) {
+      if (search.potential_generations[vertex] != forward.generation) {
+        search.potentials[vertex] = (lower_bound(vertex, to) - lower_bound(from, vertex)) / 2;
+        search.potential_generations[vertex] = forward.generation;
+      }
+      return search.potentials[vertex];
+    };
+    // Non-negative for consistent lower bounds, up to rounding errors
+    auto reduced_weight = [&](const Edge<Weight>& edge) {
+      return std::max<Weight>(0, edge.weight - potential(edge.from) + potential(edge.to));
+    };
+
+    // Both sides search the same graph with reduced weights, so route weights add up
+    std::optional<Weight> best_weight;
+    EdgeId meeting_edge = NO_ROUTE;
+    auto try_meet = [&](EdgeId edge_id, Weight forward_weight, VertexId backward_vertex) {
+      if (!backward.IsReached(backward_vertex)) {
+        return;
+      }
+      const Weight weight = forward_weight + backward.weights[backward_vertex];
+      if (!best_weight || weight < *best_weight) {
+        best_weight = weight;
+        meeting_edge = edge_id;
+      }
+    };
+
+    forward.Reach(from, 0, ROUTE_START);
+    backward.Reach(to, 0, ROUTE_START);
+    // Weights of the last settled vertices never exceed those of unsettled ones
+    Weight forward_settled_weight = 0;
+    Weight backward_settled_weight = 0;
+    bool is_forward_turn = true;
+    while (!forward.queue.IsEmpty() && !backward.queue.IsEmpty()) {
+      SearchState& state = is_forward_turn ? forward : backward;
+      const VertexId vertex = state.PopMin();
+      if (state.IsSettled(vertex)) {
+        continue;
+      }
+      state.Settle(vertex);
+      const Weight vertex_weight = state.weights[vertex];
+      (is_forward_turn ? forward_settled_weight : backward_settled_weight) = vertex_weight;
+      if (best_weight && forward_settled_weight + backward_settled_weight >= *best_weight) {
+        break;
+      }
+
+      if (is_forward_turn) {
+        for (const EdgeId edge_id : graph_.GetIncidentEdges(vertex)) {
+          const auto edge = graph_.GetEdge(edge_id);
+          if (forward.IsSettled(edge.to)) {
+            continue;
+          }
+          const Weight weight = vertex_weight + reduced_weight(edge);
+          if (!forward.IsReached(edge.to) || forward.weights[edge.to] > weight) {
+            forward.Reach(edge.to, weight, edge_id);
+          }
+          try_meet(edge_id, weight, edge.to);
+        }
+      } else {
+        for (const EdgeId edge_id : graph_.GetIncomingEdges(vertex)) {
+          const auto edge = graph_.GetEdge(edge_id);
+          if (backward.IsSettled(edge.from)) {
+            continue;
+          }
+          const Weight weight = vertex_weight + reduced_weight(edge);
+          if (!backward.IsReached(edge.from) || backward.weights[edge.from] > weight) {
+            backward.Reach(edge.from, weight, edge_id);
+          }
+          if (forward.IsReached(edge.from)) {
+            try_meet(edge_id, forward.weights[edge.from] + reduced_weight(edge), vertex);
+          }
+        }
+      }
+      is_forward_turn = !is_forward_turn;
+    }
+    RecordSearch(forward, backward);
+
+    if (!best_weight) {
       return std::nullopt;
     }
-    const Weight weight = route_internal_data->weight;
+
     std::vector<EdgeId> edges;
-    for (std::optional<EdgeId> edge_id = route_internal_data->prev_edge;
-         edge_id;
-         edge_id = routes_internal_data_[graph_.GetEdge(*edge_id).from]->prev_edge) {
-      edges.push_back(*edge_id);
+    for (EdgeId edge_id = forward.prev_edges[graph_.GetEdge(meeting_edge).from];
+         edge_id != ROUTE_START;
+         edge_id = forward.prev_edges[graph_.GetEdge(edge_id).from]) {
+      edges.push_back(edge_id);
     }
     std::reverse(std::begin(edges), std::end(edges));
+    edges.push_back(meeting_edge);
+    for (EdgeId edge_id = backward.prev_edges[graph_.GetEdge(meeting_edge).to];
+         edge_id != ROUTE_START;
+         edge_id = backward.prev_edges[graph_.GetEdge(edge_id).to]) {
+      edges.push_back(edge_id);
+    }
 
-    const RouteId route_id = next_route_id_++;
-    const size_t route_edge_count = edges.size();
-    expanded_routes_cache_[route_id] = std::move(edges);
-    return RouteInfo{route_id, weight, route_edge_count};
+    Weight weight = 0;
+    for (const EdgeId edge_id : edges) {
+      weight += graph_.GetEdge(edge_id).weight;
+    }
+    return RouteInfo{weight, std::move(edges), forward.settled_vertices.size() + backward.settled_vertices.size()};
   }
 
-  template <typename Weight>
-  EdgeId Router<Weight>::GetRouteEdge(RouteId route_id, size_t edge_idx) const {
-    return expanded_routes_cache_.at(route_id)[edge_idx];
+  template <typename Weight, typename Queue>
+  std::vector<EdgeId> Router<Weight, Queue>::ExpandRouteFromTable(size_t row, VertexId to) const {
+    const auto row_begin = std::begin(precomputed_routes_) + row * graph_.GetVertexCount();
+    std::vector<EdgeId> edges;
+    for (EdgeId edge_id = row_begin[to].prev_edge;
+         edge_id != ROUTE_START;
+         edge_id = row_begin[graph_.GetEdge(edge_id).from].prev_edge) {
+      edges.push_back(edge_id);
+    }
+    std::reverse(std::begin(edges), std::end(edges));
+    return edges;
+  }
+
+  template <typename Weight, typename Queue>
+  bool Router<Weight, Queue>::PrecomputeRoutes(const std::vector<VertexId>& sources, size_t memory_limit) {
+    const size_t vertex_count = graph_.GetVertexCount();
+    const size_t row_size = vertex_count * sizeof(PrecomputedRouteData);
+    if (sources.empty() || row_size == 0 || sources.size() > memory_limit / row_size) {
+      return false;
+    }
+
+    precomputed_rows_.assign(vertex_count, NO_ROW);
+    precomputed_routes_.assign(sources.size() * vertex_count, PrecomputedRouteData{0, NO_ROUTE});
+    SearchState& state = GetThreadSearchState();
+    for (size_t row = 0; row < sources.size(); ++row) {
+      const VertexId from = sources[row];
+      ComputeRoutesFrom(from, state);
+      const auto row_begin = std::begin(precomputed_routes_) + row * vertex_count;
+      for (const VertexId vertex : state.settled_vertices) {
+        row_begin[vertex] = {state.weights[vertex], state.prev_edges[vertex]};
+      }
+      precomputed_rows_[from] = row;
+    }
+    return true;
   }
 
-  template <typename Weight>
-  void Router<Weight>::ReleaseRoute(RouteId route_id) {
-    expanded_routes_cache_.erase(route_id);
+  template <typename Weight, typename Queue>
+  bool Router<Weight, Queue>::PrecomputeRoutes(const std::vector<VertexId>& sources, size_t memory_limit,
+                                               const Router& previous, const std::vector<VertexId>& vertex_map,
+                                               const std::vector<EdgeId>& edge_map,
+                                               const std::vector<EdgeId>& new_edges) {
+    const size_t vertex_count = graph_.GetVertexCount();
+    const size_t row_size = vertex_count * sizeof(PrecomputedRouteData);
+    if (sources.empty() || row_size == 0 || sources.size() > memory_limit / row_size) {
+      return false;
+    }
+
+    std::vector<VertexId> previous_vertices(vertex_count, NO_VERTEX);
+    for (VertexId vertex = 0; vertex < vertex_map.size(); ++vertex) {
+      if (vertex_map[vertex] != NO_VERTEX) {
+        previous_vertices[vertex_map[vertex]] = vertex;
+      }
+    }
+
+    precomputed_rows_.assign(vertex_count, NO_ROW);
+    precomputed_routes_.assign(sources.size() * vertex_count, PrecomputedRouteData{0, NO_ROUTE});
+    const size_t previous_vertex_count = previous.graph_.GetVertexCount();
+    SearchState& state = GetThreadSearchState();
+    std::vector<VertexId> broken_vertices;
+    std::vector<RouteTreeMark> marks;
+    for (size_t row = 0; row < sources.size(); ++row) {
+      const VertexId from = sources[row];
+      const VertexId previous_from = previous_vertices[from];
+      const auto row_begin = std::begin(precomputed_routes_) + row * vertex_count;
+      precomputed_rows_[from] = row;
+
+      if (previous_from == NO_VERTEX || !previous.HasPrecomputedRoutesFrom(previous_from)) {
+        ComputeRoutesFrom(from, state);
+        for (const VertexId vertex : state.settled_vertices) {
+          row_begin[vertex] = {state.weights[vertex], state.prev_edges[vertex]};
+        }
+        continue;
+      }
+
+      // Routes of the previous row whose last edge is gone are broken
+      const auto previous_row_begin = std::begin(previous.precomputed_routes_)
+          + previous.precomputed_rows_[previous_from] * previous_vertex_count;
+      broken_vertices.clear();
+      for (VertexId vertex = 0; vertex < previous_vertex_count; ++vertex) {
+        const auto& route_data = previous_row_begin[vertex];
+        if (route_data.prev_edge == NO_ROUTE || vertex_map[vertex] == NO_VERTEX) {
+          continue;
+        }
+        const EdgeId prev_edge = route_data.prev_edge == ROUTE_START ? ROUTE_START : edge_map[route_data.prev_edge];
+        row_begin[vertex_map[vertex]] = {route_data.weight, prev_edge};
+        if (prev_edge == NO_ROUTE) {
+          broken_vertices.push_back(vertex_map[vertex]);
+        }
+      }
+      RepairRoutes(row_begin, broken_vertices, new_edges, state, marks);
+    }
+    return true;
+  }
+
+  template <typename Weight, typename Queue>
+  void Router<Weight, Queue>::RepairRoutes(typename std::vector<PrecomputedRouteData>::iterator row_begin,
+                                           const std::vector<VertexId>& broken_vertices,
+                                           const std::vector<EdgeId>& new_edges,
+                                           SearchState& state, std::vector<RouteTreeMark>& marks) const {
+    const size_t vertex_count = graph_.GetVertexCount();
+    marks.assign(vertex_count, RouteTreeMark::UNKNOWN);
+    for (const VertexId vertex : broken_vertices) {
+      marks[vertex] = RouteTreeMark::BROKEN;
+    }
+    // Routes going through a broken vertex are broken too
+    std::vector<VertexId> path;
+    for (VertexId vertex = 0; vertex < vertex_count; ++vertex) {
+      VertexId path_vertex = vertex;
+      while (marks[path_vertex] == RouteTreeMark::UNKNOWN && row_begin[path_vertex].prev_edge != NO_ROUTE
+             && row_begin[path_vertex].prev_edge != ROUTE_START) {
+        path.push_back(path_vertex);
+        path_vertex = graph_.GetEdge(row_begin[path_vertex].prev_edge).from;
+      }
+      const RouteTreeMark mark = marks[path_vertex] == RouteTreeMark::BROKEN
+          ? RouteTreeMark::BROKEN : RouteTreeMark::KEPT;
+      marks[path_vertex] = mark;
+      for (const VertexId vertex_on_path : path) {
+        marks[vertex_on_path] = mark;
+      }
+      path.clear();
+    }
+
+    // Dijkstra from vertices whose routes can be made shorter than the ones kept: broken ones
+    // reached over some kept route and ends of new edges. Weights of kept routes bound the search.
+    state.Start(vertex_count);
+    auto improve = [&](VertexId vertex, Weight weight, EdgeId edge_id) {
+      if ((row_begin[vertex].prev_edge == NO_ROUTE || weight < row_begin[vertex].weight)
+          && (!state.IsReached(vertex) || weight < state.weights[vertex])) {
+        state.Reach(vertex, weight, edge_id);
+      }
+    };
+    for (VertexId vertex = 0; vertex < vertex_count; ++vertex) {
+      if (marks[vertex] == RouteTreeMark::BROKEN) {
+        row_begin[vertex] = {0, NO_ROUTE};
+      }
+    }
+    for (VertexId vertex = 0; vertex < vertex_count; ++vertex) {
+      if (marks[vertex] != RouteTreeMark::BROKEN) {
+        continue;
+      }
+      for (const EdgeId edge_id : graph_.GetIncomingEdges(vertex)) {
+        const auto edge = graph_.GetEdge(edge_id);
+        if (marks[edge.from] == RouteTreeMark::KEPT && row_begin[edge.from].prev_edge != NO_ROUTE) {
+          improve(vertex, row_begin[edge.from].weight + edge.weight, edge_id);
+        }
+      }
+    }
+    for (const EdgeId edge_id : new_edges) {
+      const auto edge = graph_.GetEdge(edge_id);
+      if (row_begin[edge.from].prev_edge != NO_ROUTE) {
+        improve(edge.to, row_begin[edge.from].weight + edge.weight, edge_id);
+      }
+    }
+
+    while (!state.queue.IsEmpty()) {
+      const VertexId vertex = state.PopMin();
+      if (state.IsSettled(vertex)) {
+        continue;
+      }
+      state.Settle(vertex);
+      const Weight vertex_weight = state.weights[vertex];
+      row_begin[vertex] = {vertex_weight, state.prev_edges[vertex]};
+      for (const EdgeId edge_id : graph_.GetIncidentEdges(vertex)) {
+        const auto edge = graph_.GetEdge(edge_id);
+        if (!state.IsSettled(edge.to)) {
+          improve(edge.to, vertex_weight + edge.weight, edge_id);
+        }
+      }
+    }
+  }
+
+  template <typename Weight, typename Queue>
+  bool Router<Weight, Queue>::HasPrecomputedRoutes() const {
+    return !precomputed_routes_.empty();
+  }
+
+  template <typename Weight, typename Queue>
+  bool Router<Weight, Queue>::HasPrecomputedRoutesFrom(VertexId from) const {
+    return from < precomputed_rows_.size() && precomputed_rows_[from] != NO_ROW;
+  }
+
+  template <typename Weight, typename Queue>
+  void Router<Weight, Queue>::SavePrecomputedRoutes(Snapshot::Writer& writer) const {
+    writer.WriteVector(precomputed_rows_);
+    writer.WriteVector(precomputed_routes_);
+  }
+
+  template <typename Weight, typename Queue>
+  void Router<Weight, Queue>::LoadPrecomputedRoutes(Snapshot::Reader& reader) {
+    precomputed_rows_ = reader.ReadVector<size_t>();
+    precomputed_routes_ = reader.ReadVector<PrecomputedRouteData>();
+    const size_t vertex_count = graph_.GetVertexCount();
+    if (!precomputed_rows_.empty() && precomputed_rows_.size() != vertex_count) {
+      throw std::runtime_error("inconsistent precomputed routes in snapshot");
+    }
+    if (vertex_count == 0 ? !precomputed_routes_.empty() : precomputed_routes_.size() % vertex_count != 0) {
+      throw std::runtime_error("inconsistent precomputed routes in snapshot");
+    }
+    const size_t row_count = vertex_count == 0 ? 0 : precomputed_routes_.size() / vertex_count;
+    std::vector<VertexId> row_sources(row_count, NO_VERTEX);
+    for (VertexId vertex = 0; vertex < precomputed_rows_.size(); ++vertex) {
+      const size_t row = precomputed_rows_[vertex];
+      if (row == NO_ROW) {
+        continue;
+      }
+      if (row >= row_count || row_sources[row] != NO_VERTEX) {
+        throw std::runtime_error("inconsistent precomputed routes in snapshot");
+      }
+      row_sources[row] = vertex;
+    }
+
+    // Every route has to go back along edges into its vertices to the source of its row,
+    // as ExpandRouteFromTable follows it without checks
+    enum class Mark : uint8_t { UNKNOWN, ON_PATH, VALID };
+    std::vector<Mark> marks(vertex_count);
+    std::vector<VertexId> path;
+    for (size_t row = 0; row < row_count; ++row) {
+      const auto row_begin = std::begin(precomputed_routes_) + row * vertex_count;
+      std::fill(std::begin(marks), std::end(marks), Mark::UNKNOWN);
+      for (VertexId vertex = 0; vertex < vertex_count; ++vertex) {
+        if (row_begin[vertex].prev_edge == NO_ROUTE) {
+          continue;
+        }
+        VertexId route_vertex = vertex;
+        while (marks[route_vertex] == Mark::UNKNOWN) {
+          marks[route_vertex] = Mark::ON_PATH;
+          path.push_back(route_vertex);
+          const EdgeId prev_edge = row_begin[route_vertex].prev_edge;
+          if (prev_edge == ROUTE_START) {
+            if (route_vertex != row_sources[row]) {
+              throw std::runtime_error("inconsistent precomputed routes in snapshot");
+            }
+            break;
+          }
+          if (prev_edge == NO_ROUTE || prev_edge >= graph_.GetEdgeCount()
+              || graph_.GetEdge(prev_edge).to != route_vertex) {
+            throw std::runtime_error("inconsistent precomputed routes in snapshot");
+          }
+          route_vertex = graph_.GetEdge(prev_edge).from;
+        }
+        if (marks[route_vertex] == Mark::ON_PATH && row_begin[route_vertex].prev_edge != ROUTE_START) {
+          throw std::runtime_error("inconsistent precomputed routes in snapshot");  // a cycle
+        }
+        for (const VertexId path_vertex : path) {
+          marks[path_vertex] = Mark::VALID;
+        }
+        path.clear();
+      }
+    }
   }
 
 }
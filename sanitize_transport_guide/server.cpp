@@ -0,0 +1,387 @@
+#include "server.h"
+#include "json_view.h"
+#include "json_writer.h"
+#include "requests.h"
+#include "utils.h"
+
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstring>
+#include <limits>
+#include <memory_resource>
+#include <stdexcept>
+#include <system_error>
+#include <utility>
+
+using namespace std;
+
+namespace {
+  // epoll tokens of the listening socket and of the event fd; connections use their ids
+  constexpr uint64_t LISTEN_TOKEN = numeric_limits<uint64_t>::max();
+  constexpr uint64_t EVENT_TOKEN = LISTEN_TOKEN - 1;
+
+  [[noreturn]] void ThrowSystemError(const string& what) {
+    throw system_error(errno, generic_category(), what);
+  }
+
+  string MakeBadRequestResponse() {
+    string response;
+    Json::Writer writer(response);
+    writer.BeginObject()
+        .Key("error_message").String("bad request")
+        .EndObject();
+    response += '\n';
+    return response;
+  }
+
+  void AddToEpoll(int epoll_fd, int fd, uint32_t events, uint64_t token) {
+    epoll_event event{};
+    event.events = events;
+    event.data.u64 = token;
+    if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &event) != 0) {
+      ThrowSystemError("epoll_ctl");
+    }
+  }
+}
+
+Server::Server(const TransportCatalog& db, string socket_path, size_t thread_count)
+    : db_(db),
+      socket_path_(move(socket_path))
+{
+  sockaddr_un address{};
+  address.sun_family = AF_UNIX;
+  if (socket_path_.size() >= sizeof(address.sun_path)) {
+    throw invalid_argument("socket path is too long: " + socket_path_);
+  }
+  strcpy(address.sun_path, socket_path_.c_str());
+
+  // Members are closed by the destructor, which does not run if the constructor throws
+  try {
+    listen_fd_ = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (listen_fd_ < 0) {
+      ThrowSystemError("socket");
+    }
+    unlink(socket_path_.c_str());
+    if (bind(listen_fd_, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) != 0) {
+      ThrowSystemError("bind " + socket_path_);
+    }
+    if (listen(listen_fd_, SOMAXCONN) != 0) {
+      ThrowSystemError("listen " + socket_path_);
+    }
+    epoll_fd_ = epoll_create1(EPOLL_CLOEXEC);
+    if (epoll_fd_ < 0) {
+      ThrowSystemError("epoll_create1");
+    }
+    event_fd_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (event_fd_ < 0) {
+      ThrowSystemError("eventfd");
+    }
+    AddToEpoll(epoll_fd_, listen_fd_, EPOLLIN, LISTEN_TOKEN);
+    AddToEpoll(epoll_fd_, event_fd_, EPOLLIN, EVENT_TOKEN);
+  } catch (...) {
+    for (const int fd : {listen_fd_, epoll_fd_, event_fd_}) {
+      if (fd >= 0) {
+        close(fd);
+      }
+    }
+    throw;
+  }
+  StartWorkers(max<size_t>(1, thread_count));
+}
+
+Server::~Server() {
+  StopWorkers();
+  for (const auto& [connection_id, connection] : connections_) {
+    close(connection.fd);
+  }
+  close(event_fd_);
+  close(epoll_fd_);
+  close(listen_fd_);
+  unlink(socket_path_.c_str());
+}
+
+void Server::Stop() {
+  is_stop_requested_ = true;
+  const uint64_t one = 1;
+  [[maybe_unused]] const auto written = write(event_fd_, &one, sizeof(one));
+}
+
+void Server::Run() {
+  epoll_event events[64];
+  while (!is_stop_requested_) {
+    const int event_count = epoll_wait(epoll_fd_, events, size(events), -1);
+    if (event_count < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      ThrowSystemError("epoll_wait");
+    }
+    for (int event_idx = 0; event_idx < event_count; ++event_idx) {
+      const uint64_t token = events[event_idx].data.u64;
+      if (token == LISTEN_TOKEN) {
+        AcceptConnections();
+      } else if (token == EVENT_TOKEN) {
+        uint64_t count;
+        [[maybe_unused]] const auto read_size = read(event_fd_, &count, sizeof(count));
+        TakeResponses();
+      } else if (const auto it = connections_.find(token); it != connections_.end()) {
+        Connection& connection = it->second;
+        if (events[event_idx].events & (EPOLLIN | EPOLLHUP | EPOLLERR)) {
+          ReadRequests(token, connection);
+        }
+        // Reading may have closed the connection
+        if (connections_.count(token)) {
+          WriteResponses(connection);
+          UpdateConnection(token, connection);
+        }
+      }
+    }
+  }
+}
+
+void Server::AcceptConnections() {
+  while (true) {
+    const int fd = accept4(listen_fd_, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+    if (fd < 0) {
+      if (errno == EAGAIN || errno == EWOULDBLOCK || errno == ECONNABORTED || errno == EINTR) {
+        return;
+      }
+      ThrowSystemError("accept");
+    }
+    const uint64_t connection_id = next_connection_id_++;
+    Connection& connection = connections_[connection_id];
+    connection.fd = fd;
+    connection.events = EPOLLIN;
+    AddToEpoll(epoll_fd_, fd, connection.events, connection_id);
+  }
+}
+
+void Server::ReadRequests(uint64_t connection_id, Connection& connection) {
+  char buffer[64 * 1024];
+  while (!connection.is_input_closed && HasRoomForRequests(connection)) {
+    const ssize_t read_size = read(connection.fd, buffer, sizeof(buffer));
+    if (read_size < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      if (errno == EAGAIN || errno == EWOULDBLOCK) {
+        break;
+      }
+      CloseConnection(connection_id);
+      return;
+    }
+    if (read_size == 0) {
+      connection.is_input_closed = true;
+    } else {
+      connection.input.append(buffer, read_size);
+    }
+    SubmitRequests(connection_id, connection);
+  }
+}
+
+void Server::SubmitRequests(uint64_t connection_id, Connection& connection) {
+  size_t line_begin = 0;
+  while (line_begin < connection.input.size() && HasRoomForRequests(connection)) {
+    size_t line_end = connection.input.find('\n', line_begin);
+    if (connection.is_dropping_line) {
+      line_begin = line_end == string::npos ? connection.input.size() : line_end + 1;
+      connection.is_dropping_line = line_end == string::npos;
+      continue;
+    }
+    if (line_end == string::npos && connection.input.size() - line_begin > MAX_REQUEST_SIZE) {
+      AddResponse(connection, connection.next_request_idx++, MakeBadRequestResponse());
+      line_begin = connection.input.size();
+      connection.is_dropping_line = true;
+      continue;
+    }
+    if (line_end == string::npos) {
+      if (!connection.is_input_closed) {
+        break;
+      }
+      // The last request may go without a newline
+      line_end = connection.input.size();
+    }
+    string request = connection.input.substr(line_begin, line_end - line_begin);
+    line_begin = min(line_end + 1, connection.input.size());
+    if (Strip(request).empty()) {
+      continue;
+    }
+    const uint64_t request_idx = connection.next_request_idx++;
+    {
+      lock_guard guard(tasks_mutex_);
+      tasks_.push_back([this, connection_id, request_idx, request = move(request)] {
+        Response response{connection_id, request_idx, Answer(request)};
+        {
+          lock_guard guard(responses_mutex_);
+          responses_.push_back(move(response));
+        }
+        const uint64_t one = 1;
+        [[maybe_unused]] const auto written = write(event_fd_, &one, sizeof(one));
+      });
+    }
+    tasks_cv_.notify_one();
+  }
+  connection.input.erase(0, line_begin);
+}
+
+bool Server::HasRoomForRequests(const Connection& connection) {
+  return connection.next_request_idx - connection.next_response_idx < MAX_PIPELINED_REQUESTS;
+}
+
+string Server::Answer(const string& request) const {
+  string response;
+  try {
+    // Nodes of a request are few, so they usually fit on the stack
+    char node_buffer[16 * 1024];
+    pmr::monotonic_buffer_resource node_resource(node_buffer, sizeof(node_buffer));
+    Json::Writer writer(response);
+    Requests::Process(db_, Json::LoadView(request, &node_resource), writer);
+  } catch (const exception&) {
+    return MakeBadRequestResponse();
+  }
+  response += '\n';
+  return response;
+}
+
+void Server::TakeResponses() {
+  vector<Response> responses;
+  {
+    lock_guard guard(responses_mutex_);
+    swap(responses, responses_);
+  }
+  for (auto& response : responses) {
+    const auto it = connections_.find(response.connection_id);
+    if (it == connections_.end()) {
+      continue;  // closed meanwhile
+    }
+    AddResponse(it->second, response.request_idx, move(response.text));
+  }
+  // Connections are written to once per batch of responses
+  for (auto it = connections_.begin(); it != connections_.end();) {
+    const uint64_t connection_id = (it++)->first;
+    Connection& connection = connections_.at(connection_id);
+    // Requests read while the connection had too many of them unanswered
+    if (!connection.input.empty()) {
+      SubmitRequests(connection_id, connection);
+    }
+    if (!connection.output.empty()) {
+      WriteResponses(connection);
+    }
+    UpdateConnection(connection_id, connection);
+  }
+}
+
+void Server::AddResponse(Connection& connection, uint64_t request_idx, string text) {
+  connection.early_responses.emplace(request_idx, move(text));
+  for (auto it = connection.early_responses.begin();
+       it != connection.early_responses.end() && it->first == connection.next_response_idx;
+       it = connection.early_responses.erase(it)) {
+    connection.output += it->second;
+    ++connection.next_response_idx;
+  }
+}
+
+void Server::WriteResponses(Connection& connection) {
+  size_t written_size = 0;
+  while (written_size < connection.output.size()) {
+    const ssize_t size = send(connection.fd, connection.output.data() + written_size,
+                              connection.output.size() - written_size, MSG_NOSIGNAL);
+    if (size < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      if (errno != EAGAIN && errno != EWOULDBLOCK) {
+        // The client is gone; what is left is dropped and the connection closes once it is answered
+        connection.is_input_closed = true;
+        written_size = connection.output.size();
+      }
+      break;
+    }
+    written_size += size;
+  }
+  connection.output.erase(0, written_size);
+}
+
+void Server::UpdateConnection(uint64_t connection_id, Connection& connection) {
+  const bool has_pending_requests = connection.next_request_idx != connection.next_response_idx;
+  if (connection.is_input_closed && connection.input.empty() && !has_pending_requests
+      && connection.output.empty()) {
+    CloseConnection(connection_id);
+    return;
+  }
+  uint32_t events = 0;
+  if (!connection.is_input_closed && HasRoomForRequests(connection)) {
+    events |= EPOLLIN;
+  }
+  if (!connection.output.empty()) {
+    events |= EPOLLOUT;
+  }
+  if (events == connection.events) {
+    return;
+  }
+  if (events == 0) {
+    // EPOLLHUP is reported whatever the mask, so a peer that has hung up would wake the loop forever
+    if (epoll_ctl(epoll_fd_, EPOLL_CTL_DEL, connection.fd, nullptr) != 0) {
+      ThrowSystemError("epoll_ctl");
+    }
+  } else if (connection.events == 0) {
+    AddToEpoll(epoll_fd_, connection.fd, events, connection_id);
+  } else {
+    epoll_event event{};
+    event.events = events;
+    event.data.u64 = connection_id;
+    if (epoll_ctl(epoll_fd_, EPOLL_CTL_MOD, connection.fd, &event) != 0) {
+      ThrowSystemError("epoll_ctl");
+    }
+  }
+  connection.events = events;
+}
+
+void Server::CloseConnection(uint64_t connection_id) {
+  const auto it = connections_.find(connection_id);
+  if (it->second.events != 0) {
+    epoll_ctl(epoll_fd_, EPOLL_CTL_DEL, it->second.fd, nullptr);
+  }
+  close(it->second.fd);
+  connections_.erase(it);
+}
+
+void Server::StartWorkers(size_t thread_count) {
+  workers_.reserve(thread_count);
+  for (size_t i = 0; i < thread_count; ++i) {
+    workers_.emplace_back([this] { Work(); });
+  }
+}
+
+void Server::StopWorkers() {
+  {
+    lock_guard guard(tasks_mutex_);
+    are_workers_stopping_ = true;
+    tasks_.clear();
+  }
+  tasks_cv_.notify_all();
+  for (auto& worker : workers_) {
+    worker.join();
+  }
+}
+
+void Server::Work() {
+  while (true) {
+    function<void()> task;
+    {
+      unique_lock lock(tasks_mutex_);
+      tasks_cv_.wait(lock, [this] { return are_workers_stopping_ || !tasks_.empty(); });
+      if (are_workers_stopping_) {
+        return;
+      }
+      task = move(tasks_.front());
+      tasks_.pop_front();
+    }
+    task();
+  }
+}
@@ -0,0 +1,101 @@
+#pragma once
+
+#include "transport_catalog.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+// Answers stat requests over a Unix domain socket, one JSON object per line each way.
+// An epoll loop on the calling thread reads and writes all connections; requests are answered
+// on a pool of thread_count workers. Clients may send requests without waiting for responses,
+// and every connection gets its responses in the order of its requests.
+// A request that cannot be answered gets {"error_message": "bad request"}, as does a line longer
+// than MAX_REQUEST_SIZE, which is dropped without being parsed.
+class Server {
+public:
+  // Listens at socket_path, replacing a file left there. Throws std::system_error if that fails.
+  Server(const TransportCatalog& db, std::string socket_path, size_t thread_count);
+  ~Server();
+
+  Server(const Server&) = delete;
+  Server& operator=(const Server&) = delete;
+
+  // Serves connections until Stop is called
+  void Run();
+
+  // Safe to call from any thread and from signal handlers
+  void Stop();
+
+private:
+  // Requests queued but not answered yet, above which no more are queued or read from a connection
+  static constexpr size_t MAX_PIPELINED_REQUESTS = 1024;
+  // Bytes of a line kept while waiting for its newline
+  static constexpr size_t MAX_REQUEST_SIZE = 4 * 1024 * 1024;
+
+  struct Connection {
+    int fd;
+    std::string input;  // read but not queued yet
+    std::string output;  // responses not written yet
+    uint64_t next_request_idx = 0;
+    uint64_t next_response_idx = 0;
+    std::map<uint64_t, std::string> early_responses;  // waiting for responses to earlier requests
+    bool is_input_closed = false;
+    bool is_dropping_line = false;  // the rest of a line over MAX_REQUEST_SIZE is skipped
+    // epoll events the connection is registered for; with none it is taken out of epoll,
+    // which would otherwise keep reporting a hung up peer
+    uint32_t events = 0;
+  };
+
+  struct Response {
+    uint64_t connection_id;
+    uint64_t request_idx;
+    std::string text;
+  };
+
+  void AcceptConnections();
+  void ReadRequests(uint64_t connection_id, Connection& connection);
+  // Queues complete lines of the input, as many as the limit of unanswered requests allows
+  void SubmitRequests(uint64_t connection_id, Connection& connection);
+  static bool HasRoomForRequests(const Connection& connection);
+  // Puts the response after those of earlier requests, or keeps it until they come
+  static void AddResponse(Connection& connection, uint64_t request_idx, std::string text);
+  void WriteResponses(Connection& connection);
+  void TakeResponses();
+  // Registers for the events the connection is ready for; closes it once it has nothing more to do
+  void UpdateConnection(uint64_t connection_id, Connection& connection);
+  void CloseConnection(uint64_t connection_id);
+
+  std::string Answer(const std::string& request) const;
+
+  void StartWorkers(size_t thread_count);
+  void StopWorkers();
+  void Work();
+
+  const TransportCatalog& db_;
+  std::string socket_path_;
+  int listen_fd_ = -1;
+  int epoll_fd_ = -1;
+  int event_fd_ = -1;  // signalled by workers with responses and by Stop
+  std::atomic<bool> is_stop_requested_ = false;
+
+  uint64_t next_connection_id_ = 0;
+  std::unordered_map<uint64_t, Connection> connections_;
+
+  std::mutex tasks_mutex_;
+  std::condition_variable tasks_cv_;
+  std::deque<std::function<void()>> tasks_;
+  bool are_workers_stopping_ = false;
+  std::vector<std::thread> workers_;
+
+  std::mutex responses_mutex_;
+  std::vector<Response> responses_;
+};
@@ -0,0 +1,153 @@
+#include "json_view.h"
+#include "json_writer.h"
+#include "requests.h"
+#include "server.h"
+#include "test_utils.h"
+
+#include "test_runner.h"
+
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <cstring>
+#include <filesystem>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace std;
+
+namespace {
+  const string BAD_REQUEST_RESPONSE = R"({"error_message": "bad request"})";
+
+  // Server over SAMPLE_INPUT running on its own thread for the lifetime of the object
+  class RunningServer {
+  public:
+    RunningServer()
+        : db_(BuildCatalog(SAMPLE_INPUT)),
+          socket_path_((filesystem::temp_directory_path() / "transport_guide_server_test.sock").string()),
+          server_(db_, socket_path_, 1),
+          thread_([this] { server_.Run(); })
+    {
+    }
+
+    ~RunningServer() {
+      server_.Stop();
+      thread_.join();
+    }
+
+    const TransportCatalog& GetCatalog() const { return db_; }
+
+    // Connected socket; reads give up after a few seconds, so that a stuck server fails the test
+    int Connect() const {
+      const int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+      sockaddr_un address{};
+      address.sun_family = AF_UNIX;
+      strcpy(address.sun_path, socket_path_.c_str());
+      if (fd < 0 || connect(fd, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) != 0) {
+        throw runtime_error("cannot connect to " + socket_path_);
+      }
+      timeval timeout{10, 0};
+      setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+      return fd;
+    }
+
+  private:
+    TransportCatalog db_;
+    string socket_path_;
+    Server server_;
+    thread thread_;
+  };
+
+  void SendAll(int fd, const string& data) {
+    for (size_t sent_size = 0; sent_size < data.size();) {
+      const ssize_t size = send(fd, data.data() + sent_size, data.size() - sent_size, MSG_NOSIGNAL);
+      if (size <= 0) {
+        throw runtime_error("cannot send to the server");
+      }
+      sent_size += size;
+    }
+  }
+
+  // Lines up to line_count or up to the end of the stream, whichever comes first
+  vector<string> ReceiveLines(int fd, size_t line_count) {
+    vector<string> lines;
+    string input;
+    char buffer[4096];
+    while (lines.size() < line_count) {
+      const ssize_t size = recv(fd, buffer, sizeof(buffer), 0);
+      if (size <= 0) {
+        break;
+      }
+      input.append(buffer, size);
+      for (size_t line_end; lines.size() < line_count && (line_end = input.find('\n')) != string::npos;) {
+        lines.push_back(input.substr(0, line_end));
+        input.erase(0, line_end + 1);
+      }
+    }
+    return lines;
+  }
+
+  string MakeResponse(const TransportCatalog& db, const string& request) {
+    string response;
+    Json::Writer writer(response);
+    Requests::Process(db, Json::LoadView(request), writer);
+    return response;
+  }
+
+  const string STOP_REQUEST = R"({"type": "Stop", "name": "Universam", "id": 4})";
+  const string BUS_REQUEST = R"({"type": "Bus", "name": "297", "id": 1})";
+
+  void TestMalformedRequestsGetBadRequest() {
+    RunningServer server;
+    const int fd = server.Connect();
+    SendAll(fd, R"({"type":"Stop","name":"S1","id":[null]})" "\n"
+                "[x]\n"
+                R"({"a":-})" "\n"
+                R"({"type": "Bus", "name": "297", "id": )" "\n"
+                + STOP_REQUEST + "\n");
+    const auto lines = ReceiveLines(fd, 5);
+    close(fd);
+    ASSERT_EQUAL(lines, (vector<string>{BAD_REQUEST_RESPONSE, BAD_REQUEST_RESPONSE, BAD_REQUEST_RESPONSE,
+                                        BAD_REQUEST_RESPONSE, MakeResponse(server.GetCatalog(), STOP_REQUEST)}));
+  }
+
+  void TestOverlongLineIsDropped() {
+    RunningServer server;
+    const int fd = server.Connect();
+    // Answered before the rest of the line is sent, so a server keeping it all would show no difference
+    SendAll(fd, R"({"type": "Stop", "name": ")" + string(5 * 1024 * 1024, 'x'));
+    ASSERT_EQUAL(ReceiveLines(fd, 1), vector<string>{BAD_REQUEST_RESPONSE});
+    SendAll(fd, string(1024 * 1024, 'x') + "\", \"id\": 1}\n" + BUS_REQUEST + "\n");
+    const auto lines = ReceiveLines(fd, 1);
+    close(fd);
+    ASSERT_EQUAL(lines, vector<string>{MakeResponse(server.GetCatalog(), BUS_REQUEST)});
+  }
+
+  // A client may shut its side down right after the requests and still get every response
+  void TestHalfClosedConnectionIsAnswered() {
+    RunningServer server;
+    const int fd = server.Connect();
+    string requests;
+    for (int i = 0; i < 100; ++i) {
+      requests += (i % 2 ? BUS_REQUEST : STOP_REQUEST) + "\n";
+    }
+    SendAll(fd, requests);
+    shutdown(fd, SHUT_WR);
+    const auto lines = ReceiveLines(fd, 101);
+    close(fd);
+    ASSERT_EQUAL(lines.size(), 100u);
+    for (size_t i = 0; i < lines.size(); ++i) {
+      ASSERT_EQUAL(lines[i], MakeResponse(server.GetCatalog(), i % 2 ? BUS_REQUEST : STOP_REQUEST));
+    }
+  }
+}
+
+void TestServer(TestRunner& tr) {
+  RUN_TEST(tr, TestMalformedRequestsGetBadRequest);
+  RUN_TEST(tr, TestOverlongLineIsDropped);
+  RUN_TEST(tr, TestHalfClosedConnectionIsAnswered);
+}
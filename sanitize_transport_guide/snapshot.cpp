@@ -0,0 +1,98 @@
+#include "snapshot.h"
+
+using namespace std;
+
+namespace Snapshot {
+
+  namespace {
+    constexpr char MAGIC[8] = {'T', 'G', 'S', 'N', 'A', 'P', 'S', 'H'};
+    constexpr uint32_t BYTE_ORDER_MARK = 0x01020304;
+
+    struct Header {
+      char magic[sizeof(MAGIC)];
+      uint32_t version;
+      uint32_t byte_order_mark;
+      uint32_t size_t_size;
+      uint32_t name_count;
+    };
+
+    template <typename T>
+    void Append(string& output, const T& value) {
+      output.append(reinterpret_cast<const char*>(&value), sizeof(value));
+    }
+  }
+
+  void Writer::WriteName(const string& name) {
+    const auto [it, inserted] = name_ids_.emplace(name, names_.size());
+    if (inserted) {
+      names_.push_back(&it->first);
+    }
+    Write<uint32_t>(it->second);
+  }
+
+  string Writer::Finish() const {
+    Header header{};
+    memcpy(header.magic, MAGIC, sizeof(MAGIC));
+    header.version = VERSION;
+    header.byte_order_mark = BYTE_ORDER_MARK;
+    header.size_t_size = sizeof(size_t);
+    header.name_count = names_.size();
+
+    string result;
+    Append(result, header);
+    for (const string* name : names_) {
+      Append<uint32_t>(result, name->size());
+      result += *name;
+    }
+    result += body_;
+    return result;
+  }
+
+  Reader::Reader(string_view data) : data_(data) {
+    const auto header = Read<Header>();
+    if (memcmp(header.magic, MAGIC, sizeof(MAGIC)) != 0) {
+      throw runtime_error("not a transport catalog snapshot");
+    }
+    if (header.version != VERSION) {
+      throw runtime_error("unsupported snapshot version " + to_string(header.version));
+    }
+    if (header.byte_order_mark != BYTE_ORDER_MARK || header.size_t_size != sizeof(size_t)) {
+      throw runtime_error("snapshot was written on an incompatible platform");
+    }
+
+    if (header.name_count > data_.size() / sizeof(uint32_t)) {
+      throw runtime_error("truncated snapshot");
+    }
+    names_.reserve(header.name_count);
+    for (uint32_t name_idx = 0; name_idx < header.name_count; ++name_idx) {
+      const auto size = Read<uint32_t>();
+      names_.emplace_back(Take(size), size);
+    }
+  }
+
+  size_t Reader::ReadSize(size_t min_item_size) {
+    const auto size = Read<uint64_t>();
+    if (size > data_.size() / min_item_size) {
+      throw runtime_error("truncated snapshot");
+    }
+    return size;
+  }
+
+  const string& Reader::ReadName() {
+    const auto name_id = Read<uint32_t>();
+    if (name_id >= names_.size()) {
+      throw runtime_error("inconsistent snapshot");
+    }
+    return names_[name_id];
+  }
+
+  const char* Reader::Take(size_t size) {
+    if (size > data_.size()) {
+      throw runtime_error("truncated snapshot");
+    }
+    const char* result = data_.data();
+    data_.remove_prefix(size);
+    return result;
+  }
+
+}
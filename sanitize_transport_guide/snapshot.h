@@ -0,0 +1,86 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <unordered_map>
+#include <vector>
+
+// Binary snapshot of a built TransportCatalog.
+// Layout: header (magic, version, layout check), name table, body.
+// Every string written with WriteName is stored once in the name table and referenced by index.
+// Values are stored in the native byte order; the layout check rejects snapshots
+// written on a platform with a different one or with a different size_t.
+namespace Snapshot {
+
+  inline constexpr uint32_t VERSION = 9;
+
+  class Writer {
+  public:
+    template <typename T>
+    void Write(const T& value) {
+      static_assert(std::is_trivially_copyable_v<T>);
+      body_.append(reinterpret_cast<const char*>(&value), sizeof(value));
+    }
+
+    template <typename T>
+    void WriteVector(const std::vector<T>& values) {
+      static_assert(std::is_trivially_copyable_v<T>);
+      Write<uint64_t>(values.size());
+      body_.append(reinterpret_cast<const char*>(values.data()), values.size() * sizeof(T));
+    }
+
+    void WriteName(const std::string& name);
+
+    // Header, name table and body, ready to be written to a file
+    std::string Finish() const;
+
+  private:
+    std::string body_;
+    std::unordered_map<std::string, uint32_t> name_ids_;
+    std::vector<const std::string*> names_;
+  };
+
+  class Reader {
+  public:
+    // Checks the header and reads the name table; data has to outlive the reader
+    explicit Reader(std::string_view data);
+
+    template <typename T>
+    T Read() {
+      static_assert(std::is_trivially_copyable_v<T>);
+      T value;
+      std::memcpy(&value, Take(sizeof(value)), sizeof(value));
+      return value;
+    }
+
+    template <typename T>
+    std::vector<T> ReadVector() {
+      static_assert(std::is_trivially_copyable_v<T>);
+      const size_t size = ReadSize(sizeof(T));
+      std::vector<T> values(size);
+      if (size > 0) {
+        std::memcpy(values.data(), Take(size * sizeof(T)), size * sizeof(T));
+      }
+      return values;
+    }
+
+    // Number of items to follow, each taking at least min_item_size bytes, so that a corrupted
+    // number cannot make the caller allocate more than the rest of the data could hold
+    size_t ReadSize(size_t min_item_size);
+
+    const std::string& ReadName();
+
+    bool IsAtEnd() const { return data_.empty(); }
+
+  private:
+    const char* Take(size_t size);
+
+    std::string_view data_;
+    std::vector<std::string> names_;
+  };
+
+}
@@ -0,0 +1,163 @@
+#include "snapshot.h"
+#include "test_utils.h"
+#include "transport_catalog.h"
+
+#include "test_runner.h"
+
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+namespace {
+  string MakeTempPath(const string& name) {
+    return (filesystem::temp_directory_path() / ("transport_guide_" + name)).string();
+  }
+
+  string ReadFile(const string& path) {
+    ifstream input(path, ios::binary);
+    return {istreambuf_iterator<char>(input), istreambuf_iterator<char>()};
+  }
+
+  void WriteFile(const string& path, const string& data) {
+    ofstream output(path, ios::binary);
+    output.write(data.data(), data.size());
+  }
+
+  // Settings covering every part a snapshot may hold: precomputed routes, a hierarchy, both graph models
+  const vector<Json::Dict> SNAPSHOT_SETTINGS = {
+      {},
+      {{"precompute_routes", Json::Node(true)}},
+      {{"graph_model", Json::Node(string("rides"))}, {"precompute_routes", Json::Node(true)}},
+      {{"graph_model", Json::Node(string("rides"))}, {"route_search", Json::Node(string("contraction_hierarchies"))}},
+      {{"route_search", Json::Node(string("bidirectional_a_star"))}, {"route_cache_size", Json::Node(16)}},
+  };
+
+  void TestWriterReaderRoundTrip() {
+    Snapshot::Writer writer;
+    writer.Write<int32_t>(-42);
+    writer.WriteName("first");
+    writer.Write(2.5);
+    writer.WriteName("second");
+    writer.WriteName("first");
+    writer.WriteVector(vector<uint64_t>{1, 2, 3});
+    writer.WriteVector(vector<int>{});
+    const string data = writer.Finish();
+
+    Snapshot::Reader reader(data);
+    ASSERT_EQUAL(reader.Read<int32_t>(), -42);
+    ASSERT_EQUAL(reader.ReadName(), "first");
+    ASSERT_EQUAL(reader.Read<double>(), 2.5);
+    ASSERT_EQUAL(reader.ReadName(), "second");
+    ASSERT_EQUAL(reader.ReadName(), "first");
+    ASSERT_EQUAL(reader.ReadVector<uint64_t>(), (vector<uint64_t>{1, 2, 3}));
+    ASSERT(reader.ReadVector<int>().empty());
+    ASSERT(reader.IsAtEnd());
+    ASSERT_THROWS(reader.Read<uint8_t>(), runtime_error);
+  }
+
+  void TestReaderRejectsBadData() {
+    Snapshot::Writer writer;
+    writer.WriteName("name");
+    writer.WriteVector(vector<uint64_t>{1, 2, 3});
+    const string data = writer.Finish();
+
+    for (size_t size = 0; size < data.size(); ++size) {
+      ASSERT_THROWS(
+          {
+            Snapshot::Reader reader(string_view(data).substr(0, size));
+            reader.ReadName();
+            reader.ReadVector<uint64_t>();
+          },
+          runtime_error);
+    }
+    string bad_magic = data;
+    bad_magic[0] = 'X';
+    ASSERT_THROWS(Snapshot::Reader{bad_magic}, runtime_error);
+    string bad_version = data;
+    ++bad_version[8];
+    ASSERT_THROWS(Snapshot::Reader{bad_version}, runtime_error);
+  }
+
+  void TestCatalogRoundTrip() {
+    const string path = MakeTempPath("round_trip.bin");
+    for (const auto& settings : SNAPSHOT_SETTINGS) {
+      const TransportCatalog db = BuildCatalog(SAMPLE_INPUT, settings);
+      db.SaveSnapshot(path);
+      const TransportCatalog loaded_db = TransportCatalog::LoadSnapshot(path);
+      ASSERT_EQUAL(AnswerRequests(loaded_db, SAMPLE_INPUT), AnswerRequests(db, SAMPLE_INPUT));
+    }
+    filesystem::remove(path);
+  }
+
+  // Padding bytes must not get into snapshots
+  void TestSnapshotsAreDeterministic() {
+    const string first_path = MakeTempPath("first.bin");
+    const string second_path = MakeTempPath("second.bin");
+    for (const auto& settings : SNAPSHOT_SETTINGS) {
+      BuildCatalog(SAMPLE_INPUT, settings).SaveSnapshot(first_path);
+      BuildCatalog(SAMPLE_INPUT, settings).SaveSnapshot(second_path);
+      ASSERT(ReadFile(first_path) == ReadFile(second_path));
+      TransportCatalog::LoadSnapshot(first_path).SaveSnapshot(second_path);
+      ASSERT(ReadFile(first_path) == ReadFile(second_path));
+    }
+    filesystem::remove(first_path);
+    filesystem::remove(second_path);
+  }
+
+  void TestTruncatedSnapshotThrows() {
+    const string path = MakeTempPath("truncated.bin");
+    BuildCatalog(SAMPLE_INPUT, SNAPSHOT_SETTINGS[1]).SaveSnapshot(path);
+    const string data = ReadFile(path);
+    for (size_t size = 0; size < data.size(); size += 13) {
+      WriteFile(path, data.substr(0, size));
+      ASSERT_THROWS(TransportCatalog::LoadSnapshot(path), runtime_error);
+    }
+    WriteFile(path, data.substr(0, data.size() - 1));
+    ASSERT_THROWS(TransportCatalog::LoadSnapshot(path), runtime_error);
+    WriteFile(path, data + '\0');
+    ASSERT_THROWS(TransportCatalog::LoadSnapshot(path), runtime_error);
+    filesystem::remove(path);
+  }
+
+  // A flipped bit may land in a weight or a coordinate and go unnoticed, but ids and sizes are checked,
+  // so a snapshot either loads or is rejected with runtime_error, never read out of bounds
+  void TestCorruptedSnapshotIsRejectedOrLoads() {
+    const string path = MakeTempPath("corrupted.bin");
+    for (const auto& settings : SNAPSHOT_SETTINGS) {
+      BuildCatalog(SAMPLE_INPUT, settings).SaveSnapshot(path);
+      const string data = ReadFile(path);
+      size_t rejected_count = 0;
+      size_t corrupted_count = 0;
+      for (size_t pos = 0; pos < data.size(); pos += 5) {
+        for (const int bit : {0, 6}) {
+          string corrupted = data;
+          corrupted[pos] ^= static_cast<char>(1 << bit);
+          WriteFile(path, corrupted);
+          ++corrupted_count;
+          try {
+            TransportCatalog::LoadSnapshot(path);
+          } catch (const runtime_error&) {
+            ++rejected_count;
+          }
+        }
+      }
+      ASSERT(rejected_count > 0);
+      ASSERT(rejected_count < corrupted_count);
+    }
+    filesystem::remove(path);
+  }
+}
+
+void TestSnapshot(TestRunner& tr) {
+  RUN_TEST(tr, TestWriterReaderRoundTrip);
+  RUN_TEST(tr, TestReaderRejectsBadData);
+  RUN_TEST(tr, TestCatalogRoundTrip);
+  RUN_TEST(tr, TestSnapshotsAreDeterministic);
+  RUN_TEST(tr, TestTruncatedSnapshotThrows);
+  RUN_TEST(tr, TestCorruptedSnapshotIsRejectedOrLoads);
+}
@@ -0,0 +1,99 @@
+#include "spatial_index.h"
+
+#include <algorithm>
+#include <cmath>
+
+using namespace std;
+
+SpatialIndex::SpatialIndex(const vector<Sphere::Point>& points) {
+  nodes_.reserve(points.size());
+  for (uint32_t point_idx = 0; point_idx < points.size(); ++point_idx) {
+    nodes_.push_back({ToUnitVector(points[point_idx]), point_idx, 0});
+  }
+  Build(0, nodes_.size());
+}
+
+SpatialIndex::Vector SpatialIndex::ToUnitVector(Sphere::Point point) {
+  const auto radians = Sphere::Point::FromDegrees(point.latitude, point.longitude);
+  return {
+      cos(radians.latitude) * cos(radians.longitude),
+      cos(radians.latitude) * sin(radians.longitude),
+      sin(radians.latitude),
+  };
+}
+
+void SpatialIndex::Build(size_t begin, size_t end) {
+  if (end - begin <= 1) {
+    return;
+  }
+  // Splitting along the widest extent keeps cells compact, as points only cover a part of the sphere
+  Vector min_position = nodes_[begin].position;
+  Vector max_position = nodes_[begin].position;
+  for (size_t node_idx = begin + 1; node_idx < end; ++node_idx) {
+    for (size_t axis = 0; axis < 3; ++axis) {
+      min_position[axis] = min(min_position[axis], nodes_[node_idx].position[axis]);
+      max_position[axis] = max(max_position[axis], nodes_[node_idx].position[axis]);
+    }
+  }
+  uint8_t axis = 0;
+  for (uint8_t other_axis = 1; other_axis < 3; ++other_axis) {
+    if (max_position[other_axis] - min_position[other_axis] > max_position[axis] - min_position[axis]) {
+      axis = other_axis;
+    }
+  }
+
+  const size_t middle = begin + (end - begin) / 2;
+  nth_element(nodes_.begin() + begin, nodes_.begin() + middle, nodes_.begin() + end,
+              [axis](const Node& lhs, const Node& rhs) { return lhs.position[axis] < rhs.position[axis]; });
+  nodes_[middle].axis = axis;
+  Build(begin, middle);
+  Build(middle + 1, end);
+}
+
+vector<uint32_t> SpatialIndex::FindNearest(Sphere::Point point, size_t count) const {
+  Candidates candidates;
+  if (count > 0) {
+    candidates.reserve(min(count, nodes_.size()));
+    Search(0, nodes_.size(), ToUnitVector(point), count, candidates);
+  }
+  sort_heap(begin(candidates), end(candidates));
+
+  vector<uint32_t> point_indices;
+  point_indices.reserve(candidates.size());
+  for (const auto& [squared_chord, point_idx] : candidates) {
+    point_indices.push_back(point_idx);
+  }
+  return point_indices;
+}
+
+void SpatialIndex::Search(size_t begin, size_t end, const Vector& target, size_t count,
+                          Candidates& candidates) const {
+  if (begin >= end) {
+    return;
+  }
+  const size_t middle = begin + (end - begin) / 2;
+  const Node& node = nodes_[middle];
+
+  double squared_chord = 0;
+  for (size_t axis = 0; axis < 3; ++axis) {
+    squared_chord += (node.position[axis] - target[axis]) * (node.position[axis] - target[axis]);
+  }
+  const pair candidate(squared_chord, node.point_idx);
+  if (candidates.size() < count) {
+    candidates.push_back(candidate);
+    push_heap(std::begin(candidates), std::end(candidates));
+  } else if (candidate < candidates.front()) {
+    pop_heap(std::begin(candidates), std::end(candidates));
+    candidates.back() = candidate;
+    push_heap(std::begin(candidates), std::end(candidates));
+  }
+
+  // The far side is searched unless it lies farther than every candidate kept; equally far points
+  // still count, as they may have smaller indices
+  const double axis_difference = target[node.axis] - node.position[node.axis];
+  const bool is_left_near = axis_difference < 0;
+  Search(is_left_near ? begin : middle + 1, is_left_near ? middle : end, target, count, candidates);
+  if (candidates.size() < count || axis_difference * axis_difference <= candidates.front().first) {
+    Search(is_left_near ? middle + 1 : begin, is_left_near ? end : middle, target, count, candidates);
+  }
+}
@@ -0,0 +1,42 @@
+#pragma once
+
+#include "sphere.h"
+
+#include <array>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+// k-d tree over points of a sphere taken as unit vectors in 3D. The chord between two points grows
+// with the great-circle distance, so the nearest points by chord are the nearest on the sphere,
+// near the poles and across the antimeridian as well.
+class SpatialIndex {
+public:
+  SpatialIndex() = default;
+  explicit SpatialIndex(const std::vector<Sphere::Point>& points);
+
+  // Indices of up to count points closest to point, closest first; equally close ones go by index
+  std::vector<uint32_t> FindNearest(Sphere::Point point, size_t count) const;
+
+  size_t size() const { return nodes_.size(); }
+
+private:
+  using Vector = std::array<double, 3>;
+  static Vector ToUnitVector(Sphere::Point point);
+
+  struct Node {
+    Vector position;
+    uint32_t point_idx;
+    uint8_t axis;  // the subtree rooted here is split along it
+  };
+
+  // The subtree of nodes in [begin, end) is rooted at the middle one,
+  // with nodes not greater along its axis to the left and not less to the right
+  void Build(size_t begin, size_t end);
+
+  // Max-heap of (squared chord, point index) keeping the count nearest points found
+  using Candidates = std::vector<std::pair<double, uint32_t>>;
+  void Search(size_t begin, size_t end, const Vector& target, size_t count, Candidates& candidates) const;
+
+  std::vector<Node> nodes_;
+};
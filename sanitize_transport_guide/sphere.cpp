@@ -26,4 +26,54 @@ namespace Sphere {
       + cos(lhs.latitude) * cos(rhs.latitude) * cos(abs(lhs.longitude - rhs.longitude))
     ) * EARTH_RADIUS;
   }
+
+  PointSet::PointSet(const vector<Point>& points) {
+    latitude_sines_.reserve(points.size());
+    latitude_cosines_.reserve(points.size());
+    longitudes_.reserve(points.size());
+    for (const Point& point : points) {
+      const Point radians = Point::FromDegrees(point.latitude, point.longitude);
+      latitude_sines_.push_back(sin(radians.latitude));
+      latitude_cosines_.push_back(cos(radians.latitude));
+      longitudes_.push_back(radians.longitude);
+    }
+  }
+
+  // Same expression as in Sphere::Distance, so that rounding is the same too
+  static double ComputeDistance(double lhs_latitude_sine, double lhs_latitude_cosine, double lhs_longitude,
+                                double rhs_latitude_sine, double rhs_latitude_cosine, double rhs_longitude) {
+    return acos(
+      lhs_latitude_sine * rhs_latitude_sine
+      + lhs_latitude_cosine * rhs_latitude_cosine * cos(abs(lhs_longitude - rhs_longitude))
+    ) * EARTH_RADIUS;
+  }
+
+  double PointSet::Distance(size_t lhs_idx, size_t rhs_idx) const {
+    return ComputeDistance(latitude_sines_[lhs_idx], latitude_cosines_[lhs_idx], longitudes_[lhs_idx],
+                           latitude_sines_[rhs_idx], latitude_cosines_[rhs_idx], longitudes_[rhs_idx]);
+  }
+
+  double PointSet::ComputeRouteDistance(const vector<uint32_t>& point_indices) const {
+    double result = 0;
+    for (size_t i = 1; i < point_indices.size(); ++i) {
+      result += Distance(point_indices[i - 1], point_indices[i]);
+    }
+    return result;
+  }
+
+  void PointSet::ComputeDistancesFrom(size_t point_idx, vector<double>& distances) const {
+    const size_t point_count = size();
+    distances.resize(point_count);
+    const double latitude_sine = latitude_sines_[point_idx];
+    const double latitude_cosine = latitude_cosines_[point_idx];
+    const double longitude = longitudes_[point_idx];
+    const double* const latitude_sines = latitude_sines_.data();
+    const double* const latitude_cosines = latitude_cosines_.data();
+    const double* const longitudes = longitudes_.data();
+    double* const result = distances.data();
+    for (size_t i = 0; i < point_count; ++i) {
+      result[i] = ComputeDistance(latitude_sine, latitude_cosine, longitude,
+                                  latitude_sines[i], latitude_cosines[i], longitudes[i]);
+    }
+  }
 }
@@ -1,6 +1,8 @@
 #pragma once
 
 #include <cmath>
+#include <cstdint>
+#include <vector>
 
 namespace Sphere {
   double ConvertDegreesToRadians(double degrees);
@@ -13,4 +15,28 @@ namespace Sphere {
   };
 
   double Distance(Point lhs, Point rhs);
+
+  // Points given in degrees, kept as separate arrays of longitudes in radians and of sines and cosines
+  // of latitudes, so that a distance takes one cos and one acos instead of converting and taking
+  // sines and cosines of both points every time. Distances are bit for bit the ones of Sphere::Distance.
+  class PointSet {
+  public:
+    PointSet() = default;
+    explicit PointSet(const std::vector<Point>& points);
+
+    size_t size() const { return longitudes_.size(); }
+
+    double Distance(size_t lhs_idx, size_t rhs_idx) const;
+
+    // Length of the route through the points with these indices
+    double ComputeRouteDistance(const std::vector<uint32_t>& point_indices) const;
+
+    // Distances from the given point to every point, in a branch-free loop over the arrays
+    void ComputeDistancesFrom(size_t point_idx, std::vector<double>& distances) const;
+
+  private:
+    std::vector<double> latitude_sines_;
+    std::vector<double> latitude_cosines_;
+    std::vector<double> longitudes_;
+  };
 }
@@ -0,0 +1,17 @@
+#include "test_runner.h"
+
+void TestJson(TestRunner& tr);
+void TestLruCache(TestRunner& tr);
+void TestServer(TestRunner& tr);
+void TestSnapshot(TestRunner& tr);
+void TestTransportCatalog(TestRunner& tr);
+
+int main() {
+  TestRunner tr;
+  TestJson(tr);
+  TestLruCache(tr);
+  TestServer(tr);
+  TestSnapshot(tr);
+  TestTransportCatalog(tr);
+  return 0;
+}
@@ -0,0 +1,143 @@
+#pragma once
+
+#include "descriptions.h"
+#include "json.h"
+#include "json_writer.h"
+#include "requests.h"
+#include "sphere.h"
+#include "transport_catalog.h"
+
+#include <map>
+#include <random>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+// Small input with stops, a roundtrip bus and a bus going there and back, and requests of several types
+inline const std::string SAMPLE_INPUT = R"({
+  "routing_settings": {"bus_wait_time": 6, "bus_velocity": 40},
+  "base_requests": [
+    {"type": "Bus", "name": "297", "stops": ["Biryulyovo Zapadnoye", "Biryulyovo Tovarnaya", "Universam",
+      "Biryulyovo Zapadnoye"], "is_roundtrip": true, "departures": [360, 400, 1200]},
+    {"type": "Bus", "name": "635", "stops": ["Biryulyovo Tovarnaya", "Universam", "Prazhskaya"],
+      "is_roundtrip": false},
+    {"type": "Stop", "name": "Biryulyovo Zapadnoye", "latitude": 55.574371, "longitude": 37.6517,
+      "road_distances": {"Biryulyovo Tovarnaya": 2600}},
+    {"type": "Stop", "name": "Universam", "latitude": 55.587655, "longitude": 37.645687,
+      "road_distances": {"Prazhskaya": 4650, "Biryulyovo Tovarnaya": 1380, "Biryulyovo Zapadnoye": 2500}},
+    {"type": "Stop", "name": "Biryulyovo Tovarnaya", "latitude": 55.592028, "longitude": 37.653656,
+      "road_distances": {"Universam": 890}},
+    {"type": "Stop", "name": "Prazhskaya", "latitude": 55.611717, "longitude": 37.603938, "road_distances": {}},
+    {"type": "Stop", "name": "Lonely", "latitude": -55.5, "longitude": -37.25, "road_distances": {}}
+  ],
+  "stat_requests": [
+    {"type": "Bus", "name": "297", "id": 1},
+    {"type": "Bus", "name": "635", "id": 2},
+    {"type": "Bus", "name": "828", "id": 3},
+    {"type": "Stop", "name": "Universam", "id": 4},
+    {"type": "Stop", "name": "Lonely", "id": 5},
+    {"type": "Route", "from": "Biryulyovo Zapadnoye", "to": "Universam", "id": 6},
+    {"type": "Route", "from": "Biryulyovo Zapadnoye", "to": "Prazhskaya", "id": 7},
+    {"type": "Route", "from": "Prazhskaya", "to": "Biryulyovo Tovarnaya", "id": 8},
+    {"type": "Route", "from": "Universam", "to": "Lonely", "id": 9},
+    {"type": "NearestStops", "latitude": 55.59, "longitude": 37.65, "count": 2, "id": 10},
+    {"type": "TimetableRoute", "from": "Biryulyovo Zapadnoye", "to": "Universam", "departure_time": 380, "id": 11}
+  ]
+})";
+
+// Input without stat requests: stops named "Stop 0" and so on scattered over a city, and buses going to
+// the closest of a few random stops at every step, every second one there and back. The same seed gives
+// the same input.
+inline std::string MakeRandomInput(size_t stop_count, size_t bus_count, size_t stops_per_bus, unsigned seed) {
+  std::mt19937 generator(seed);
+  std::uniform_real_distribution<double> latitude(55.5, 55.9);
+  std::uniform_real_distribution<double> longitude(37.3, 37.9);
+  std::uniform_int_distribution<int> distance(300, 3000);
+  std::uniform_int_distribution<size_t> stop_idx_distribution(0, stop_count - 1);
+
+  std::vector<Sphere::Point> positions;
+  for (size_t stop_idx = 0; stop_idx < stop_count; ++stop_idx) {
+    positions.push_back({latitude(generator), longitude(generator)});
+  }
+  std::vector<std::vector<std::pair<size_t, int>>> distances(stop_count);
+  std::string input;
+  Json::Writer writer(input);
+  writer.BeginObject()
+      .Key("routing_settings").BeginObject().Key("bus_wait_time").Int(6).Key("bus_velocity").Int(40).EndObject()
+      .Key("stat_requests").BeginArray().EndArray()
+      .Key("base_requests").BeginArray();
+  for (size_t bus_idx = 0; bus_idx < bus_count; ++bus_idx) {
+    writer.BeginObject()
+        .Key("type").String("Bus")
+        .Key("name").String("Bus " + std::to_string(bus_idx))
+        .Key("is_roundtrip").Bool(bus_idx % 2 == 0)
+        .Key("departures").BeginArray().Int(static_cast<int>(360 + bus_idx)).Int(static_cast<int>(720 + bus_idx))
+        .EndArray()
+        .Key("stops").BeginArray();
+    const size_t first_stop_idx = stop_idx_distribution(generator);
+    size_t stop_idx = first_stop_idx;
+    writer.String("Stop " + std::to_string(stop_idx));
+    for (size_t i = 1; i < stops_per_bus; ++i) {
+      size_t next_stop_idx = stop_idx_distribution(generator);
+      for (int candidate = 0; candidate < 4; ++candidate) {
+        const size_t candidate_idx = stop_idx_distribution(generator);
+        if (next_stop_idx == stop_idx || (candidate_idx != stop_idx
+            && Sphere::Distance(positions[stop_idx], positions[candidate_idx])
+               < Sphere::Distance(positions[stop_idx], positions[next_stop_idx]))) {
+          next_stop_idx = candidate_idx;
+        }
+      }
+      distances[stop_idx].emplace_back(next_stop_idx, distance(generator));
+      stop_idx = next_stop_idx;
+      writer.String("Stop " + std::to_string(stop_idx));
+    }
+    if (bus_idx % 2 == 0) {
+      distances[stop_idx].emplace_back(first_stop_idx, distance(generator));
+      writer.String("Stop " + std::to_string(first_stop_idx));
+    }
+    writer.EndArray().EndObject();
+  }
+  for (size_t stop_idx = 0; stop_idx < stop_count; ++stop_idx) {
+    writer.BeginObject()
+        .Key("type").String("Stop")
+        .Key("name").String("Stop " + std::to_string(stop_idx))
+        .Key("latitude").Double(positions[stop_idx].latitude)
+        .Key("longitude").Double(positions[stop_idx].longitude)
+        .Key("road_distances").BeginObject();
+    // Keys of an object are unique, the last distance to a stop wins as it would on reading
+    std::map<size_t, int> stop_distances;
+    for (const auto& [neighbour_idx, neighbour_distance] : distances[stop_idx]) {
+      stop_distances[neighbour_idx] = neighbour_distance;
+    }
+    for (const auto& [neighbour_idx, neighbour_distance] : stop_distances) {
+      writer.Key("Stop " + std::to_string(neighbour_idx)).Int(neighbour_distance);
+    }
+    writer.EndObject().EndObject();
+  }
+  writer.EndArray().EndObject();
+  return input;
+}
+
+inline Json::Document LoadJson(const std::string& input) {
+  std::istringstream input_stream(input);
+  return Json::Load(input_stream);
+}
+
+// Catalog of the base requests of input, with routing settings overridden by settings
+inline TransportCatalog BuildCatalog(std::string_view input, const Json::Dict& settings = {}) {
+  auto input_doc = Descriptions::ReadInputDocument(input);
+  Json::Dict routing_settings = input_doc.sections.at("routing_settings").AsMap();
+  for (const auto& [key, value] : settings) {
+    routing_settings[key] = value;
+  }
+  return TransportCatalog(std::move(input_doc.descriptions), routing_settings);
+}
+
+// Responses to the stat requests of input
+inline std::string AnswerRequests(const TransportCatalog& db, const std::string& input) {
+  std::ostringstream output;
+  Requests::ProcessAll(db, LoadJson(input).GetRoot().AsMap().at("stat_requests").AsArray(), output);
+  return output.str();
+}
@@ -0,0 +1,152 @@
+#include "timetable_router.h"
+#include "metrics.h"
+
+#include <algorithm>
+#include <limits>
+#include <stdexcept>
+#include <tuple>
+#include <utility>
+
+using namespace std;
+
+TimetableRouter::TimetableRouter(size_t stop_count, const vector<BusRoute>& bus_routes,
+                                 const Json::Dict& routing_settings_json)
+    : stop_count_(stop_count),
+      bus_velocity_(routing_settings_json.at("bus_velocity").AsDouble())
+{
+  Build(bus_routes);
+}
+
+TimetableRouter::TimetableRouter(const TimetableRouter& previous, size_t stop_count,
+                                 const vector<BusRoute>& bus_routes)
+    : stop_count_(stop_count),
+      bus_velocity_(previous.bus_velocity_)
+{
+  Build(bus_routes);
+}
+
+void TimetableRouter::Build(const vector<BusRoute>& bus_routes) {
+  const double meters_per_minute = bus_velocity_ * 1000.0 / 60;
+  size_t connection_count = 0;
+  for (const auto& bus_route : bus_routes) {
+    if (bus_route.stop_ids.size() > 1) {
+      connection_count += bus_route.departures.size() * (bus_route.stop_ids.size() - 1);
+    }
+  }
+  connections_.reserve(connection_count);
+
+  for (const auto& bus_route : bus_routes) {
+    if (bus_route.stop_ids.size() <= 1) {
+      continue;
+    }
+    for (const int departure : bus_route.departures) {
+      const auto trip_idx = static_cast<uint32_t>(trip_bus_ids_.size());
+      trip_bus_ids_.push_back(bus_route.bus_id);
+      // Times are counted from the trip departure, so that a bus leaves a stop exactly when it arrives there
+      for (size_t stop_idx = 0; stop_idx + 1 < bus_route.stop_ids.size(); ++stop_idx) {
+        connections_.push_back({
+            departure + bus_route.distances_from_start[stop_idx] / meters_per_minute,
+            departure + bus_route.distances_from_start[stop_idx + 1] / meters_per_minute,
+            bus_route.stop_ids[stop_idx],
+            bus_route.stop_ids[stop_idx + 1],
+            trip_idx,
+            static_cast<uint32_t>(stop_idx),
+        });
+      }
+    }
+  }
+
+  // Of connections departing at once, those arriving at once go first, so that one
+  // taking no time is scanned before any that may continue the route from its stop
+  sort(begin(connections_), end(connections_), [](const Connection& lhs, const Connection& rhs) {
+    return tie(lhs.departure_time, lhs.arrival_time, lhs.trip_idx, lhs.stop_idx)
+        < tie(rhs.departure_time, rhs.arrival_time, rhs.trip_idx, rhs.stop_idx);
+  });
+  Metrics::Set(Metrics::Counter::TIMETABLE_CONNECTIONS, connections_.size());
+}
+
+optional<TimetableRouter::RouteInfo> TimetableRouter::FindRoute(NameId stop_from, NameId stop_to,
+                                                                double departure_time) const {
+  if (stop_from == stop_to) {
+    return RouteInfo{departure_time, departure_time, {}};
+  }
+
+  vector<double> arrival_times(stop_count_, numeric_limits<double>::infinity());
+  // Connections of the trip a stop is reached by: the one boarded and the one left
+  vector<pair<uint32_t, uint32_t>> stop_legs(stop_count_, {NO_CONNECTION, NO_CONNECTION});
+  // First connection of every trip taken
+  vector<uint32_t> trip_boardings(trip_bus_ids_.size(), NO_CONNECTION);
+  arrival_times[stop_from] = departure_time;
+
+  const auto first_connection = lower_bound(
+      begin(connections_), end(connections_), departure_time,
+      [](const Connection& connection, double time) { return connection.departure_time < time; }
+  );
+  for (auto idx = static_cast<uint32_t>(first_connection - begin(connections_)); idx < connections_.size(); ++idx) {
+    const Connection& connection = connections_[idx];
+    // Nothing departing later can arrive earlier
+    if (connection.departure_time >= arrival_times[stop_to]) {
+      break;
+    }
+    uint32_t& boarding = trip_boardings[connection.trip_idx];
+    if (boarding == NO_CONNECTION) {
+      if (arrival_times[connection.stop_from] > connection.departure_time) {
+        continue;
+      }
+      boarding = idx;
+    }
+    if (connection.arrival_time < arrival_times[connection.stop_to]) {
+      arrival_times[connection.stop_to] = connection.arrival_time;
+      stop_legs[connection.stop_to] = {boarding, idx};
+    }
+  }
+  if (arrival_times[stop_to] == numeric_limits<double>::infinity()) {
+    return nullopt;
+  }
+
+  vector<pair<uint32_t, uint32_t>> legs;
+  for (NameId stop_id = stop_to; stop_id != stop_from; stop_id = connections_[stop_legs[stop_id].first].stop_from) {
+    legs.push_back(stop_legs[stop_id]);
+  }
+  reverse(begin(legs), end(legs));
+
+  RouteInfo route{departure_time, arrival_times[stop_to], {}};
+  route.items.reserve(legs.size() * 2);
+  double time = departure_time;
+  for (const auto& [boarding_idx, leaving_idx] : legs) {
+    const Connection& boarding = connections_[boarding_idx];
+    const Connection& leaving = connections_[leaving_idx];
+    route.items.push_back(TransportRouter::RouteInfo::WaitItem{boarding.stop_from, boarding.departure_time - time});
+    route.items.push_back(TransportRouter::RouteInfo::BusItem{
+        trip_bus_ids_[boarding.trip_idx],
+        leaving.arrival_time - boarding.departure_time,
+        leaving.stop_idx - boarding.stop_idx + 1
+    });
+    time = leaving.arrival_time;
+  }
+  return route;
+}
+
+void TimetableRouter::Save(Snapshot::Writer& writer) const {
+  writer.Write<uint64_t>(stop_count_);
+  writer.Write(bus_velocity_);
+  writer.WriteVector(connections_);
+  writer.WriteVector(trip_bus_ids_);
+}
+
+unique_ptr<TimetableRouter> TimetableRouter::Load(Snapshot::Reader& reader) {
+  unique_ptr<TimetableRouter> result(new TimetableRouter);
+  TimetableRouter& router = *result;
+  router.stop_count_ = reader.Read<uint64_t>();
+  router.bus_velocity_ = reader.Read<double>();
+  router.connections_ = reader.ReadVector<Connection>();
+  router.trip_bus_ids_ = reader.ReadVector<NameId>();
+  for (const auto& connection : router.connections_) {
+    if (connection.stop_from >= router.stop_count_ || connection.stop_to >= router.stop_count_
+        || connection.trip_idx >= router.trip_bus_ids_.size()) {
+      throw runtime_error("inconsistent snapshot");
+    }
+  }
+  Metrics::Set(Metrics::Counter::TIMETABLE_CONNECTIONS, router.connections_.size());
+  return result;
+}
@@ -0,0 +1,64 @@
+#pragma once
+
+#include "json.h"
+#include "name_table.h"
+#include "road_network.h"
+#include "snapshot.h"
+#include "transport_router.h"
+
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <vector>
+
+// Earliest arrival by the departures of buses rather than by a constant bus_wait_time, found by
+// the connection scan algorithm: every hop of every trip is a connection, and all of them are kept
+// in one flat array sorted by departure time, so a query is a single forward scan from its departure.
+// Times are in minutes after midnight. Buses take bus_velocity of routing_settings between stops and
+// leave a stop as soon as they arrive at it; passengers change buses at a stop without delay.
+class TimetableRouter {
+public:
+  // Stops have ids from 0 to stop_count - 1. Buses without departures are left out.
+  TimetableRouter(size_t stop_count, const std::vector<BusRoute>& bus_routes, const Json::Dict& routing_settings_json);
+
+  // Router with the settings of previous
+  TimetableRouter(const TimetableRouter& previous, size_t stop_count, const std::vector<BusRoute>& bus_routes);
+
+  struct RouteInfo {
+    double departure_time;  // from stop_from, as asked for
+    double arrival_time;
+    std::vector<TransportRouter::RouteInfo::Item> items;  // waits until departures and bus rides
+  };
+
+  // Empty if stop_to cannot be reached after departure_time. Safe to call concurrently.
+  std::optional<RouteInfo> FindRoute(NameId stop_from, NameId stop_to, double departure_time) const;
+
+  size_t GetStopCount() const { return stop_count_; }
+  size_t GetConnectionCount() const { return connections_.size(); }
+  size_t GetTripCount() const { return trip_bus_ids_.size(); }
+
+  void Save(Snapshot::Writer& writer) const;
+  static std::unique_ptr<TimetableRouter> Load(Snapshot::Reader& reader);
+
+private:
+  TimetableRouter() = default;
+
+  void Build(const std::vector<BusRoute>& bus_routes);
+
+  // A bus of trip_idx going from the stop_idx-th stop of its route to the next one
+  struct Connection {
+    double departure_time;
+    double arrival_time;
+    NameId stop_from;
+    NameId stop_to;
+    uint32_t trip_idx;
+    uint32_t stop_idx;
+  };
+
+  static constexpr uint32_t NO_CONNECTION = UINT32_MAX;
+
+  size_t stop_count_ = 0;
+  double bus_velocity_ = 0;  // km/h
+  std::vector<Connection> connections_;  // by departure time
+  std::vector<NameId> trip_bus_ids_;  // by trip index
+};
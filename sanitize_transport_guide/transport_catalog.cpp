@@ -1,73 +1,439 @@
 #include "transport_catalog.h"
+#include "json_view.h"
+#include "metrics.h"
 
+#include <algorithm>
+#include <fstream>
 #include <sstream>
+#include <stdexcept>
+#include <unordered_map>
+#include <unordered_set>
 
 using namespace std;
 
-TransportCatalog::TransportCatalog(vector<Descriptions::InputQuery> data, const Json::Dict& routing_settings_json) {
+TransportCatalog::TransportCatalog(vector<Descriptions::InputQuery> data, const Json::Dict& routing_settings_json,
+                                   size_t thread_count)
+    : routing_settings_json_(routing_settings_json),
+      thread_count_(thread_count)
+{
+  const Metrics::ScopedTimer timer(Metrics::Phase::CATALOG_BUILD);
   auto stops_end = partition(begin(data), end(data), [](const auto& item) {
     return holds_alternative<Descriptions::Stop>(item);
   });
 
   Descriptions::StopsDict stops_dict;
+  vector<string> stop_names;
   for (const auto& item : Range{begin(data), stops_end}) {
     const auto& stop = get<Descriptions::Stop>(item);
     stops_dict[stop.name] = &stop;
-    stops_.insert({stop.name, {}});
+    stop_names.push_back(stop.name);
   }
+  stop_names_ = NameTable(move(stop_names));
+  stops_.resize(stop_names_.size());
 
   Descriptions::BusesDict buses_dict;
+  vector<string> bus_names;
   for (const auto& item : Range{stops_end, end(data)}) {
     const auto& bus = get<Descriptions::Bus>(item);
-
     buses_dict[bus.name] = &bus;
-    buses_[bus.name] = Bus{
-      bus.stops.size(),
-      ComputeUniqueItemsCount(AsRange(bus.stops)),
-      ComputeRoadRouteLength(bus.stops, stops_dict),
-      ComputeGeoRouteDistance(bus.stops, stops_dict)
-    };
+    bus_names.push_back(bus.name);
+  }
+  bus_names_ = NameTable(move(bus_names));
+
+  stop_positions_.reserve(stop_names_.size());
+  for (const string& stop_name : stop_names_.GetNames()) {
+    stop_positions_.push_back(stops_dict.at(stop_name)->position);
+  }
+  stop_index_ = SpatialIndex(stop_positions_);
+  stop_points_ = Sphere::PointSet(stop_positions_);
+  road_distances_ = RoadDistances(stops_dict, stop_names_);
+  bus_routes_ = MakeBusRoutes(buses_dict, stop_names_, bus_names_, road_distances_, thread_count);
+  FillStopsAndBuses();
+}
+
+void TransportCatalog::BuildDeferred() const {
+  ParallelFor(bus_routes_.size(), thread_count_, [this](size_t bus_id) {
+    GetBusStats(bus_id);
+  });
+  GetRouter();
+  GetTimetableRouter();
+}
+
+void TransportCatalog::FillStopsAndBuses() {
+  buses_.assign(bus_names_.size(), Bus{});
+  bus_stats_flags_ = make_unique<once_flag[]>(bus_names_.size());
+
+  stops_.assign(stop_names_.size(), Stop{});
+  for (const auto& bus_route : bus_routes_) {
+    for (const NameId stop_id : bus_route.stop_ids) {
+      stops_[stop_id].bus_ids.push_back(bus_route.bus_id);
+    }
+  }
+  // Bus ids come in increasing order, so only repeated stops of a bus leave duplicates
+  for (auto& stop : stops_) {
+    stop.bus_ids.erase(unique(begin(stop.bus_ids), end(stop.bus_ids)), end(stop.bus_ids));
+  }
+}
 
-    for (const string& stop_name : bus.stops) {
-      stops_.at(stop_name).bus_names.insert(bus.name);
+// Names left after removals plus names added. id_map receives ids of the old names in the new table,
+// NO_NAME for removed ones. A name both removed and added gets a new id but is not mapped from the old one.
+static NameTable UpdateNames(const NameTable& names,
+                             const vector<string>& removed_names,
+                             const vector<string_view>& added_names,
+                             vector<NameId>& id_map) {
+  unordered_set<string_view> removed;
+  for (const string& name : removed_names) {
+    names.GetId(name);
+    removed.insert(name);
+  }
+  vector<string> new_names;
+  new_names.reserve(names.size() + added_names.size());
+  for (const string& name : names.GetNames()) {
+    if (!removed.count(name)) {
+      new_names.push_back(name);
     }
   }
+  for (const string_view name : added_names) {
+    new_names.emplace_back(name);
+  }
+  NameTable new_table(move(new_names));
 
-  router_ = make_unique<TransportRouter>(stops_dict, buses_dict, routing_settings_json);
+  id_map.assign(names.size(), NO_NAME);
+  for (NameId id = 0; id < names.size(); ++id) {
+    if (!removed.count(names.GetName(id))) {
+      id_map[id] = new_table.GetId(names.GetName(id));
+    }
+  }
+  return new_table;
+}
+
+TransportCatalog TransportCatalog::Update(const Descriptions::Update& update, size_t thread_count) const {
+  TransportCatalog catalog;
+
+  vector<string_view> added_stop_names;
+  for (const auto& stop : update.stops) {
+    added_stop_names.push_back(stop.name);
+  }
+  vector<NameId> stop_id_map;
+  catalog.stop_names_ = UpdateNames(stop_names_, update.removed_stops, added_stop_names, stop_id_map);
+
+  vector<string_view> added_bus_names;
+  for (const auto& bus : update.buses) {
+    added_bus_names.push_back(bus.name);
+  }
+  vector<NameId> bus_id_map;
+  catalog.bus_names_ = UpdateNames(bus_names_, update.removed_buses, added_bus_names, bus_id_map);
+
+  catalog.stop_positions_.resize(catalog.stop_names_.size());
+  vector<RoadDistances::Entry> road_distances;
+  for (NameId stop_id = 0; stop_id < stop_id_map.size(); ++stop_id) {
+    if (stop_id_map[stop_id] != NO_NAME) {
+      catalog.stop_positions_[stop_id_map[stop_id]] = stop_positions_[stop_id];
+    }
+  }
+  for (const auto& entry : road_distances_.GetEntries()) {
+    if (stop_id_map[entry.from] != NO_NAME && stop_id_map[entry.to] != NO_NAME) {
+      road_distances.push_back({stop_id_map[entry.from], stop_id_map[entry.to], entry.distance});
+    }
+  }
+  for (const auto& stop : update.stops) {
+    const NameId stop_id = catalog.stop_names_.GetId(stop.name);
+    catalog.stop_positions_[stop_id] = stop.position;
+    for (const auto& [neighbour_name, distance] : stop.distances) {
+      // As on building, distances to stops without a description can never be asked for
+      if (const auto neighbour_id = catalog.stop_names_.Find(neighbour_name)) {
+        road_distances.push_back({stop_id, *neighbour_id, distance});
+      }
+    }
+  }
+  catalog.stop_index_ = SpatialIndex(catalog.stop_positions_);
+  catalog.stop_points_ = Sphere::PointSet(catalog.stop_positions_);
+  catalog.road_distances_ = RoadDistances(catalog.stop_names_.size(), move(road_distances));
+
+  unordered_map<string_view, const Descriptions::Bus*> updated_buses;
+  for (const auto& bus : update.buses) {
+    updated_buses[bus.name] = &bus;
+  }
+  vector<NameId> previous_bus_ids(catalog.bus_names_.size(), NO_NAME);
+  for (NameId bus_id = 0; bus_id < bus_id_map.size(); ++bus_id) {
+    if (bus_id_map[bus_id] != NO_NAME) {
+      previous_bus_ids[bus_id_map[bus_id]] = bus_id;
+    }
+  }
+  // Only distances from updated stops can change, so other buses keep their distances
+  vector<bool> is_stop_updated(catalog.stop_names_.size());
+  for (const auto& stop : update.stops) {
+    is_stop_updated[catalog.stop_names_.GetId(stop.name)] = true;
+  }
+  catalog.bus_routes_.resize(catalog.bus_names_.size());
+  ParallelFor(catalog.bus_names_.size(), thread_count, [&](size_t bus_id) {
+    const string& bus_name = catalog.bus_names_.GetName(bus_id);
+    vector<NameId> stop_ids;
+    if (const auto it = updated_buses.find(bus_name); it != updated_buses.end()) {
+      for (const string& stop_name : it->second->stops) {
+        stop_ids.push_back(catalog.stop_names_.GetId(stop_name));
+      }
+      catalog.bus_routes_[bus_id] = MakeBusRoute(bus_id, move(stop_ids), it->second->departures,
+                                                 catalog.road_distances_);
+      return;
+    }
+
+    const auto& previous_route = bus_routes_[previous_bus_ids[bus_id]];
+    bool passes_updated_stop = false;
+    for (const NameId stop_id : previous_route.stop_ids) {
+      if (stop_id_map[stop_id] == NO_NAME) {
+        throw invalid_argument("stop " + stop_names_.GetName(stop_id) + " is removed but left on bus " + bus_name);
+      }
+      stop_ids.push_back(stop_id_map[stop_id]);
+      passes_updated_stop = passes_updated_stop || is_stop_updated[stop_ids.back()];
+    }
+    catalog.bus_routes_[bus_id] = passes_updated_stop
+        ? MakeBusRoute(bus_id, move(stop_ids), previous_route.departures, catalog.road_distances_)
+        : BusRoute{static_cast<NameId>(bus_id), move(stop_ids), previous_route.distances_from_start,
+                   previous_route.departures};
+  });
+  catalog.FillStopsAndBuses();
+  catalog.thread_count_ = thread_count;
+
+  catalog.router_ = make_unique<TransportRouter>(
+      GetRouter(), catalog.stop_positions_, catalog.bus_routes_, stop_id_map, bus_id_map, thread_count
+  );
+  catalog.timetable_router_ = make_unique<TimetableRouter>(
+      GetTimetableRouter(), catalog.stop_names_.size(), catalog.bus_routes_
+  );
+  catalog.version_ = version_ + 1;
+  return catalog;
 }
 
 const TransportCatalog::Stop* TransportCatalog::GetStop(const string& name) const {
-  return GetValuePointer(stops_, name);
+  const auto stop_id = stop_names_.Find(name);
+  return stop_id ? &stops_[*stop_id] : nullptr;
 }
 
 const TransportCatalog::Bus* TransportCatalog::GetBus(const string& name) const {
-  return GetValuePointer(buses_, name);
+  const auto bus_id = bus_names_.Find(name);
+  return bus_id ? &GetBusStats(*bus_id) : nullptr;
+}
+
+const TransportCatalog::Bus& TransportCatalog::GetBusStats(NameId bus_id) const {
+  call_once(bus_stats_flags_[bus_id], [this, bus_id] {
+    const auto& bus_route = bus_routes_[bus_id];
+    buses_[bus_id] = Bus{
+      bus_route.stop_ids.size(),
+      ComputeUniqueItemsCount(AsRange(bus_route.stop_ids)),
+      bus_route.GetLength(),
+      stop_points_.ComputeRouteDistance(bus_route.stop_ids)
+    };
+  });
+  return buses_[bus_id];
+}
+
+// A router built or loaded along with the catalog is left as it is
+const TransportRouter& TransportCatalog::GetRouter() const {
+  call_once(*router_flag_, [this] {
+    if (!router_) {
+      router_ = make_unique<TransportRouter>(stop_positions_, bus_routes_, routing_settings_json_, thread_count_);
+    }
+  });
+  return *router_;
+}
+
+const TimetableRouter& TransportCatalog::GetTimetableRouter() const {
+  call_once(*timetable_router_flag_, [this] {
+    if (!timetable_router_) {
+      timetable_router_ = make_unique<TimetableRouter>(stop_names_.size(), bus_routes_, routing_settings_json_);
+    }
+  });
+  return *timetable_router_;
+}
+
+vector<Responses::NearbyStop> TransportCatalog::FindNearestStops(Sphere::Point point, size_t count) const {
+  vector<Responses::NearbyStop> nearby_stops;
+  for (const NameId stop_id : stop_index_.FindNearest(point, count)) {
+    const double distance = Sphere::Distance(point, stop_positions_[stop_id]);
+    // acos rounding gives NaN for coinciding points
+    nearby_stops.push_back({stop_id, distance > 0 ? distance : 0});
+  }
+  return nearby_stops;
+}
+
+const string& TransportCatalog::GetStopName(NameId stop_id) const {
+  return stop_names_.GetName(stop_id);
+}
+
+const string& TransportCatalog::GetBusName(NameId bus_id) const {
+  return bus_names_.GetName(bus_id);
 }
 
 optional<TransportRouter::RouteInfo> TransportCatalog::FindRoute(const string& stop_from, const string& stop_to) const {
-  return router_->FindRoute(stop_from, stop_to);
+  return GetRouter().FindRoute(stop_names_.GetId(stop_from), stop_names_.GetId(stop_to));
 }
 
-int TransportCatalog::ComputeRoadRouteLength(
-    const vector<string>& stops,
-    const Descriptions::StopsDict& stops_dict
-) {
-  int result = 0;
-  for (size_t i = 1; i < stops.size(); ++i) {
-    result += Descriptions::ComputeStopsDistance(*stops_dict.at(stops[i - 1]), *stops_dict.at(stops[i]));
+optional<TimetableRouter::RouteInfo> TransportCatalog::FindTimetableRoute(const string& stop_from,
+                                                                         const string& stop_to,
+                                                                         double departure_time) const {
+  return GetTimetableRouter().FindRoute(stop_names_.GetId(stop_from), stop_names_.GetId(stop_to), departure_time);
+}
+
+TransportRouter::RouteMatrix TransportCatalog::FindRouteMatrix(const vector<string>& stops_from,
+                                                               const vector<string>& stops_to,
+                                                               const vector<pair<size_t, size_t>>& expanded_pairs,
+                                                               size_t thread_count) const {
+  auto get_stop_ids = [this](const vector<string>& stop_names) {
+    vector<NameId> stop_ids;
+    stop_ids.reserve(stop_names.size());
+    for (const string& stop_name : stop_names) {
+      stop_ids.push_back(stop_names_.GetId(stop_name));
+    }
+    return stop_ids;
+  };
+  return GetRouter().FindRouteMatrix(get_stop_ids(stops_from), get_stop_ids(stops_to), expanded_pairs, thread_count);
+}
+
+static void SaveNames(const NameTable& names, Snapshot::Writer& writer) {
+  writer.Write<uint64_t>(names.size());
+  for (const string& name : names.GetNames()) {
+    writer.WriteName(name);
+  }
+}
+
+static NameTable LoadNames(Snapshot::Reader& reader) {
+  vector<string> names(reader.ReadSize(sizeof(uint32_t)));
+  for (string& name : names) {
+    name = reader.ReadName();
+  }
+  // Saved sorted and unique, so that ids stay the same
+  if (adjacent_find(begin(names), end(names), greater_equal<>()) != end(names)) {
+    throw runtime_error("inconsistent snapshot");
+  }
+  return NameTable(move(names));
+}
+
+void TransportCatalog::SaveSnapshot(const string& path) const {
+  const Metrics::ScopedTimer timer(Metrics::Phase::SNAPSHOT_SAVE);
+  // A snapshot holds everything built
+  BuildDeferred();
+  Snapshot::Writer writer;
+
+  SaveNames(stop_names_, writer);
+  for (const auto& stop : stops_) {
+    writer.WriteVector(stop.bus_ids);
+  }
+
+  SaveNames(bus_names_, writer);
+  // Field by field, as Bus has padding
+  for (const auto& bus : buses_) {
+    writer.Write<uint64_t>(bus.stop_count);
+    writer.Write<uint64_t>(bus.unique_stop_count);
+    writer.Write<int32_t>(bus.road_route_length);
+    writer.Write(bus.geo_route_length);
+  }
+
+  writer.Write<uint64_t>(version_);
+  writer.WriteVector(stop_positions_);
+  writer.WriteVector(road_distances_.GetEntries());
+  for (const auto& bus_route : bus_routes_) {
+    writer.WriteVector(bus_route.stop_ids);
+    writer.WriteVector(bus_route.distances_from_start);
+    writer.WriteVector(bus_route.departures);
+  }
+
+  router_->Save(writer);
+  timetable_router_->Save(writer);
+
+  const string data = writer.Finish();
+  ofstream output(path, ios::binary);
+  output.write(data.data(), data.size());
+  if (!output) {
+    throw runtime_error("cannot write snapshot to " + path);
   }
-  return result;
 }
 
-double TransportCatalog::ComputeGeoRouteDistance(
-    const vector<string>& stops,
-    const Descriptions::StopsDict& stops_dict
-) {
-  double result = 0;
-  for (size_t i = 1; i < stops.size(); ++i) {
-    result += Sphere::Distance(
-      stops_dict.at(stops[i - 1])->position, stops_dict.at(stops[i])->position
-    );
+TransportCatalog TransportCatalog::LoadSnapshot(const string& path) {
+  const Metrics::ScopedTimer timer(Metrics::Phase::SNAPSHOT_LOAD);
+  const Json::MappedFile input_file(path);
+  Snapshot::Reader reader(input_file.GetContents());
+  TransportCatalog catalog;
+
+  catalog.stop_names_ = LoadNames(reader);
+  catalog.stops_.resize(catalog.stop_names_.size());
+  for (auto& stop : catalog.stops_) {
+    stop.bus_ids = reader.ReadVector<NameId>();
   }
-  return result;
+
+  catalog.bus_names_ = LoadNames(reader);
+  const size_t stop_count = catalog.stops_.size();
+  const size_t bus_count = catalog.bus_names_.size();
+  catalog.buses_.resize(bus_count);
+  for (auto& bus : catalog.buses_) {
+    bus.stop_count = reader.Read<uint64_t>();
+    bus.unique_stop_count = reader.Read<uint64_t>();
+    bus.road_route_length = reader.Read<int32_t>();
+    bus.geo_route_length = reader.Read<double>();
+  }
+  // Stats come with the snapshot
+  catalog.bus_stats_flags_ = make_unique<once_flag[]>(bus_count);
+  for (NameId bus_id = 0; bus_id < bus_count; ++bus_id) {
+    call_once(catalog.bus_stats_flags_[bus_id], [] {});
+  }
+
+  catalog.version_ = reader.Read<uint64_t>();
+  catalog.stop_positions_ = reader.ReadVector<Sphere::Point>();
+  catalog.stop_index_ = SpatialIndex(catalog.stop_positions_);
+  catalog.stop_points_ = Sphere::PointSet(catalog.stop_positions_);
+  auto road_distances = reader.ReadVector<RoadDistances::Entry>();
+  for (const auto& entry : road_distances) {
+    if (entry.from >= stop_count || entry.to >= stop_count) {
+      throw runtime_error("inconsistent snapshot " + path);
+    }
+  }
+  catalog.road_distances_ = RoadDistances(stop_count, move(road_distances));
+  catalog.bus_routes_.resize(bus_count);
+  for (NameId bus_id = 0; bus_id < bus_count; ++bus_id) {
+    auto& bus_route = catalog.bus_routes_[bus_id];
+    bus_route.bus_id = bus_id;
+    bus_route.stop_ids = reader.ReadVector<NameId>();
+    bus_route.distances_from_start = reader.ReadVector<int>();
+    bus_route.departures = reader.ReadVector<int>();
+    for (const NameId stop_id : bus_route.stop_ids) {
+      if (stop_id >= stop_count) {
+        throw runtime_error("inconsistent snapshot " + path);
+      }
+    }
+    if (bus_route.distances_from_start.size() != bus_route.stop_ids.size()) {
+      throw runtime_error("inconsistent snapshot " + path);
+    }
+  }
+
+  catalog.router_ = TransportRouter::Load(reader);
+  catalog.timetable_router_ = TimetableRouter::Load(reader);
+  if (catalog.stop_positions_.size() != stop_count || catalog.router_->GetStopCount() != stop_count
+      || catalog.timetable_router_->GetStopCount() != stop_count || !reader.IsAtEnd()) {
+    throw runtime_error("inconsistent snapshot " + path);
+  }
+  for (const auto& stop : catalog.stops_) {
+    for (const NameId bus_id : stop.bus_ids) {
+      if (bus_id >= catalog.buses_.size()) {
+        throw runtime_error("inconsistent snapshot " + path);
+      }
+    }
+  }
+  return catalog;
+}
+
+VersionedCatalog::VersionedCatalog(TransportCatalog catalog)
+    : catalog_(make_shared<const TransportCatalog>(move(catalog)))
+{
+}
+
+shared_ptr<const TransportCatalog> VersionedCatalog::Get() const {
+  return atomic_load(&catalog_);
+}
+
+size_t VersionedCatalog::Update(const Descriptions::Update& update, size_t thread_count) {
+  lock_guard guard(update_mutex_);
+  auto catalog = make_shared<const TransportCatalog>(Get()->Update(update, thread_count));
+  const size_t version = catalog->GetVersion();
+  atomic_store(&catalog_, shared_ptr<const TransportCatalog>(move(catalog)));
+  return version;
 }
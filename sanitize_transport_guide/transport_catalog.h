@@ -2,19 +2,26 @@
 
 #include "descriptions.h"
 #include "json.h"
+#include "name_table.h"
+#include "road_network.h"
+#include "snapshot.h"
+#include "spatial_index.h"
+#include "sphere.h"
+#include "timetable_router.h"
 #include "transport_router.h"
 #include "utils.h"
 
+#include <memory>
+#include <mutex>
 #include <optional>
-#include <set>
 #include <string>
-#include <unordered_map>
+#include <utility>
 #include <variant>
 #include <vector>
 
 namespace Responses {
   struct Stop {
-    std::set<std::string> bus_names;
+    std::vector<NameId> bus_ids;  // sorted, so bus names go in alphabetical order
   };
 
   struct Bus {
@@ -23,6 +30,11 @@ namespace Responses {
     int road_route_length = 0;
     double geo_route_length = 0.0;
   };
+
+  struct NearbyStop {
+    NameId stop_id;
+    double distance;  // great-circle, in meters
+  };
 }
 
 class TransportCatalog {
@@ -31,27 +43,105 @@ private:
   using Stop = Responses::Stop;
 
 public:
-  TransportCatalog(std::vector<Descriptions::InputQuery> data, const Json::Dict& routing_settings_json);
+  // Bus routes and the router graph are built on thread_count threads. Stats of a bus are computed
+  // on the first request for it and routers on the first route request, so a catalog is ready to answer
+  // a few requests long before it could answer all of them. All of that is safe for concurrent readers.
+  // Only unique stop counts, geo lengths and the routers are deferred: road distances of every bus are
+  // still resolved into prefix sums here, so that a missing distance throws std::out_of_range on building
+  // rather than on some later request, and updates and snapshots always have them at hand.
+  TransportCatalog(std::vector<Descriptions::InputQuery> data, const Json::Dict& routing_settings_json,
+                   size_t thread_count = 1);
+
+  // Computes now what is left for first requests, so that none of them waits for it
+  void BuildDeferred() const;
 
   const Stop* GetStop(const std::string& name) const;
   const Bus* GetBus(const std::string& name) const;
 
+  // Up to count stops closest to point, closest first
+  std::vector<Responses::NearbyStop> FindNearestStops(Sphere::Point point, size_t count) const;
+
+  const std::string& GetStopName(NameId stop_id) const;
+  const std::string& GetBusName(NameId bus_id) const;
+
+  // Throws std::out_of_range for unknown stops
   std::optional<TransportRouter::RouteInfo> FindRoute(const std::string& stop_from, const std::string& stop_to) const;
 
+  // Travel times between every stop of stops_from and every stop of stops_to, with items
+  // for expanded_pairs of (source, target) indices only; see TransportRouter::FindRouteMatrix.
+  // Throws std::out_of_range for unknown stops.
+  TransportRouter::RouteMatrix FindRouteMatrix(const std::vector<std::string>& stops_from,
+                                               const std::vector<std::string>& stops_to,
+                                               const std::vector<std::pair<size_t, size_t>>& expanded_pairs,
+                                               size_t thread_count = 1) const;
+
+  // Earliest arrival by bus departures for leaving stop_from at departure_time, in minutes after midnight.
+  // Throws std::out_of_range for unknown stops.
+  std::optional<TimetableRouter::RouteInfo> FindTimetableRoute(const std::string& stop_from,
+                                                               const std::string& stop_to,
+                                                               double departure_time) const;
+
   std::string RenderMap() const;
 
+  // New version of the catalog with the changes applied; this one is left as it is, so that it can
+  // still be read meanwhile. Only buses that are updated or pass an updated stop get their distances
+  // looked up anew, and only routes the changes may affect are searched anew, see TransportRouter;
+  // routers of this catalog are built first if they have not been, as the new ones are made from them.
+  // Throws std::out_of_range for unknown stops and std::invalid_argument for removed stops left on buses.
+  TransportCatalog Update(const Descriptions::Update& update, size_t thread_count = 1) const;
+
+  // Number of updates the catalog has gone through since it was built
+  size_t GetVersion() const { return version_; }
+
+  // Writes the built catalog with its router to a binary file,
+  // so that it can be loaded without parsing and building everything again
+  void SaveSnapshot(const std::string& path) const;
+  static TransportCatalog LoadSnapshot(const std::string& path);
+
+private:
+  TransportCatalog() = default;
+
+  // Fills stops_ from bus_routes_ and leaves every bus to have its stats computed
+  void FillStopsAndBuses();
+
+  const Bus& GetBusStats(NameId bus_id) const;
+  const TransportRouter& GetRouter() const;
+  const TimetableRouter& GetTimetableRouter() const;
+
+  NameTable stop_names_;
+  NameTable bus_names_;
+  std::vector<Stop> stops_;  // indexed by stop id
+  mutable std::vector<Bus> buses_;  // indexed by bus id, each filled in under its flag
+  std::unique_ptr<std::once_flag[]> bus_stats_flags_;  // indexed by bus id
+  // What the catalog is built from, kept for updates
+  std::vector<Sphere::Point> stop_positions_;  // indexed by stop id
+  RoadDistances road_distances_;
+  std::vector<BusRoute> bus_routes_;  // indexed by bus id
+  SpatialIndex stop_index_;  // over stop_positions_
+  Sphere::PointSet stop_points_;  // over stop_positions_, for geo lengths of buses
+  // Settings for building the routers, if the catalog did not get them built or loaded
+  Json::Dict routing_settings_json_;
+  size_t thread_count_ = 1;
+  // Filled in under their flags, the pointers to flags keep the catalog movable
+  mutable std::unique_ptr<TransportRouter> router_;
+  mutable std::unique_ptr<TimetableRouter> timetable_router_;
+  std::unique_ptr<std::once_flag> router_flag_ = std::make_unique<std::once_flag>();
+  std::unique_ptr<std::once_flag> timetable_router_flag_ = std::make_unique<std::once_flag>();
+  size_t version_ = 0;
+};
+
+// Catalog updated while being read. Readers take the current version and may keep it as long as they need;
+// an update builds the next version aside and then publishes it at once.
+class VersionedCatalog {
+public:
+  explicit VersionedCatalog(TransportCatalog catalog);
+
+  std::shared_ptr<const TransportCatalog> Get() const;
+
+  // Updates go one at a time. Returns the version published.
+  size_t Update(const Descriptions::Update& update, size_t thread_count = 1);
+
 private:
-  static int ComputeRoadRouteLength(
-      const std::vector<std::string>& stops,
-      const Descriptions::StopsDict& stops_dict
-  );
-
-  static double ComputeGeoRouteDistance(
-      const std::vector<std::string>& stops,
-      const Descriptions::StopsDict& stops_dict
-  );
-
-  std::unordered_map<std::string, Stop> stops_;
-  std::unordered_map<std::string, Bus> buses_;
-  std::unique_ptr<TransportRouter> router_;
+  std::mutex update_mutex_;
+  std::shared_ptr<const TransportCatalog> catalog_;
 };
@@ -0,0 +1,435 @@
+#include "descriptions.h"
+#include "json_writer.h"
+#include "name_table.h"
+#include "requests.h"
+#include "road_network.h"
+#include "sphere.h"
+#include "test_utils.h"
+#include "transport_catalog.h"
+#include "transport_router.h"
+
+#include "test_runner.h"
+
+#include <algorithm>
+#include <cmath>
+#include <iomanip>
+#include <memory>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <variant>
+#include <vector>
+
+using namespace std;
+
+namespace {
+  // SAMPLE_INPUT with the changes of UPDATE_DESCRIPTIONS, written out in full
+  const string UPDATED_INPUT = R"({
+    "routing_settings": {"bus_wait_time": 6, "bus_velocity": 40},
+    "base_requests": [
+      {"type": "Bus", "name": "297", "stops": ["Biryulyovo Zapadnoye", "Biryulyovo Tovarnaya", "Universam",
+        "Biryulyovo Zapadnoye"], "is_roundtrip": true, "departures": [360, 400, 1200]},
+      {"type": "Bus", "name": "750", "stops": ["Universam", "Tsaritsyno", "Prazhskaya"],
+        "is_roundtrip": false, "departures": [390, 420]},
+      {"type": "Stop", "name": "Biryulyovo Zapadnoye", "latitude": 55.574371, "longitude": 37.6517,
+        "road_distances": {"Biryulyovo Tovarnaya": 2600}},
+      {"type": "Stop", "name": "Universam", "latitude": 55.587655, "longitude": 37.645687,
+        "road_distances": {"Prazhskaya": 4000, "Biryulyovo Tovarnaya": 1380, "Biryulyovo Zapadnoye": 2500,
+          "Tsaritsyno": 1500}},
+      {"type": "Stop", "name": "Biryulyovo Tovarnaya", "latitude": 55.592028, "longitude": 37.653656,
+        "road_distances": {"Universam": 890}},
+      {"type": "Stop", "name": "Prazhskaya", "latitude": 55.611717, "longitude": 37.603938, "road_distances": {}},
+      {"type": "Stop", "name": "Tsaritsyno", "latitude": 55.6, "longitude": 37.63,
+        "road_distances": {"Prazhskaya": 3000}}
+    ],
+    "stat_requests": [
+      {"type": "Bus", "name": "297", "id": 1},
+      {"type": "Bus", "name": "635", "id": 2},
+      {"type": "Bus", "name": "750", "id": 3},
+      {"type": "Stop", "name": "Universam", "id": 4},
+      {"type": "Stop", "name": "Lonely", "id": 5},
+      {"type": "Stop", "name": "Tsaritsyno", "id": 6},
+      {"type": "Route", "from": "Biryulyovo Zapadnoye", "to": "Universam", "id": 7},
+      {"type": "Route", "from": "Biryulyovo Zapadnoye", "to": "Prazhskaya", "id": 8},
+      {"type": "Route", "from": "Prazhskaya", "to": "Biryulyovo Tovarnaya", "id": 9},
+      {"type": "Route", "from": "Tsaritsyno", "to": "Biryulyovo Zapadnoye", "id": 10},
+      {"type": "NearestStops", "latitude": 55.59, "longitude": 37.65, "count": 3, "id": 11},
+      {"type": "TimetableRoute", "from": "Biryulyovo Zapadnoye", "to": "Prazhskaya", "departure_time": 380,
+        "id": 12}
+    ]
+  })";
+
+  // Valid for the catalog both before and after the changes, with different responses
+  const string BUS_REQUESTS = R"({"stat_requests": [
+    {"type": "Bus", "name": "297", "id": 1},
+    {"type": "Bus", "name": "635", "id": 2},
+    {"type": "Bus", "name": "750", "id": 3}
+  ]})";
+
+  // Changes a distance of Universam, adds Tsaritsyno and bus 750, removes bus 635 and Lonely
+  const string UPDATE_DESCRIPTIONS = R"([
+    {"type": "Stop", "name": "Universam", "latitude": 55.587655, "longitude": 37.645687,
+      "road_distances": {"Prazhskaya": 4000, "Tsaritsyno": 1500}},
+    {"type": "Stop", "name": "Tsaritsyno", "latitude": 55.6, "longitude": 37.63,
+      "road_distances": {"Prazhskaya": 3000}},
+    {"type": "Bus", "name": "750", "stops": ["Universam", "Tsaritsyno", "Prazhskaya"],
+      "is_roundtrip": false, "departures": [390, 420]}
+  ])";
+
+  Descriptions::Update MakeUpdate(const string& descriptions_json,
+                                  vector<string> removed_stops, vector<string> removed_buses) {
+    Descriptions::Update update;
+    for (auto& description : Descriptions::ReadDescriptions(LoadJson(descriptions_json).GetRoot().AsArray())) {
+      if (auto* stop = get_if<Descriptions::Stop>(&description)) {
+        update.stops.push_back(move(*stop));
+      } else {
+        update.buses.push_back(move(get<Descriptions::Bus>(description)));
+      }
+    }
+    update.removed_stops = move(removed_stops);
+    update.removed_buses = move(removed_buses);
+    return update;
+  }
+
+  // Every router setup takes over a different part of the previous router
+  const vector<Json::Dict> UPDATE_SETTINGS = {
+      {},
+      {{"precompute_routes", Json::Node(true)}},
+      {{"graph_model", Json::Node(string("rides"))}, {"precompute_routes", Json::Node(true)}},
+      {{"graph_model", Json::Node(string("rides"))}, {"route_search", Json::Node(string("contraction_hierarchies"))}},
+      {{"route_search", Json::Node(string("bidirectional_a_star"))}, {"route_cache_size", Json::Node(16)}},
+  };
+
+  void TestUpdateMatchesRebuild() {
+    const auto update = MakeUpdate(UPDATE_DESCRIPTIONS, {"Lonely"}, {"635"});
+    for (const auto& settings : UPDATE_SETTINGS) {
+      const TransportCatalog db = BuildCatalog(SAMPLE_INPUT, settings);
+      // Routes found before the update are cached, so the updated router has something to take over
+      const string responses_before = AnswerRequests(db, SAMPLE_INPUT);
+
+      const TransportCatalog updated_db = db.Update(update);
+      ASSERT_EQUAL(updated_db.GetVersion(), 1u);
+      ASSERT_EQUAL(AnswerRequests(updated_db, UPDATED_INPUT),
+                   AnswerRequests(BuildCatalog(UPDATED_INPUT, settings), UPDATED_INPUT));
+      ASSERT_EQUAL(AnswerRequests(db, SAMPLE_INPUT), responses_before);
+      ASSERT(AnswerRequests(updated_db, BUS_REQUESTS) != AnswerRequests(db, BUS_REQUESTS));
+    }
+  }
+
+  void TestUpdateWithThreadsMatchesRebuild() {
+    const auto update = MakeUpdate(UPDATE_DESCRIPTIONS, {"Lonely"}, {"635"});
+    const TransportCatalog db = BuildCatalog(SAMPLE_INPUT, UPDATE_SETTINGS[2]);
+    ASSERT_EQUAL(AnswerRequests(db.Update(update, 4), UPDATED_INPUT),
+                 AnswerRequests(BuildCatalog(UPDATED_INPUT, UPDATE_SETTINGS[2]), UPDATED_INPUT));
+  }
+
+  void TestUpdatesAddUp() {
+    const TransportCatalog db = BuildCatalog(SAMPLE_INPUT);
+    const auto first_update = MakeUpdate(UPDATE_DESCRIPTIONS, {}, {"635"});
+    const auto second_update = MakeUpdate("[]", {"Lonely"}, {});
+    const TransportCatalog updated_db = db.Update(first_update).Update(second_update);
+    ASSERT_EQUAL(updated_db.GetVersion(), 2u);
+    ASSERT_EQUAL(AnswerRequests(updated_db, UPDATED_INPUT),
+                 AnswerRequests(BuildCatalog(UPDATED_INPUT), UPDATED_INPUT));
+  }
+
+  void TestBadUpdateThrows() {
+    const TransportCatalog db = BuildCatalog(SAMPLE_INPUT);
+    ASSERT_THROWS(db.Update(MakeUpdate("[]", {"Universam"}, {})), invalid_argument);
+    ASSERT_THROWS(db.Update(MakeUpdate("[]", {"Tsaritsyno"}, {})), out_of_range);
+    ASSERT_THROWS(db.Update(MakeUpdate("[]", {}, {"750"})), out_of_range);
+    ASSERT_THROWS(db.Update(MakeUpdate(R"([{"type": "Bus", "name": "750", "stops": ["Universam", "Tsaritsyno"],
+                                           "is_roundtrip": false}])", {}, {})),
+                  out_of_range);
+    // A failed update leaves the catalog as it was
+    ASSERT_EQUAL(AnswerRequests(db, SAMPLE_INPUT), AnswerRequests(BuildCatalog(SAMPLE_INPUT), SAMPLE_INPUT));
+  }
+
+  // Models and searches promising the total times of Dijkstra over the STOP_PAIRS graph
+  const vector<Json::Dict> ROUTE_SEARCH_SETTINGS = {
+      {{"graph_model", Json::Node(string("rides"))}},
+      {{"route_search", Json::Node(string("bidirectional_a_star"))}},
+      {{"route_search", Json::Node(string("contraction_hierarchies"))}},
+      {{"graph_model", Json::Node(string("rides"))}, {"route_search", Json::Node(string("bidirectional_a_star"))}},
+      {{"graph_model", Json::Node(string("rides"))}, {"route_search", Json::Node(string("contraction_hierarchies"))}},
+  };
+
+  vector<string> GetStopNames(const string& input) {
+    vector<string> stop_names;
+    for (const auto& description : Descriptions::ReadInputDocument(input).descriptions) {
+      if (const auto* stop = get_if<Descriptions::Stop>(&description)) {
+        stop_names.push_back(stop->name);
+      }
+    }
+    return stop_names;
+  }
+
+  // Router over the stops and buses of input, built as the catalog builds it
+  unique_ptr<TransportRouter> BuildRouter(const string& input, const Json::Dict& settings) {
+    auto input_doc = Descriptions::ReadInputDocument(input);
+    Descriptions::StopsDict stops_dict;
+    Descriptions::BusesDict buses_dict;
+    vector<string> stop_names;
+    vector<string> bus_names;
+    for (const auto& description : input_doc.descriptions) {
+      if (const auto* stop = get_if<Descriptions::Stop>(&description)) {
+        stops_dict[stop->name] = stop;
+        stop_names.push_back(stop->name);
+      } else {
+        const auto& bus = get<Descriptions::Bus>(description);
+        buses_dict[bus.name] = &bus;
+        bus_names.push_back(bus.name);
+      }
+    }
+    const NameTable stop_table(move(stop_names));
+    const NameTable bus_table(move(bus_names));
+    vector<Sphere::Point> stop_positions;
+    for (const string& stop_name : stop_table.GetNames()) {
+      stop_positions.push_back(stops_dict.at(stop_name)->position);
+    }
+    Json::Dict routing_settings = input_doc.sections.at("routing_settings").AsMap();
+    for (const auto& [key, value] : settings) {
+      routing_settings[key] = value;
+    }
+    const auto bus_routes = MakeBusRoutes(buses_dict, stop_table, bus_table, RoadDistances(stops_dict, stop_table));
+    return make_unique<TransportRouter>(stop_positions, bus_routes, routing_settings);
+  }
+
+  void CheckRouteSearchesMatchDijkstra(const string& input) {
+    const auto stop_names = GetStopNames(input);
+    // A search from every stop, which is Dijkstra over the STOP_PAIRS graph whatever the route_search setting
+    const auto expected_times = BuildCatalog(input).FindRouteMatrix(stop_names, stop_names, {}).total_times;
+    for (size_t settings_idx = 0; settings_idx < ROUTE_SEARCH_SETTINGS.size(); ++settings_idx) {
+      const TransportCatalog db = BuildCatalog(input, ROUTE_SEARCH_SETTINGS[settings_idx]);
+      for (size_t from_idx = 0; from_idx < stop_names.size(); ++from_idx) {
+        for (size_t to_idx = 0; to_idx < stop_names.size(); ++to_idx) {
+          const auto& expected_time = expected_times[from_idx][to_idx];
+          const auto route = db.FindRoute(stop_names[from_idx], stop_names[to_idx]);
+          const string hint = stop_names[from_idx] + " -> " + stop_names[to_idx]
+              + " with settings " + to_string(settings_idx);
+          AssertEqual(route.has_value(), expected_time.has_value(), hint);
+          if (route) {
+            // Sums of the same times in another order may differ in the last digits
+            AssertEqual(abs(route->total_time - *expected_time) < 1e-9 * (1 + *expected_time), true, hint);
+          }
+        }
+      }
+    }
+  }
+
+  void TestRouteSearchesMatchDijkstraOnSample() {
+    CheckRouteSearchesMatchDijkstra(SAMPLE_INPUT);
+  }
+
+  // Few short buses leave a small core, so queries go through the hierarchy
+  void TestRouteSearchesMatchDijkstraWithHierarchy() {
+    const string input = MakeRandomInput(120, 12, 15, 1);
+    ASSERT(BuildRouter(input, ROUTE_SEARCH_SETTINGS[4])->HasHierarchy());
+    CheckRouteSearchesMatchDijkstra(input);
+  }
+
+  // Many long buses make the STOP_PAIRS graph dense, so most of it is left in the core and Dijkstra goes instead
+  void TestRouteSearchesMatchDijkstraWithBigCore() {
+    const string input = MakeRandomInput(100, 20, 40, 2);
+    ASSERT(!BuildRouter(input, ROUTE_SEARCH_SETTINGS[2])->HasHierarchy());
+    CheckRouteSearchesMatchDijkstra(input);
+  }
+
+  // Response to a single request. Json::Node has no null, so the nulls of missing routes in a
+  // RouteMatrix response come as -1.
+  Json::Node Ask(const TransportCatalog& db, const string& request) {
+    string response;
+    Json::Writer writer(response);
+    Requests::Process(db, LoadJson(request).GetRoot(), writer);
+    for (size_t pos; (pos = response.find("null")) != string::npos;) {
+      response.replace(pos, 4, "-1");
+    }
+    return LoadJson(response).GetRoot();
+  }
+
+  // Responses print doubles with 6 significant digits
+  bool IsClose(double lhs, double rhs) {
+    return abs(lhs - rhs) <= 1e-5 * max(1.0, abs(rhs));
+  }
+
+  string MakeStrings(const vector<string>& strings) {
+    string result;
+    Json::Writer writer(result);
+    writer.BeginArray();
+    for (const string& item : strings) {
+      writer.String(item);
+    }
+    writer.EndArray();
+    return result;
+  }
+
+  void TestRouteMatrixMatchesRoutes() {
+    const string input = MakeRandomInput(40, 8, 10, 3);
+    const vector<string> stops_from = {"Stop 0", "Stop 7", "Stop 13", "Stop 7"};
+    const vector<string> stops_to = {"Stop 1", "Stop 0", "Stop 22", "Stop 31", "Stop 39"};
+    // The matrix is Dijkstra whatever the settings, routes follow them
+    for (const auto& settings : {Json::Dict{}, ROUTE_SEARCH_SETTINGS[4]}) {
+      const TransportCatalog db = BuildCatalog(input, settings);
+      const auto response = Ask(db, R"({"type": "RouteMatrix", "id": 5, "from": )" + MakeStrings(stops_from)
+          + R"(, "to": )" + MakeStrings(stops_to) + R"(, "routes": [{"from": "Stop 7", "to": "Stop 39"},
+             {"from": "Stop 13", "to": "Stop 0"}, {"from": "Stop 0", "to": "Stop 0"}]})").AsMap();
+      ASSERT_EQUAL(response.at("request_id").AsInt(), 5);
+
+      const auto& total_times = response.at("total_times").AsArray();
+      ASSERT_EQUAL(total_times.size(), stops_from.size());
+      for (size_t from_idx = 0; from_idx < stops_from.size(); ++from_idx) {
+        const auto& row = total_times[from_idx].AsArray();
+        ASSERT_EQUAL(row.size(), stops_to.size());
+        for (size_t to_idx = 0; to_idx < stops_to.size(); ++to_idx) {
+          const auto route = db.FindRoute(stops_from[from_idx], stops_to[to_idx]);
+          const double total_time = row[to_idx].AsDouble();
+          ASSERT(route ? IsClose(total_time, route->total_time) : total_time == -1);
+        }
+      }
+
+      const auto& routes = response.at("routes").AsArray();
+      ASSERT_EQUAL(routes.size(), 3u);
+      for (const auto& route_node : routes) {
+        const auto& route_response = route_node.AsMap();
+        const auto route = db.FindRoute(route_response.at("from").AsString(), route_response.at("to").AsString());
+        ASSERT_EQUAL(route_response.count("error_message"), route ? 0u : 1u);
+        if (route) {
+          ASSERT(IsClose(route_response.at("total_time").AsDouble(), route->total_time));
+          ASSERT_EQUAL(route_response.at("items").AsArray().size(), route->items.size());
+        }
+      }
+    }
+  }
+
+  void TestRouteMatrixWithUnknownStops() {
+    const TransportCatalog db = BuildCatalog(SAMPLE_INPUT);
+    for (const string request : {
+             R"({"type": "RouteMatrix", "id": 3, "from": ["Universam", "Moon"], "to": ["Prazhskaya"]})",
+             R"({"type": "RouteMatrix", "id": 3, "from": ["Universam"], "to": ["Prazhskaya"],
+                 "routes": [{"from": "Prazhskaya", "to": "Universam"}]})"}) {
+      const auto response = Ask(db, request).AsMap();
+      ASSERT_EQUAL(response.at("error_message").AsString(), "not found");
+      ASSERT_EQUAL(response.at("request_id").AsInt(), 3);
+    }
+  }
+
+  void TestNearestStopsMatchBruteForce() {
+    const string input = MakeRandomInput(300, 10, 10, 4);
+    const TransportCatalog db = BuildCatalog(input);
+    vector<pair<string, Sphere::Point>> stops;
+    for (const auto& description : Descriptions::ReadInputDocument(input).descriptions) {
+      if (const auto* stop = get_if<Descriptions::Stop>(&description)) {
+        stops.emplace_back(stop->name, stop->position);
+      }
+    }
+    // Json::Load reads no exponents, so points stay close enough for distances below a million meters
+    const vector<Sphere::Point> points = {{55.7, 37.6}, {55.5, 37.3}, {55.91, 37.95}, {54.0, 36.0}};
+    for (const auto& point : points) {
+      vector<pair<double, string>> expected_stops;
+      for (const auto& [name, position] : stops) {
+        expected_stops.emplace_back(Sphere::Distance(point, position), name);
+      }
+      sort(begin(expected_stops), end(expected_stops));
+      for (const int count : {0, 1, 7, 300, 301}) {
+        ostringstream request;
+        request << setprecision(17) << R"({"type": "NearestStops", "id": 1, "latitude": )" << point.latitude
+                << R"(, "longitude": )" << point.longitude << R"(, "count": )" << count << "}";
+        const auto response_stops = Ask(db, request.str()).AsMap().at("stops").AsArray();
+        ASSERT_EQUAL(response_stops.size(), min<size_t>(count, stops.size()));
+        for (size_t idx = 0; idx < response_stops.size(); ++idx) {
+          const auto& stop = response_stops[idx].AsMap();
+          ASSERT_EQUAL(stop.at("name").AsString(), expected_stops[idx].second);
+          ASSERT(IsClose(stop.at("distance").AsDouble(), expected_stops[idx].first));
+        }
+      }
+    }
+  }
+
+  void TestNegativeNearestStopsCountIsRejected() {
+    const TransportCatalog db = BuildCatalog(SAMPLE_INPUT);
+    const auto response = Ask(db, R"({"type": "NearestStops", "id": 8, "latitude": 55.6, "longitude": 37.6,
+                                      "count": -1})").AsMap();
+    ASSERT_EQUAL(response.at("error_message").AsString(), "bad request");
+    ASSERT_EQUAL(response.at("request_id").AsInt(), 8);
+  }
+
+  void TestPointRouteGoesBetweenNearestStops() {
+    const TransportCatalog db = BuildCatalog(SAMPLE_INPUT);
+    // Close to Biryulyovo Zapadnoye and to Prazhskaya
+    const auto response = Ask(db, R"({"type": "PointRoute", "id": 2,
+        "from": {"latitude": 55.5744, "longitude": 37.6516}, "to": {"latitude": 55.61, "longitude": 37.605}})").AsMap();
+    ASSERT_EQUAL(response.at("stop_from").AsString(), "Biryulyovo Zapadnoye");
+    ASSERT_EQUAL(response.at("stop_to").AsString(), "Prazhskaya");
+    const auto route = db.FindRoute("Biryulyovo Zapadnoye", "Prazhskaya");
+    ASSERT(IsClose(response.at("total_time").AsDouble(), route->total_time));
+    ASSERT_EQUAL(response.at("items").AsArray().size(), route->items.size());
+
+    // Nearest to Lonely, which no bus stops at
+    const auto lonely_response = Ask(db, R"({"type": "PointRoute", "id": 3,
+        "from": {"latitude": -55, "longitude": -37}, "to": {"latitude": 55.61, "longitude": 37.605}})").AsMap();
+    ASSERT_EQUAL(lonely_response.at("error_message").AsString(), "not found");
+  }
+
+  // A to C by bus 1, changing at B to bus 2 for D. At 60 km/h a bus goes a kilometer a minute.
+  const string TIMETABLE_INPUT = R"({
+    "routing_settings": {"bus_wait_time": 6, "bus_velocity": 60},
+    "base_requests": [
+      {"type": "Bus", "name": "1", "stops": ["A", "B", "C"], "is_roundtrip": false, "departures": [600, 620]},
+      {"type": "Bus", "name": "2", "stops": ["B", "D"], "is_roundtrip": false, "departures": [601, 603]},
+      {"type": "Stop", "name": "A", "latitude": 55.60, "longitude": 37.60, "road_distances": {"B": 2000}},
+      {"type": "Stop", "name": "B", "latitude": 55.61, "longitude": 37.61, "road_distances": {"C": 3000, "D": 4000}},
+      {"type": "Stop", "name": "C", "latitude": 55.62, "longitude": 37.62, "road_distances": {}},
+      {"type": "Stop", "name": "D", "latitude": 55.63, "longitude": 37.63, "road_distances": {}}
+    ],
+    "stat_requests": []
+  })";
+
+  void TestTimetableRouteArrivals() {
+    const TransportCatalog db = BuildCatalog(TIMETABLE_INPUT);
+    // Bus 1 leaves A at 600 and is at B at 602, too late for bus 2 of 601 but in time for that of 603,
+    // which comes to D at 607
+    const auto response = Ask(db, R"({"type": "TimetableRoute", "id": 1, "from": "A", "to": "D",
+                                      "departure_time": 595})").AsMap();
+    ASSERT(IsClose(response.at("arrival_time").AsDouble(), 607));
+    ASSERT(IsClose(response.at("total_time").AsDouble(), 12));
+    vector<string> items;
+    for (const auto& item_node : response.at("items").AsArray()) {
+      const auto& item = item_node.AsMap();
+      ostringstream item_text;
+      item_text << item.at("type").AsString() << " "
+                << (item.count("bus") ? item.at("bus").AsString() : item.at("stop_name").AsString())
+                << " " << item.at("time").AsDouble();
+      items.push_back(item_text.str());
+    }
+    ASSERT_EQUAL(items, (vector<string>{"Wait A 5", "Bus 1 2", "Wait B 1", "Bus 2 4"}));
+
+    // Bus 1 of 600 goes on from B to C, 3 minutes more
+    const auto direct_response = Ask(db, R"({"type": "TimetableRoute", "id": 2, "from": "A", "to": "C",
+                                             "departure_time": 600})").AsMap();
+    ASSERT(IsClose(direct_response.at("arrival_time").AsDouble(), 605));
+    // Bus 1 of 620 comes to B after the last bus 2
+    const auto late_response = Ask(db, R"({"type": "TimetableRoute", "id": 3, "from": "A", "to": "D",
+                                           "departure_time": 601})").AsMap();
+    ASSERT_EQUAL(late_response.at("error_message").AsString(), "not found");
+    // Back from C by the trip of 620, which turns there at 625 and is at A at 630
+    const auto back_response = Ask(db, R"({"type": "TimetableRoute", "id": 4, "from": "C", "to": "A",
+                                           "departure_time": 606})").AsMap();
+    ASSERT(IsClose(back_response.at("arrival_time").AsDouble(), 630));
+  }
+}
+
+void TestTransportCatalog(TestRunner& tr) {
+  RUN_TEST(tr, TestUpdateMatchesRebuild);
+  RUN_TEST(tr, TestUpdateWithThreadsMatchesRebuild);
+  RUN_TEST(tr, TestUpdatesAddUp);
+  RUN_TEST(tr, TestBadUpdateThrows);
+  RUN_TEST(tr, TestRouteSearchesMatchDijkstraOnSample);
+  RUN_TEST(tr, TestRouteSearchesMatchDijkstraWithHierarchy);
+  RUN_TEST(tr, TestRouteSearchesMatchDijkstraWithBigCore);
+  RUN_TEST(tr, TestRouteMatrixMatchesRoutes);
+  RUN_TEST(tr, TestRouteMatrixWithUnknownStops);
+  RUN_TEST(tr, TestNearestStopsMatchBruteForce);
+  RUN_TEST(tr, TestNegativeNearestStopsCountIsRejected);
+  RUN_TEST(tr, TestPointRouteGoesBetweenNearestStops);
+  RUN_TEST(tr, TestTimetableRouteArrivals);
+}
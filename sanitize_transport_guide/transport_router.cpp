@@ -1,113 +1,765 @@
 #include "transport_router.h"
+#include "graph_snapshot.h"
+#include "metrics.h"
+
+#include <algorithm>
+#include <cassert>
+#include <iterator>
+#include <limits>
+#include <stdexcept>
+#include <tuple>
+#include <unordered_map>
 
 using namespace std;
 
 
-TransportRouter::TransportRouter(const Descriptions::StopsDict& stops_dict,
-                                 const Descriptions::BusesDict& buses_dict,
-                                 const Json::Dict& routing_settings_json)
-    : routing_settings_(MakeRoutingSettings(routing_settings_json))
+TransportRouter::TransportRouter(const vector<Sphere::Point>& stop_positions,
+                                 const vector<BusRoute>& bus_routes,
+                                 const Json::Dict& routing_settings_json,
+                                 size_t thread_count)
+    : routing_settings_(MakeRoutingSettings(routing_settings_json)),
+      stop_count_(stop_positions.size())
 {
-  const size_t vertex_count = stops_dict.size() * 2;
-  vertices_info_.resize(vertex_count);
-  graph_ = BusGraph(vertex_count);
+  const Metrics::ScopedTimer timer(Metrics::Phase::ROUTER_INIT);
+  BuildGraph(stop_positions, bus_routes, thread_count);
+  if (routing_settings_.precompute_routes) {
+    PrecomputeRoutes();
+  }
+  if (routing_settings_.route_search == RouteSearch::CONTRACTION_HIERARCHIES) {
+    BuildHierarchy();
+  }
+  if (routing_settings_.route_cache_size > 0) {
+    route_cache_ = make_unique<RouteCache>(routing_settings_.route_cache_size);
+  }
+}
 
-  FillGraphWithStops(stops_dict);
-  FillGraphWithBuses(stops_dict, buses_dict);
+TransportRouter::TransportRouter(const TransportRouter& previous,
+                                 const vector<Sphere::Point>& stop_positions,
+                                 const vector<BusRoute>& bus_routes,
+                                 const vector<NameId>& stop_id_map,
+                                 const vector<NameId>& bus_id_map,
+                                 size_t thread_count)
+    : routing_settings_(previous.routing_settings_),
+      stop_count_(stop_positions.size())
+{
+  const Metrics::ScopedTimer timer(Metrics::Phase::ROUTER_INIT);
+  BuildGraph(stop_positions, bus_routes, thread_count);
+  const GraphMap graph_map = MapGraph(previous, stop_id_map, bus_id_map);
+  if (routing_settings_.precompute_routes) {
+    PrecomputeRoutes(previous, graph_map);
+  }
+  if (routing_settings_.route_search == RouteSearch::CONTRACTION_HIERARCHIES) {
+    BuildHierarchy();
+  }
+  if (routing_settings_.route_cache_size > 0) {
+    route_cache_ = make_unique<RouteCache>(routing_settings_.route_cache_size);
+    TakeOverCachedRoutes(previous, graph_map, stop_id_map, bus_id_map);
+  }
+}
+
+void TransportRouter::BuildGraph(const vector<Sphere::Point>& stop_positions, const vector<BusRoute>& bus_routes,
+                                 size_t thread_count) {
+  const Metrics::ScopedTimer timer(Metrics::Phase::GRAPH_FILL);
+  size_t vertex_count = stop_count_ * 2;
+  if (routing_settings_.graph_model == GraphModel::RIDES) {
+    for (const auto& bus_route : bus_routes) {
+      if (bus_route.stop_ids.size() > 1) {
+        vertex_count += bus_route.stop_ids.size();
+      }
+    }
+  }
+  BusGraph graph(vertex_count);
+  vertex_positions_.reserve(vertex_count);
+  for (const auto& position : stop_positions) {
+    vertex_positions_.insert(vertex_positions_.end(), 2, position);
+  }
+
+  FillGraphWithStops(stop_count_, graph);
+  if (routing_settings_.graph_model == GraphModel::RIDES) {
+    FillGraphWithBusRides(bus_routes, graph, thread_count);
+  } else {
+    FillGraphWithBuses(bus_routes, graph, thread_count);
+  }
+  FreezeGraph(graph);
+  vertex_points_ = Sphere::PointSet(vertex_positions_);
+  Metrics::Set(Metrics::Counter::GRAPH_VERTICES, graph_.GetVertexCount());
+  Metrics::Set(Metrics::Counter::GRAPH_EDGES, graph_.GetEdgeCount());
+
+  vector<double> min_ratios(bus_routes.size(), numeric_limits<double>::max());
+  ParallelFor(bus_routes.size(), thread_count, [&](size_t bus_idx) {
+    const auto& bus_route = bus_routes[bus_idx];
+    for (size_t stop_idx = 1; stop_idx < bus_route.stop_ids.size(); ++stop_idx) {
+      const double geo_distance = vertex_points_.Distance(GetStopVertexIds(bus_route.stop_ids[stop_idx - 1]).in,
+                                                          GetStopVertexIds(bus_route.stop_ids[stop_idx]).in);
+      if (geo_distance > 0) {
+        min_ratios[bus_idx] = min(min_ratios[bus_idx], bus_route.ComputeDistance(stop_idx - 1, stop_idx) / geo_distance);
+      }
+    }
+  });
+  min_road_to_geo_ratio_ = numeric_limits<double>::max();
+  for (const double ratio : min_ratios) {
+    min_road_to_geo_ratio_ = min(min_road_to_geo_ratio_, ratio);
+  }
+  if (min_road_to_geo_ratio_ == numeric_limits<double>::max()) {
+    min_road_to_geo_ratio_ = 0;
+  }
 
   router_ = std::make_unique<Router>(graph_);
 }
 
 TransportRouter::RoutingSettings TransportRouter::MakeRoutingSettings(const Json::Dict& json) {
-  return {
+  RoutingSettings settings{
       json.at("bus_wait_time").AsInt(),
       json.at("bus_velocity").AsDouble(),
   };
+  if (auto it = json.find("precompute_routes"); it != json.end()) {
+    settings.precompute_routes = it->second.AsBool();
+  }
+  if (auto it = json.find("precompute_memory_limit_mb"); it != json.end()) {
+    const int limit_mb = it->second.AsInt();
+    if (limit_mb < 0) {
+      throw invalid_argument("negative precompute_memory_limit_mb: " + to_string(limit_mb));
+    }
+    settings.precompute_memory_limit = static_cast<size_t>(limit_mb) * 1024 * 1024;
+  }
+  if (auto it = json.find("graph_model"); it != json.end()) {
+    const string& model = it->second.AsString();
+    if (model == "rides") {
+      settings.graph_model = GraphModel::RIDES;
+    } else if (model != "stop_pairs") {
+      throw invalid_argument("unknown graph_model: " + model);
+    }
+  }
+  if (auto it = json.find("route_search"); it != json.end()) {
+    const string& search = it->second.AsString();
+    if (search == "bidirectional_a_star") {
+      settings.route_search = RouteSearch::BIDIRECTIONAL_A_STAR;
+    } else if (search == "contraction_hierarchies") {
+      settings.route_search = RouteSearch::CONTRACTION_HIERARCHIES;
+    } else if (search != "dijkstra") {
+      throw invalid_argument("unknown route_search: " + search);
+    }
+  }
+  if (auto it = json.find("route_cache_size"); it != json.end()) {
+    const int cache_size = it->second.AsInt();
+    if (cache_size < 0) {
+      throw invalid_argument("negative route_cache_size: " + to_string(cache_size));
+    }
+    settings.route_cache_size = cache_size;
+  }
+  return settings;
 }
 
-void TransportRouter::FillGraphWithStops(const Descriptions::StopsDict& stops_dict) {
-  Graph::VertexId vertex_id = 0;
-
-  for (const auto& [stop_name, _] : stops_dict) {
-    auto& vertex_ids = stops_vertex_ids_[stop_name];
-    vertex_ids.in = vertex_id++;
-    vertex_ids.out = vertex_id++;
-    vertices_info_[vertex_ids.in] = {stop_name};
-    vertices_info_[vertex_ids.out] = {stop_name};
-
-    edges_info_.push_back(WaitEdgeInfo{});
-    graph_.AddEdge({
+void TransportRouter::FillGraphWithStops(size_t stop_count, BusGraph& graph) {
+  for (NameId stop_id = 0; stop_id < stop_count; ++stop_id) {
+    const auto vertex_ids = GetStopVertexIds(stop_id);
+    edges_info_.push_back(WaitEdgeInfo{stop_id});
+    graph.AddEdge({
         vertex_ids.out,
         vertex_ids.in,
         static_cast<double>(routing_settings_.bus_wait_time)
     });
   }
+}
 
-  assert(vertex_id == graph_.GetVertexCount());
+void TransportRouter::FillGraphWithBuses(const vector<BusRoute>& bus_routes, BusGraph& graph, size_t thread_count) {
+  vector<EdgeBatch> batches(bus_routes.size());
+  ParallelFor(bus_routes.size(), thread_count, [&](size_t bus_idx) {
+    batches[bus_idx] = MakeBusEdges(bus_routes[bus_idx]);
+  });
+  for (auto& batch : batches) {
+    AddEdges(move(batch), graph);
+  }
 }
 
-void TransportRouter::FillGraphWithBuses(const Descriptions::StopsDict& stops_dict,
-                                         const Descriptions::BusesDict& buses_dict) {
-  for (const auto& [_, bus_item] : buses_dict) {
-    const auto& bus = *bus_item;
-    const size_t stop_count = bus.stops.size();
+TransportRouter::EdgeBatch TransportRouter::MakeBusEdges(const BusRoute& bus_route) const {
+  EdgeBatch batch;
+  const auto& stop_ids = bus_route.stop_ids;
+  const size_t stop_count = stop_ids.size();
+  if (stop_count <= 1) {
+    return batch;
+  }
+  batch.edges.reserve(stop_count * (stop_count - 1) / 2);
+  batch.edges_info.reserve(stop_count * (stop_count - 1) / 2);
+  for (size_t start_stop_idx = 0; start_stop_idx + 1 < stop_count; ++start_stop_idx) {
+    const Graph::VertexId start_vertex = GetStopVertexIds(stop_ids[start_stop_idx]).in;
+    for (size_t finish_stop_idx = start_stop_idx + 1; finish_stop_idx < stop_count; ++finish_stop_idx) {
+      batch.edges_info.push_back(BusEdgeInfo{
+          .bus_id = bus_route.bus_id,
+          .span_count = finish_stop_idx - start_stop_idx,
+      });
+      batch.edges.push_back({
+          start_vertex,
+          GetStopVertexIds(stop_ids[finish_stop_idx]).out,
+          ComputeRideTime(bus_route.ComputeDistance(start_stop_idx, finish_stop_idx))
+      });
+    }
+  }
+  return batch;
+}
+
+void TransportRouter::FillGraphWithBusRides(const vector<BusRoute>& bus_routes, BusGraph& graph, size_t thread_count) {
+  // Rides are numbered in bus order first, so that their vertices are known before their edges are made
+  Graph::VertexId ride_vertex_id = stop_count_ * 2;
+  vector<const BusRoute*> ride_routes;
+  for (const auto& bus_route : bus_routes) {
+    const size_t stop_count = bus_route.stop_ids.size();
     if (stop_count <= 1) {
       continue;
     }
-    auto compute_distance_from = [&stops_dict, &bus](size_t lhs_idx) {
-      return Descriptions::ComputeStopsDistance(*stops_dict.at(bus.stops[lhs_idx]), *stops_dict.at(bus.stops[lhs_idx + 1]));
-    };
-    for (size_t start_stop_idx = 0; start_stop_idx + 1 < stop_count; ++start_stop_idx) {
-      const Graph::VertexId start_vertex = stops_vertex_ids_[bus.stops[start_stop_idx]].in;
-      int total_distance = 0;
-      for (size_t finish_stop_idx = start_stop_idx + 1; finish_stop_idx < stop_count; ++finish_stop_idx) {
-        total_distance += compute_distance_from(finish_stop_idx - 1);
-        edges_info_.push_back(BusEdgeInfo{
-            .bus_name = bus.name,
-            .span_count = finish_stop_idx - start_stop_idx,
-        });
-        graph_.AddEdge({
-            start_vertex,
-            stops_vertex_ids_[bus.stops[finish_stop_idx]].out,
-            total_distance * 1.0 / (routing_settings_.bus_velocity * 1000.0 / 60)  // m / (km/h * 1000 / 60) = min
-        });
+    ride_routes.push_back(&bus_route);
+    bus_rides_info_.push_back(BusRideInfo{bus_route.bus_id, bus_route.distances_from_start});
+    bus_ride_first_vertices_.push_back(ride_vertex_id);
+    ride_vertex_id += stop_count;
+  }
+  assert(ride_vertex_id == graph.GetVertexCount());
+  vertex_positions_.resize(ride_vertex_id);
+
+  vector<EdgeBatch> batches(ride_routes.size());
+  ParallelFor(ride_routes.size(), thread_count, [&](size_t bus_ride_idx) {
+    batches[bus_ride_idx] = MakeBusRideEdges(*ride_routes[bus_ride_idx], bus_ride_idx);
+  });
+  for (auto& batch : batches) {
+    AddEdges(move(batch), graph);
+  }
+}
+
+TransportRouter::EdgeBatch TransportRouter::MakeBusRideEdges(const BusRoute& bus_route, size_t bus_ride_idx) {
+  EdgeBatch batch;
+  const size_t stop_count = bus_route.stop_ids.size();
+  batch.edges.reserve(3 * (stop_count - 1));
+  batch.edges_info.reserve(3 * (stop_count - 1));
+  Graph::VertexId ride_vertex_id = bus_ride_first_vertices_[bus_ride_idx];
+  for (size_t stop_idx = 0; stop_idx < stop_count; ++stop_idx, ++ride_vertex_id) {
+    const auto vertex_ids = GetStopVertexIds(bus_route.stop_ids[stop_idx]);
+    vertex_positions_[ride_vertex_id] = vertex_positions_[vertex_ids.in];
+
+    if (stop_idx > 0) {
+      batch.edges_info.push_back(RideEdgeInfo{});
+      const double ride_time = ComputeRideTime(bus_route.ComputeDistance(stop_idx - 1, stop_idx));
+      batch.edges.push_back({ride_vertex_id - 1, ride_vertex_id, ride_time});
+
+      batch.edges_info.push_back(AlightEdgeInfo{stop_idx});
+      batch.edges.push_back({ride_vertex_id, vertex_ids.out, 0});
+    }
+    if (stop_idx + 1 < stop_count) {
+      batch.edges_info.push_back(BoardEdgeInfo{bus_ride_idx, stop_idx});
+      batch.edges.push_back({vertex_ids.in, ride_vertex_id, 0});
+    }
+  }
+  return batch;
+}
+
+void TransportRouter::AddEdges(EdgeBatch batch, BusGraph& graph) {
+  for (const auto& edge : batch.edges) {
+    graph.AddEdge(edge);
+  }
+  move(begin(batch.edges_info), end(batch.edges_info), back_inserter(edges_info_));
+}
+
+double TransportRouter::ComputeRideTime(int distance) const {
+  return distance * 1.0 / (routing_settings_.bus_velocity * 1000.0 / 60);  // m / (km/h * 1000 / 60) = min
+}
+
+double TransportRouter::ComputeRideTimeLowerBound(Graph::VertexId from, Graph::VertexId to) const {
+  const double geo_distance = vertex_points_.Distance(from, to);
+  // acos rounding gives NaN for coinciding points
+  if (!(geo_distance > 0)) {
+    return 0;
+  }
+  return geo_distance * min_road_to_geo_ratio_ / (routing_settings_.bus_velocity * 1000.0 / 60);
+}
+
+void TransportRouter::FreezeGraph(const BusGraph& graph) {
+  vector<Graph::EdgeId> builder_edge_ids;
+  graph_ = FrozenBusGraph(graph, &builder_edge_ids);
+
+  // Edge infos follow the frozen edge numbering
+  vector<EdgeInfo> edges_info;
+  edges_info.reserve(builder_edge_ids.size());
+  for (const Graph::EdgeId edge_id : builder_edge_ids) {
+    edges_info.push_back(move(edges_info_[edge_id]));
+  }
+  edges_info_ = move(edges_info);
+}
+
+vector<Graph::VertexId> TransportRouter::GetStopOutVertices() const {
+  vector<Graph::VertexId> vertices;
+  vertices.reserve(stop_count_);
+  for (NameId stop_id = 0; stop_id < stop_count_; ++stop_id) {
+    vertices.push_back(GetStopVertexIds(stop_id).out);
+  }
+  return vertices;
+}
+
+void TransportRouter::PrecomputeRoutes() {
+  // Routes are only requested between stops, so only "out" vertices need table rows.
+  // Falls back to on-demand Dijkstra if the table does not fit into the limit.
+  router_->PrecomputeRoutes(GetStopOutVertices(), routing_settings_.precompute_memory_limit);
+}
+
+void TransportRouter::PrecomputeRoutes(const TransportRouter& previous, const GraphMap& graph_map) {
+  router_->PrecomputeRoutes(GetStopOutVertices(), routing_settings_.precompute_memory_limit,
+                            *previous.router_, graph_map.vertex_map, graph_map.edge_map, graph_map.new_edges);
+}
+
+size_t TransportRouter::GetBusRideIdx(Graph::VertexId vertex) const {
+  return upper_bound(begin(bus_ride_first_vertices_), end(bus_ride_first_vertices_), vertex)
+      - begin(bus_ride_first_vertices_) - 1;
+}
+
+TransportRouter::GraphMap TransportRouter::MapGraph(const TransportRouter& previous,
+                                                    const vector<NameId>& stop_id_map,
+                                                    const vector<NameId>& bus_id_map) const {
+  GraphMap graph_map;
+  graph_map.vertex_map.assign(previous.graph_.GetVertexCount(), Router::NO_VERTEX);
+  for (NameId stop_id = 0; stop_id < previous.stop_count_; ++stop_id) {
+    if (stop_id_map[stop_id] != NO_NAME) {
+      const auto previous_vertex_ids = GetStopVertexIds(stop_id);
+      const auto vertex_ids = GetStopVertexIds(stop_id_map[stop_id]);
+      graph_map.vertex_map[previous_vertex_ids.in] = vertex_ids.in;
+      graph_map.vertex_map[previous_vertex_ids.out] = vertex_ids.out;
+    }
+  }
+  // Vertices of a bus ride are mapped by stop index; its edges tell whether the ride has changed
+  unordered_map<NameId, size_t> bus_ride_indices;
+  for (size_t bus_ride_idx = 0; bus_ride_idx < bus_rides_info_.size(); ++bus_ride_idx) {
+    bus_ride_indices[bus_rides_info_[bus_ride_idx].bus_id] = bus_ride_idx;
+  }
+  for (size_t previous_ride_idx = 0; previous_ride_idx < previous.bus_rides_info_.size(); ++previous_ride_idx) {
+    const auto& previous_ride_info = previous.bus_rides_info_[previous_ride_idx];
+    const auto it = bus_ride_indices.find(bus_id_map[previous_ride_info.bus_id]);
+    if (it == bus_ride_indices.end()) {
+      continue;
+    }
+    const size_t stop_count = min(previous_ride_info.distances_from_start.size(),
+                                  bus_rides_info_[it->second].distances_from_start.size());
+    for (size_t stop_idx = 0; stop_idx < stop_count; ++stop_idx) {
+      graph_map.vertex_map[previous.bus_ride_first_vertices_[previous_ride_idx] + stop_idx] =
+          bus_ride_first_vertices_[it->second] + stop_idx;
+    }
+  }
+
+  // Edges between the same vertices of the same kind are matched by weight
+  struct EdgeKey {
+    Graph::VertexId from;
+    Graph::VertexId to;
+    size_t kind;  // index of the EdgeInfo alternative
+    uint64_t bus_label;  // bus id and span count of bus edges
+    double weight;
+    Graph::EdgeId edge_id;
+
+    auto AsTuple() const { return tie(from, to, kind, bus_label, weight); }
+    bool IsParallelTo(const EdgeKey& other) const {
+      return tie(from, to, kind, bus_label) == tie(other.from, other.to, other.kind, other.bus_label);
+    }
+  };
+  auto make_keys = [](const TransportRouter& router, const vector<Graph::VertexId>* vertex_map,
+                      const vector<NameId>* bus_id_map) {
+    vector<EdgeKey> keys;
+    keys.reserve(router.graph_.GetEdgeCount());
+    for (Graph::EdgeId edge_id = 0; edge_id < router.graph_.GetEdgeCount(); ++edge_id) {
+      const auto edge = router.graph_.GetEdge(edge_id);
+      const auto& edge_info = router.edges_info_[edge_id];
+      EdgeKey key{edge.from, edge.to, edge_info.index(), 0, edge.weight, edge_id};
+      if (vertex_map) {
+        key.from = (*vertex_map)[edge.from];
+        key.to = (*vertex_map)[edge.to];
+      }
+      if (holds_alternative<BusEdgeInfo>(edge_info)) {
+        const auto& bus_edge_info = get<BusEdgeInfo>(edge_info);
+        const NameId bus_id = bus_id_map ? (*bus_id_map)[bus_edge_info.bus_id] : bus_edge_info.bus_id;
+        if (bus_id == NO_NAME) {
+          continue;
+        }
+        key.bus_label = (uint64_t{bus_id} << 32) | bus_edge_info.span_count;
+      }
+      if (key.from != Router::NO_VERTEX && key.to != Router::NO_VERTEX) {
+        keys.push_back(key);
+      }
+    }
+    sort(begin(keys), end(keys), [](const EdgeKey& lhs, const EdgeKey& rhs) {
+      return lhs.AsTuple() < rhs.AsTuple();
+    });
+    return keys;
+  };
+  const auto previous_keys = make_keys(previous, &graph_map.vertex_map, &bus_id_map);
+  const auto keys = make_keys(*this, nullptr, nullptr);
+
+  graph_map.edge_map.assign(previous.graph_.GetEdgeCount(), Graph::NO_ROUTE);
+  auto previous_it = begin(previous_keys);
+  for (auto group_begin = begin(keys); group_begin != end(keys);) {
+    const auto group_end = find_if(group_begin, end(keys), [&](const EdgeKey& key) {
+      return !key.IsParallelTo(*group_begin);
+    });
+    while (previous_it != end(previous_keys) && previous_it->AsTuple() < group_begin->AsTuple()
+           && !previous_it->IsParallelTo(*group_begin)) {
+      ++previous_it;
+    }
+    const auto previous_group_begin = previous_it;
+    while (previous_it != end(previous_keys) && previous_it->IsParallelTo(*group_begin)) {
+      ++previous_it;
+    }
+
+    // Both groups go by weight; edges not lighter than a previous parallel edge cannot make routes shorter
+    auto previous_group_it = previous_group_begin;
+    for (auto it = group_begin; it != group_end; ++it) {
+      bool is_mapped = false;
+      for (; previous_group_it != previous_it && !(it->weight < previous_group_it->weight); ++previous_group_it) {
+        if (previous_group_it->weight == it->weight) {
+          graph_map.edge_map[previous_group_it->edge_id] = it->edge_id;
+          is_mapped = true;
+        }
+      }
+      if (!is_mapped && (previous_group_begin == previous_it || it->weight < previous_group_begin->weight)) {
+        graph_map.new_edges.push_back(it->edge_id);
+      }
+    }
+    group_begin = group_end;
+  }
+
+  graph_map.changed_buses.assign(bus_id_map.size(), false);
+  for (Graph::EdgeId edge_id = 0; edge_id < graph_map.edge_map.size(); ++edge_id) {
+    if (graph_map.edge_map[edge_id] != Graph::NO_ROUTE) {
+      continue;
+    }
+    const auto& edge_info = previous.edges_info_[edge_id];
+    if (holds_alternative<BusEdgeInfo>(edge_info)) {
+      graph_map.changed_buses[get<BusEdgeInfo>(edge_info).bus_id] = true;
+    } else if (!holds_alternative<WaitEdgeInfo>(edge_info)) {
+      // Edges of a bus ride have a ride vertex at least at one end, and ride vertices follow stop ones
+      const auto edge = previous.graph_.GetEdge(edge_id);
+      const auto ride_idx = previous.GetBusRideIdx(max(edge.from, edge.to));
+      graph_map.changed_buses[previous.bus_rides_info_[ride_idx].bus_id] = true;
+    }
+  }
+  return graph_map;
+}
+
+void TransportRouter::TakeOverCachedRoutes(const TransportRouter& previous, const GraphMap& graph_map,
+                                           const vector<NameId>& stop_id_map, const vector<NameId>& bus_id_map) {
+  // Routes of unchanged buses are still there and still shortest unless some new edge makes a shortcut
+  if (!previous.route_cache_ || !graph_map.new_edges.empty()) {
+    return;
+  }
+  previous.route_cache_->ForEach([&](uint64_t key, const shared_ptr<const optional<RouteInfo>>& route) {
+    const NameId stop_from = stop_id_map[key >> 32];
+    const NameId stop_to = stop_id_map[key & numeric_limits<uint32_t>::max()];
+    if (stop_from == NO_NAME || stop_to == NO_NAME) {
+      return;
+    }
+    optional<RouteInfo> route_info = *route;
+    if (route_info) {
+      for (auto& item : route_info->items) {
+        if (auto* bus_item = get_if<RouteInfo::BusItem>(&item)) {
+          if (graph_map.changed_buses[bus_item->bus_id]) {
+            return;
+          }
+          bus_item->bus_id = bus_id_map[bus_item->bus_id];
+        } else {
+          auto& wait_item = get<RouteInfo::WaitItem>(item);
+          if (stop_id_map[wait_item.stop_id] == NO_NAME) {
+            return;
+          }
+          wait_item.stop_id = stop_id_map[wait_item.stop_id];
+        }
+      }
+    }
+    route_cache_->Insert((uint64_t{stop_from} << 32) | stop_to,
+                         make_shared<const optional<RouteInfo>>(move(route_info)));
+  });
+}
+
+void TransportRouter::BuildHierarchy() {
+  auto hierarchy = make_unique<Hierarchy>(graph_);
+  // Searching a core holding most of the graph costs more than Dijkstra over the graph itself
+  if (hierarchy->GetCoreVertexCount() * 2 <= graph_.GetVertexCount()) {
+    hierarchy_ = move(hierarchy);
+  }
+}
+
+optional<TransportRouter::Router::RouteInfo> TransportRouter::BuildRoute(Graph::VertexId from, Graph::VertexId to) const {
+  // Routes from the precomputed table are the cheapest anyway
+  if (router_->HasPrecomputedRoutes()) {
+    return router_->BuildRoute(from, to);
+  }
+  switch (routing_settings_.route_search) {
+    case RouteSearch::BIDIRECTIONAL_A_STAR:
+      return router_->BuildRouteBidirectional(from, to, [this](Graph::VertexId from, Graph::VertexId to) {
+        return ComputeRideTimeLowerBound(from, to);
+      });
+    case RouteSearch::CONTRACTION_HIERARCHIES:
+      if (hierarchy_) {
+        return hierarchy_->BuildRoute(from, to);
       }
+      [[fallthrough]];
+    default:
+      return router_->BuildRoute(from, to);
+  }
+}
+
+optional<TransportRouter::RouteInfo> TransportRouter::FindRoute(NameId stop_from, NameId stop_to) const {
+  if (!route_cache_) {
+    return ComputeRoute(stop_from, stop_to);
+  }
+
+  const uint64_t key = (uint64_t{stop_from} << 32) | stop_to;
+  if (const auto cached_route = route_cache_->Find(key)) {
+    auto route = **cached_route;
+    if (route) {
+      route->settled_vertex_count = 0;
     }
+    return route;
   }
+  auto route = make_shared<const optional<RouteInfo>>(ComputeRoute(stop_from, stop_to));
+  route_cache_->Insert(key, route);
+  return *route;
 }
 
-optional<TransportRouter::RouteInfo> TransportRouter::FindRoute(const string& stop_from, const string& stop_to) const {
-  const Graph::VertexId vertex_from = stops_vertex_ids_.at(stop_from).out;
-  const Graph::VertexId vertex_to = stops_vertex_ids_.at(stop_to).out;
-  const auto route = router_->BuildRoute(vertex_from, vertex_to);
+optional<LruCacheStats> TransportRouter::GetRouteCacheStats() const {
+  if (!route_cache_) {
+    return nullopt;
+  }
+  return route_cache_->GetStats();
+}
+
+optional<TransportRouter::RouteInfo> TransportRouter::ComputeRoute(NameId stop_from, NameId stop_to) const {
+  const Graph::VertexId vertex_from = GetStopVertexIds(stop_from).out;
+  const Graph::VertexId vertex_to = GetStopVertexIds(stop_to).out;
+  const auto route = BuildRoute(vertex_from, vertex_to);
   if (!route) {
     return nullopt;
   }
+  return MakeRouteInfo(*route);
+}
 
-  RouteInfo route_info = {.total_time = route->weight};
-  route_info.items.reserve(route->edge_count);
-  for (size_t edge_idx = 0; edge_idx < route->edge_count; ++edge_idx) {
-    const Graph::EdgeId edge_id = router_->GetRouteEdge(route->id, edge_idx);
-    const auto& edge = graph_.GetEdge(edge_id);
+TransportRouter::RouteInfo TransportRouter::MakeRouteInfo(const Router::RouteInfo& route) const {
+  RouteInfo route_info = {.total_time = route.weight, .items = {}, .settled_vertex_count = route.settled_vertex_count};
+  route_info.items.reserve(route.edges.size());
+  const BoardEdgeInfo* board_edge_info = nullptr;
+  for (const Graph::EdgeId edge_id : route.edges) {
+    const auto edge = graph_.GetEdge(edge_id);
     const auto& edge_info = edges_info_[edge_id];
     if (holds_alternative<BusEdgeInfo>(edge_info)) {
       const BusEdgeInfo& bus_edge_info = get<BusEdgeInfo>(edge_info);
       route_info.items.push_back(RouteInfo::BusItem{
-          .bus_name = bus_edge_info.bus_name,
+          .bus_id = bus_edge_info.bus_id,
           .time = edge.weight,
           .span_count = bus_edge_info.span_count,
       });
-    } else {
-      const Graph::VertexId vertex_id = edge.from;
+    } else if (holds_alternative<BoardEdgeInfo>(edge_info)) {
+      board_edge_info = &get<BoardEdgeInfo>(edge_info);
+    } else if (holds_alternative<AlightEdgeInfo>(edge_info)) {
+      // Ride times are recomputed from whole distances to match the STOP_PAIRS model exactly
+      const auto& bus_ride_info = bus_rides_info_[board_edge_info->bus_ride_idx];
+      const size_t finish_stop_idx = get<AlightEdgeInfo>(edge_info).stop_idx;
+      route_info.items.push_back(RouteInfo::BusItem{
+          .bus_id = bus_ride_info.bus_id,
+          .time = ComputeRideTime(bus_ride_info.distances_from_start[finish_stop_idx]
+                                  - bus_ride_info.distances_from_start[board_edge_info->stop_idx]),
+          .span_count = finish_stop_idx - board_edge_info->stop_idx,
+      });
+    } else if (holds_alternative<WaitEdgeInfo>(edge_info)) {
       route_info.items.push_back(RouteInfo::WaitItem{
-          .stop_name = vertices_info_[vertex_id].stop_name,
+          .stop_id = get<WaitEdgeInfo>(edge_info).stop_id,
           .time = edge.weight,
       });
     }
   }
 
-  // Releasing in destructor of some proxy object would be better,
-  // but we do not expect exceptions in normal workflow
-  router_->ReleaseRoute(route->id);
+  if (routing_settings_.graph_model == GraphModel::RIDES) {
+    // Sum up in route order, as Dijkstra does for the STOP_PAIRS model
+    route_info.total_time = 0;
+    for (const auto& item : route_info.items) {
+      route_info.total_time += visit([](const auto& item) { return item.time; }, item);
+    }
+  }
+
   return route_info;
 }
+
+TransportRouter::RouteMatrix TransportRouter::FindRouteMatrix(const vector<NameId>& stops_from,
+                                                              const vector<NameId>& stops_to,
+                                                              const vector<pair<size_t, size_t>>& expanded_pairs,
+                                                              size_t thread_count) const {
+  RouteMatrix matrix;
+  matrix.total_times.resize(stops_from.size());
+  matrix.routes.resize(expanded_pairs.size());
+
+  vector<Graph::VertexId> targets;
+  targets.reserve(stops_to.size());
+  for (const NameId stop_id : stops_to) {
+    targets.push_back(GetStopVertexIds(stop_id).out);
+  }
+  // Indices of expanded pairs by source, checked before any search starts
+  vector<vector<size_t>> expanded_pair_indices(stops_from.size());
+  for (size_t pair_idx = 0; pair_idx < expanded_pairs.size(); ++pair_idx) {
+    const auto [from_idx, to_idx] = expanded_pairs[pair_idx];
+    if (from_idx >= stops_from.size() || to_idx >= stops_to.size()) {
+      throw out_of_range("expanded pair is out of the route matrix");
+    }
+    expanded_pair_indices[from_idx].push_back(pair_idx);
+  }
+
+  // Every source fills in its own row and its own routes
+  auto compute_row = [&](size_t from_idx) {
+    vector<bool> expand_edges(targets.size(), false);
+    for (const size_t pair_idx : expanded_pair_indices[from_idx]) {
+      expand_edges[expanded_pairs[pair_idx].second] = true;
+    }
+    const auto routes = router_->BuildRoutes(GetStopVertexIds(stops_from[from_idx]).out, targets, expand_edges);
+
+    auto& total_times = matrix.total_times[from_idx];
+    total_times.reserve(routes.size());
+    for (const auto& route : routes) {
+      total_times.push_back(route ? optional(route->weight) : nullopt);
+    }
+    for (const size_t pair_idx : expanded_pair_indices[from_idx]) {
+      if (const auto& route = routes[expanded_pairs[pair_idx].second]) {
+        matrix.routes[pair_idx] = MakeRouteInfo(*route);
+      }
+    }
+  };
+
+  ParallelFor(stops_from.size(), thread_count, compute_row);
+  return matrix;
+}
+
+size_t TransportRouter::GetVertexCount() const {
+  return graph_.GetVertexCount();
+}
+
+size_t TransportRouter::GetEdgeCount() const {
+  return graph_.GetEdgeCount();
+}
+
+// Structs with padding are written field by field, so that snapshots of the same catalog are identical
+void TransportRouter::SaveRoutingSettings(const RoutingSettings& settings, Snapshot::Writer& writer) {
+  writer.Write<int32_t>(settings.bus_wait_time);
+  writer.Write(settings.bus_velocity);
+  writer.Write<uint8_t>(settings.precompute_routes);
+  writer.Write<uint64_t>(settings.precompute_memory_limit);
+  writer.Write<uint8_t>(static_cast<uint8_t>(settings.graph_model));
+  writer.Write<uint8_t>(static_cast<uint8_t>(settings.route_search));
+  writer.Write<uint64_t>(settings.route_cache_size);
+}
+
+TransportRouter::RoutingSettings TransportRouter::LoadRoutingSettings(Snapshot::Reader& reader) {
+  RoutingSettings settings{reader.Read<int32_t>(), reader.Read<double>()};
+  const uint8_t precompute_routes = reader.Read<uint8_t>();
+  settings.precompute_memory_limit = reader.Read<uint64_t>();
+  const uint8_t graph_model = reader.Read<uint8_t>();
+  const uint8_t route_search = reader.Read<uint8_t>();
+  settings.route_cache_size = reader.Read<uint64_t>();
+  if (precompute_routes > 1 || graph_model > static_cast<uint8_t>(GraphModel::RIDES)
+      || route_search > static_cast<uint8_t>(RouteSearch::CONTRACTION_HIERARCHIES)) {
+    throw runtime_error("inconsistent routing settings in snapshot");
+  }
+  settings.precompute_routes = precompute_routes;
+  settings.graph_model = static_cast<GraphModel>(graph_model);
+  settings.route_search = static_cast<RouteSearch>(route_search);
+  return settings;
+}
+
+void TransportRouter::Save(Snapshot::Writer& writer) const {
+  SaveRoutingSettings(routing_settings_, writer);
+  writer.Write<uint64_t>(stop_count_);
+  writer.WriteVector(vertex_positions_);
+  writer.Write(min_road_to_geo_ratio_);
+
+  writer.Write<uint64_t>(edges_info_.size());
+  for (const auto& edge_info : edges_info_) {
+    writer.Write<uint8_t>(edge_info.index());
+    if (holds_alternative<BusEdgeInfo>(edge_info)) {
+      writer.Write(get<BusEdgeInfo>(edge_info).bus_id);
+      writer.Write<uint64_t>(get<BusEdgeInfo>(edge_info).span_count);
+    } else if (holds_alternative<WaitEdgeInfo>(edge_info)) {
+      writer.Write(get<WaitEdgeInfo>(edge_info));
+    } else if (holds_alternative<BoardEdgeInfo>(edge_info)) {
+      writer.Write(get<BoardEdgeInfo>(edge_info));
+    } else if (holds_alternative<AlightEdgeInfo>(edge_info)) {
+      writer.Write(get<AlightEdgeInfo>(edge_info));
+    }
+  }
+
+  writer.Write<uint64_t>(bus_rides_info_.size());
+  for (const auto& bus_ride_info : bus_rides_info_) {
+    writer.Write(bus_ride_info.bus_id);
+    writer.WriteVector(bus_ride_info.distances_from_start);
+  }
+
+  Graph::FrozenGraphSnapshot<double>::Save(graph_, writer);
+  router_->SavePrecomputedRoutes(writer);
+  writer.Write<uint8_t>(hierarchy_ != nullptr);
+  if (hierarchy_) {
+    hierarchy_->Save(writer);
+  }
+}
+
+unique_ptr<TransportRouter> TransportRouter::Load(Snapshot::Reader& reader) {
+  unique_ptr<TransportRouter> result(new TransportRouter);
+  TransportRouter& router = *result;
+  router.routing_settings_ = LoadRoutingSettings(reader);
+  router.stop_count_ = reader.Read<uint64_t>();
+  router.vertex_positions_ = reader.ReadVector<Sphere::Point>();
+  router.vertex_points_ = Sphere::PointSet(router.vertex_positions_);
+  router.min_road_to_geo_ratio_ = reader.Read<double>();
+
+  router.edges_info_.resize(reader.ReadSize(sizeof(uint8_t)));
+  for (auto& edge_info : router.edges_info_) {
+    // Kinds are indices of the EdgeInfo alternatives
+    switch (reader.Read<uint8_t>()) {
+      case 0: {
+        const NameId bus_id = reader.Read<NameId>();
+        edge_info = BusEdgeInfo{bus_id, reader.Read<uint64_t>()};
+        break;
+      }
+      case 1:
+        edge_info = reader.Read<WaitEdgeInfo>();
+        break;
+      case 2:
+        edge_info = reader.Read<BoardEdgeInfo>();
+        break;
+      case 3:
+        edge_info = RideEdgeInfo{};
+        break;
+      case 4:
+        edge_info = reader.Read<AlightEdgeInfo>();
+        break;
+      default:
+        throw runtime_error("unknown edge kind in snapshot");
+    }
+  }
+
+  router.bus_rides_info_.resize(reader.ReadSize(sizeof(NameId) + sizeof(uint64_t)));
+  for (auto& bus_ride_info : router.bus_rides_info_) {
+    bus_ride_info.bus_id = reader.Read<NameId>();
+    bus_ride_info.distances_from_start = reader.ReadVector<int>();
+  }
+  Graph::VertexId ride_vertex_id = router.stop_count_ * 2;
+  for (const auto& bus_ride_info : router.bus_rides_info_) {
+    router.bus_ride_first_vertices_.push_back(ride_vertex_id);
+    ride_vertex_id += bus_ride_info.distances_from_start.size();
+  }
+
+  router.graph_ = Graph::FrozenGraphSnapshot<double>::Load(reader);
+  if (router.graph_.GetVertexCount() < router.stop_count_ * 2
+      || router.graph_.GetVertexCount() != router.vertex_positions_.size()
+      || router.graph_.GetEdgeCount() != router.edges_info_.size()) {
+    throw runtime_error("inconsistent router in snapshot");
+  }
+  router.router_ = make_unique<Router>(router.graph_);
+  router.router_->LoadPrecomputedRoutes(reader);
+  if (reader.Read<uint8_t>()) {
+    if (router.routing_settings_.route_search != RouteSearch::CONTRACTION_HIERARCHIES) {
+      throw runtime_error("inconsistent router in snapshot");
+    }
+    router.hierarchy_ = make_unique<Hierarchy>(Hierarchy::Load(reader, router.graph_));
+  }
+  if (router.routing_settings_.route_cache_size > 0) {
+    router.route_cache_ = make_unique<RouteCache>(router.routing_settings_.route_cache_size);
+  }
+  Metrics::Set(Metrics::Counter::GRAPH_VERTICES, router.graph_.GetVertexCount());
+  Metrics::Set(Metrics::Counter::GRAPH_EDGES, router.graph_.GetEdgeCount());
+  return result;
+}
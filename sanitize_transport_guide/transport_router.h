@@ -1,75 +1,223 @@
 #pragma once
 
-#include "descriptions.h"
+#include "contraction_hierarchy.h"
 #include "graph.h"
 #include "json.h"
+#include "lru_cache.h"
+#include "name_table.h"
+#include "road_network.h"
 #include "router.h"
+#include "snapshot.h"
+#include "sphere.h"
 
 #include <memory>
-#include <unordered_map>
+#include <optional>
+#include <utility>
 #include <vector>
 
 class TransportRouter {
 private:
   using BusGraph = Graph::DirectedWeightedGraph<double>;
+  using FrozenBusGraph = Graph::FrozenGraph<double>;
   using Router = Graph::Router<double>;
+  using Hierarchy = Graph::ContractionHierarchy<double>;
 
 public:
-  TransportRouter(const Descriptions::StopsDict& stops_dict,
-                  const Descriptions::BusesDict& buses_dict,
-                  const Json::Dict& routing_settings_json);
+  // Stops have ids from 0 to stop_positions.size() - 1.
+  // Edges of different buses are made on thread_count threads; the graph is the same for any count.
+  TransportRouter(const std::vector<Sphere::Point>& stop_positions,
+                  const std::vector<BusRoute>& bus_routes,
+                  const Json::Dict& routing_settings_json,
+                  size_t thread_count = 1);
+
+  // Router with the settings of previous for changed stops and buses. stop_id_map and bus_id_map
+  // give the ids of stops and buses of previous, NO_NAME for removed ones. Precomputed and cached routes
+  // of previous are taken over where the changes cannot affect them; a contraction hierarchy is built anew.
+  TransportRouter(const TransportRouter& previous,
+                  const std::vector<Sphere::Point>& stop_positions,
+                  const std::vector<BusRoute>& bus_routes,
+                  const std::vector<NameId>& stop_id_map,
+                  const std::vector<NameId>& bus_id_map,
+                  size_t thread_count = 1);
 
   struct RouteInfo {
     double total_time;
 
     struct BusItem {
-      std::string bus_name;
+      NameId bus_id;
       double time;
       size_t span_count;
     };
     struct WaitItem {
-      std::string stop_name;
+      NameId stop_id;
       double time;
     };
 
     using Item = std::variant<BusItem, WaitItem>;
     std::vector<Item> items;
+
+    size_t settled_vertex_count;  // by the graph search, 0 for precomputed and cached routes
+  };
+
+  // Safe to call concurrently, the route cache is shared by all callers
+  std::optional<RouteInfo> FindRoute(NameId stop_from, NameId stop_to) const;
+
+  struct RouteMatrix {
+    // By source and target index, empty if there is no route. Computed by Dijkstra,
+    // so they may differ from total_time of RouteInfo in the last digits for the RIDES model.
+    std::vector<std::vector<std::optional<double>>> total_times;
+    std::vector<std::optional<RouteInfo>> routes;  // for every expanded pair
   };
 
-  std::optional<RouteInfo> FindRoute(const std::string& stop_from, const std::string& stop_to) const;
+  // One search from every stop of stops_from to all of stops_to, whatever the route_search setting,
+  // spread over thread_count workers. Items are built only for expanded_pairs of (source, target) indices.
+  // Throws std::out_of_range for indices out of stops_from or stops_to.
+  RouteMatrix FindRouteMatrix(const std::vector<NameId>& stops_from, const std::vector<NameId>& stops_to,
+                              const std::vector<std::pair<size_t, size_t>>& expanded_pairs,
+                              size_t thread_count = 1) const;
+
+  // Empty if routing_settings.route_cache_size is 0
+  std::optional<LruCacheStats> GetRouteCacheStats() const;
+
+  size_t GetStopCount() const { return stop_count_; }
+  size_t GetVertexCount() const;
+  size_t GetEdgeCount() const;
+  // False for CONTRACTION_HIERARCHIES too, if the core was left too big to be worth searching
+  bool HasHierarchy() const { return hierarchy_ != nullptr; }
+
+  // Graph, edge infos and precomputed routes, so that loading does not rebuild anything
+  void Save(Snapshot::Writer& writer) const;
+  static std::unique_ptr<TransportRouter> Load(Snapshot::Reader& reader);
 
 private:
+  TransportRouter() = default;
+
+  enum class GraphModel {
+    STOP_PAIRS,  // an edge for every pair of stops on every bus, O(k^2) edges per bus
+    RIDES,  // a vertex for every stop of every bus, O(k) edges per bus
+  };
+
+  enum class RouteSearch {
+    DIJKSTRA,
+    BIDIRECTIONAL_A_STAR,  // guided by great-circle distances between stops
+    CONTRACTION_HIERARCHIES,  // built with the router; Dijkstra if contraction leaves most vertices in the core
+  };
+
   struct RoutingSettings {
     int bus_wait_time;  // in minutes
     double bus_velocity;  // km/h
+    bool precompute_routes = false;
+    size_t precompute_memory_limit = 512 * 1024 * 1024;  // in bytes
+    GraphModel graph_model = GraphModel::STOP_PAIRS;
+    RouteSearch route_search = RouteSearch::DIJKSTRA;
+    size_t route_cache_size = 0;  // found routes kept by stop pair
   };
 
   static RoutingSettings MakeRoutingSettings(const Json::Dict& json);
+  static void SaveRoutingSettings(const RoutingSettings& settings, Snapshot::Writer& writer);
+  static RoutingSettings LoadRoutingSettings(Snapshot::Reader& reader);
+
+  void BuildGraph(const std::vector<Sphere::Point>& stop_positions, const std::vector<BusRoute>& bus_routes,
+                  size_t thread_count);
+
+  void FillGraphWithStops(size_t stop_count, BusGraph& graph);
+
+  // Edges of every bus are made apart and then added in bus order, so edge ids do not depend on thread_count
+  struct EdgeBatch;
+  void FillGraphWithBuses(const std::vector<BusRoute>& bus_routes, BusGraph& graph, size_t thread_count);
+  EdgeBatch MakeBusEdges(const BusRoute& bus_route) const;
+
+  void FillGraphWithBusRides(const std::vector<BusRoute>& bus_routes, BusGraph& graph, size_t thread_count);
+  // Also places the ride vertices of the bus
+  EdgeBatch MakeBusRideEdges(const BusRoute& bus_route, size_t bus_ride_idx);
 
-  void FillGraphWithStops(const Descriptions::StopsDict& stops_dict);
+  void AddEdges(EdgeBatch batch, BusGraph& graph);
 
-  void FillGraphWithBuses(const Descriptions::StopsDict& stops_dict,
-                          const Descriptions::BusesDict& buses_dict);
+  double ComputeRideTime(int distance) const;
 
+  // No route between the vertices is shorter: buses never go faster than bus_velocity
+  // along roads, and no road is shorter than min_road_to_geo_ratio_ of the great-circle distance
+  double ComputeRideTimeLowerBound(Graph::VertexId from, Graph::VertexId to) const;
+
+  void FreezeGraph(const BusGraph& graph);
+
+  std::vector<Graph::VertexId> GetStopOutVertices() const;
+  void PrecomputeRoutes();
+  void BuildHierarchy();
+
+  // Ids in this graph of vertices and edges of the graph of a previous router
+  struct GraphMap {
+    std::vector<Graph::VertexId> vertex_map;  // NO_VERTEX for vertices gone
+    std::vector<Graph::EdgeId> edge_map;  // NO_ROUTE for edges gone or changed
+    std::vector<Graph::EdgeId> new_edges;  // edges that may make routes shorter
+    std::vector<bool> changed_buses;  // by previous bus id, with some edge gone or changed
+  };
+  GraphMap MapGraph(const TransportRouter& previous,
+                    const std::vector<NameId>& stop_id_map,
+                    const std::vector<NameId>& bus_id_map) const;
+  void PrecomputeRoutes(const TransportRouter& previous, const GraphMap& graph_map);
+  void TakeOverCachedRoutes(const TransportRouter& previous, const GraphMap& graph_map,
+                            const std::vector<NameId>& stop_id_map, const std::vector<NameId>& bus_id_map);
+
+  // Index in bus_rides_info_ of the bus ride a vertex of the RIDES model belongs to
+  size_t GetBusRideIdx(Graph::VertexId vertex) const;
+
+  std::optional<Router::RouteInfo> BuildRoute(Graph::VertexId from, Graph::VertexId to) const;
+
+  std::optional<RouteInfo> ComputeRoute(NameId stop_from, NameId stop_to) const;
+  RouteInfo MakeRouteInfo(const Router::RouteInfo& route) const;
+
+  // Buses depart from the "in" vertex of a stop and arrive at its "out" vertex
   struct StopVertexIds {
     Graph::VertexId in;
     Graph::VertexId out;
   };
-  struct VertexInfo {
-    std::string stop_name;
-  };
+  static StopVertexIds GetStopVertexIds(NameId stop_id) {
+    return {Graph::VertexId{stop_id} * 2, Graph::VertexId{stop_id} * 2 + 1};
+  }
 
   struct BusEdgeInfo {
-    std::string bus_name;
+    NameId bus_id;
     size_t span_count;
   };
-  struct WaitEdgeInfo {};
-  using EdgeInfo = std::variant<BusEdgeInfo, WaitEdgeInfo>;
+  struct WaitEdgeInfo {
+    NameId stop_id;
+  };
+
+  // Edges of the RIDES graph model: boarding a bus at its stop_idx-th stop,
+  // riding to the next stop and leaving the bus at its stop_idx-th stop
+  struct BoardEdgeInfo {
+    size_t bus_ride_idx;
+    size_t stop_idx;
+  };
+  struct RideEdgeInfo {};
+  struct AlightEdgeInfo {
+    size_t stop_idx;
+  };
+  using EdgeInfo = std::variant<BusEdgeInfo, WaitEdgeInfo, BoardEdgeInfo, RideEdgeInfo, AlightEdgeInfo>;
+
+  struct EdgeBatch {
+    std::vector<Graph::Edge<double>> edges;
+    std::vector<EdgeInfo> edges_info;
+  };
+
+  struct BusRideInfo {
+    NameId bus_id;
+    std::vector<int> distances_from_start;  // for every stop of the bus
+  };
 
   RoutingSettings routing_settings_;
-  BusGraph graph_;
+  FrozenBusGraph graph_;
   std::unique_ptr<Router> router_;
-  std::unordered_map<std::string, StopVertexIds> stops_vertex_ids_;
-  std::vector<VertexInfo> vertices_info_;
+  std::unique_ptr<Hierarchy> hierarchy_;  // for CONTRACTION_HIERARCHIES with a small enough core only
+  // Routes, found or not, by (stop_from << 32) | stop_to
+  using RouteCache = LruCache<uint64_t, std::shared_ptr<const std::optional<RouteInfo>>>;
+  std::unique_ptr<RouteCache> route_cache_;
+  size_t stop_count_ = 0;
+  std::vector<Sphere::Point> vertex_positions_;
+  Sphere::PointSet vertex_points_;  // vertex_positions_ prepared for distance lower bounds
+  double min_road_to_geo_ratio_ = 0;
   std::vector<EdgeInfo> edges_info_;
+  std::vector<BusRideInfo> bus_rides_info_;
+  std::vector<Graph::VertexId> bus_ride_first_vertices_;  // by index in bus_rides_info_
 };
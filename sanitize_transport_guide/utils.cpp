@@ -13,3 +13,12 @@ string_view Strip(string_view line) {
   }
   return line;
 }
+
+string ReadAll(istream& input) {
+  string result;
+  char buffer[1 << 16];
+  while (input.read(buffer, sizeof(buffer)) || input.gcount() > 0) {
+    result.append(buffer, input.gcount());
+  }
+  return result;
+}
@@ -1,9 +1,17 @@
 #pragma once
 
+#include <algorithm>
+#include <atomic>
+#include <exception>
+#include <istream>
 #include <iterator>
+#include <mutex>
+#include <string>
 #include <string_view>
+#include <thread>
 #include <unordered_map>
 #include <unordered_set>
+#include <vector>
 
 template <typename It>
 class Range {
@@ -40,4 +48,43 @@ const V* GetValuePointer(const std::unordered_map<K, V>& map, const K& key) {
   }
 }
 
+// Calls func(idx) for every idx in [0, count) on thread_count threads, the calling one included.
+// Threads take indices one by one, so uneven items spread well. The first exception thrown
+// is rethrown once all threads have stopped; the items left after it are skipped.
+template <typename Func>
+void ParallelFor(size_t count, size_t thread_count, Func func) {
+  thread_count = std::max<size_t>(1, std::min(thread_count, count));
+  std::atomic<size_t> next_idx = 0;
+  std::exception_ptr exception;
+  std::mutex exception_mutex;
+  auto worker = [&] {
+    try {
+      for (size_t idx = next_idx++; idx < count; idx = next_idx++) {
+        func(idx);
+      }
+    } catch (...) {
+      std::lock_guard guard(exception_mutex);
+      if (!exception) {
+        exception = std::current_exception();
+      }
+      next_idx = count;
+    }
+  };
+
+  std::vector<std::thread> workers;
+  workers.reserve(thread_count - 1);
+  for (size_t i = 1; i < thread_count; ++i) {
+    workers.emplace_back(worker);
+  }
+  worker();
+  for (auto& worker_thread : workers) {
+    worker_thread.join();
+  }
+  if (exception) {
+    std::rethrow_exception(exception);
+  }
+}
+
 std::string_view Strip(std::string_view line);
+
+std::string ReadAll(std::istream& input);